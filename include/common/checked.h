@@ -7,9 +7,12 @@
 #ifndef _CHECKED_H_
 #define _CHECKED_H_
 
+#include <errno.h>
 #include <pthread.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "error.h"
 
@@ -66,6 +69,17 @@ checked_cond_wait_info(pthread_cond_t * cond, pthread_mutex_t * mutex, const cha
 }
 
 
+#define checked_cond_timedwait(cond, mutex, abstime) checked_cond_timedwait_info((cond), (mutex), (abstime), __FILE__, __FUNCTION__, __LINE__)
+
+/** Returns false if the absolute time passed, true otherwise. */
+static inline bool
+checked_cond_timedwait_info(pthread_cond_t * cond, pthread_mutex_t * mutex, const struct timespec * abstime, const char * restrict file, const char * restrict func, int line) {
+	int result = pthread_cond_timedwait(cond, mutex, abstime);
+	check_std_error(result != 0 && result != ETIMEDOUT, "failed to wait on condition at %s:%s:%d", file, func, line);
+	return result != ETIMEDOUT;
+}
+
+
 #define checked_cond_signal(cond) checked_cond_signal_info((cond), __FILE__, __FUNCTION__, __LINE__)
 
 static inline void
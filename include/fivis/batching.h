@@ -0,0 +1,113 @@
+/**
+ * Adaptive batching controller.
+ *
+ * Tunes the number of rows sent in a request and the interval between
+ * requests within configured bounds, based on the measured request latency
+ * and errors. The batch size is controlled in the AIMD style: it grows by
+ * a constant step while the latency stays close to the baseline (the lowest
+ * recently observed latency) and requests do not fail, and shrinks by a
+ * constant factor when the latency rises or a request fails. A backlog of
+ * rows is sent at the shortest interval, i.e., at the rate at which the
+ * requests complete, stretched by the recent error rate, otherwise the
+ * rows accumulate for the longest interval.
+ */
+
+#ifndef _BATCHING_H_
+#define _BATCHING_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+
+/** Bounds and tuning parameters of the batching controller. */
+struct batching_config {
+	/** Bounds of the number of rows in a request. */
+	size_t rows_min;
+	size_t rows_max;
+
+	/** Number of rows in the first request. */
+	size_t rows_initial;
+
+	/** Number of rows added to the batch size after a fast request. */
+	size_t rows_increase;
+
+	/** Factor (0-1) the batch size is multiplied by after a slow or failed request. */
+	double rows_decrease;
+
+	/**
+	 * Relative increase of the latency over the baseline which is still
+	 * considered flat, e.g., 0.5 allows 50% higher latency.
+	 */
+	double latency_tolerance;
+
+	/** Bounds of the interval between requests (in seconds). */
+	double interval_min_secs;
+	double interval_max_secs;
+};
+
+
+/** Represents the state of the batching controller. */
+struct batching {
+	struct batching_config config;
+
+	/** Current number of rows in a request. */
+	size_t rows;
+
+	/** Baseline latency (in seconds), zero until the first success. */
+	double baseline_secs;
+
+	/** Smoothed latency of successful requests (in seconds). */
+	double latency_secs;
+
+	/**
+	 * Smoothed ratio of failed requests (0-1). The batch size does not
+	 * grow while it is high, and it stretches the interval for a backlog.
+	 */
+	double error_rate;
+
+	/** Number of failed requests since the last success. */
+	size_t failures;
+};
+
+
+/**
+ * Initializes the controller with the given configuration. The
+ * configuration is copied and its values are adjusted to be consistent.
+ */
+void batching_init(struct batching * batching, const struct batching_config * config);
+
+
+/** Returns the number of rows to put in the next request. */
+size_t batching_rows(const struct batching * batching);
+
+
+/**
+ * Returns the time (in seconds) to wait before sending the next request,
+ * given the number of rows waiting to be sent. A full batch is sent after
+ * the shortest interval, extended towards the longest one in proportion to
+ * the recent error rate, a partial batch after the longest one. After
+ * failed requests, the interval doubles with each failure.
+ */
+double batching_interval(const struct batching * batching, size_t backlog_rows);
+
+
+/**
+ * Updates the controller with the outcome of a request containing the
+ * given number of rows and taking the given time (in seconds).
+ */
+void batching_update(
+	struct batching * batching, size_t rows, double latency_secs, bool success
+);
+
+//
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _BATCHING_H_ */
@@ -0,0 +1,42 @@
+/**
+ * Conversion of double values to decimal strings.
+ *
+ * Produces the shortest decimal representation which converts back to
+ * the same double value, using the Grisu2 algorithm by Florian Loitsch.
+ */
+
+#ifndef _DTOA_H_
+#define _DTOA_H_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+
+/**
+ * Minimum size of the buffer passed to dtoa_shortest(). The longest
+ * output is a negative number with 17 digits, a decimal point, and a
+ * three-digit exponent with sign, e.g., "-1.2345678901234567e-308".
+ */
+#define DTOA_BUFFER_SIZE 32
+
+
+/**
+ * Formats the given value into the given buffer (which must have at least
+ * DTOA_BUFFER_SIZE bytes) as the shortest decimal string that reads back as
+ * the same value. The output is a valid JSON number, except for NaN and
+ * infinite values, which are formatted as "null". The buffer is not zero
+ * terminated. Returns the number of bytes written.
+ */
+size_t dtoa_shortest(double value, char * buffer);
+
+//
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _DTOA_H_ */
@@ -7,10 +7,12 @@
 #ifndef _ENTRY_H_
 #define _ENTRY_H_
 
+#include <assert.h>
 #include <inttypes.h>
 #include <stdbool.h>
 #include <time.h>
 
+#include "json.h"
 #include "list.h"
 #include "sbuf.h"
 
@@ -30,10 +32,30 @@ union entry_value {
 	struct timespec as_timespec;
 };
 
+/** Identifies the type of values formatted by an entry. */
+enum entry_type {
+	/** Values are formatted by the entry's own value formatter. */
+	ENTRY_TYPE_CUSTOM = 0,
+
+	ENTRY_TYPE_BOOLEAN,
+	ENTRY_TYPE_SIGNED,
+	ENTRY_TYPE_DOUBLE,
+	ENTRY_TYPE_STRING,
+	ENTRY_TYPE_DATETIME,
+};
+
 typedef const char * (* entry_format_value_fn)(const char * restrict, union entry_value *, sbuf_t *);
 
 typedef const char * (* entry_format_type_fn)(const char * restrict, sbuf_t *);
 
+
+/**
+ * Precision value requesting the shortest representation of a double
+ * value which reads back as the same value.
+ */
+#define ENTRY_PRECISION_SHORTEST (-1)
+
+
 /** Represents a named entry which can format its type and a given value. */
 struct entry {
 	char * name;
@@ -41,6 +63,18 @@ struct entry {
 
 	entry_format_value_fn format_value;
 	entry_format_type_fn format_type;
+
+	/**
+	 * Type of the entry values. Allows formatting values of the built-in
+	 * types without calling the value formatter through a pointer.
+	 */
+	enum entry_type type;
+
+	/**
+	 * Number of decimals used when formatting double values, or
+	 * ENTRY_PRECISION_SHORTEST for the shortest round-trip format.
+	 */
+	int precision;
 };
 
 //
@@ -53,11 +87,23 @@ static inline struct entry entry_generic(
 		.link = LIST_INIT(result.link),
 		.format_value = format_value,
 		.format_type = format_type,
+		.type = ENTRY_TYPE_CUSTOM,
+		.precision = ENTRY_PRECISION_SHORTEST,
 	};
 
 	return result;
 }
 
+
+static inline struct entry entry_typed(
+	char * name, enum entry_type type,
+	entry_format_value_fn format_value, entry_format_type_fn format_type
+) {
+	struct entry result = entry_generic(name, format_value, format_type);
+	result.type = type;
+	return result;
+}
+
 //
 
 const char * entry_format_boolean_value(const char * restrict name, union entry_value * value, struct sbuf * buffer);
@@ -65,7 +111,7 @@ const char * entry_format_boolean_value(const char * restrict name, union entry_
 const char * entry_format_boolean_type(const char * restrict name, struct sbuf * buffer);
 
 static inline struct entry entry_boolean(char * name) {
-	return entry_generic(name, entry_format_boolean_value, entry_format_boolean_type);
+	return entry_typed(name, ENTRY_TYPE_BOOLEAN, entry_format_boolean_value, entry_format_boolean_type);
 }
 
 static inline void entry_init_boolean(struct entry * entry, char * name) {
@@ -79,7 +125,7 @@ const char * entry_format_signed_value(const char * restrict name, union entry_v
 const char * entry_format_signed_type(const char * restrict name, struct sbuf * buffer);
 
 static inline struct entry entry_signed(char * name) {
-	return entry_generic(name, entry_format_signed_value, entry_format_signed_type);
+	return entry_typed(name, ENTRY_TYPE_SIGNED, entry_format_signed_value, entry_format_signed_type);
 }
 
 static inline void entry_init_signed(struct entry * entry, char * name) {
@@ -88,18 +134,37 @@ static inline void entry_init_signed(struct entry * entry, char * name) {
 
 //
 
+/**
+ * Formats a double value in the shortest representation. Entries created
+ * using entry_double_fixed() are formatted with their precision by
+ * entry_format_value(), which does not call the value formatter.
+ */
 const char * entry_format_double_value(const char * restrict name, union entry_value * value, struct sbuf * buffer);
 
 const char * entry_format_double_type(const char * restrict name, struct sbuf * buffer);
 
 static inline struct entry entry_double(char * name) {
-	return entry_generic(name, entry_format_double_value, entry_format_double_type);
+	return entry_typed(name, ENTRY_TYPE_DOUBLE, entry_format_double_value, entry_format_double_type);
 }
 
 static inline void entry_init_double(struct entry * entry, char * name) {
 	*entry = entry_double(name);
 }
 
+/**
+ * Creates a double entry which formats values rounded to the given
+ * number of decimals (at most 18).
+ */
+static inline struct entry entry_double_fixed(char * name, int decimals) {
+	struct entry result = entry_double(name);
+	result.precision = decimals;
+	return result;
+}
+
+static inline void entry_init_double_fixed(struct entry * entry, char * name, int decimals) {
+	*entry = entry_double_fixed(name, decimals);
+}
+
 //
 
 const char * entry_format_string_value(const char * restrict name, union entry_value * value, struct sbuf * buffer);
@@ -107,7 +172,7 @@ const char * entry_format_string_value(const char * restrict name, union entry_v
 const char * entry_format_string_type(const char * restrict name, struct sbuf * buffer);
 
 static inline struct entry entry_string(char * name) {
-	return entry_generic(name, entry_format_string_value, entry_format_string_type);
+	return entry_typed(name, ENTRY_TYPE_STRING, entry_format_string_value, entry_format_string_type);
 }
 
 static inline void entry_init_string(struct entry * entry, char * name) {
@@ -117,12 +182,19 @@ static inline void entry_init_string(struct entry * entry, char * name) {
 
 //
 
+/**
+ * Formats a timestamp as a quoted ISO 8601 UTC datetime string with
+ * millisecond precision. The text for the most recent second is cached
+ * per thread, so formatting repeated or consecutive timestamps is cheap.
+ */
+const char * entry_format_datetime(const struct timespec * restrict ts, struct sbuf * buffer);
+
 const char * entry_format_datetime_value(const char * restrict name, union entry_value * value, struct sbuf * buffer);
 
 const char * entry_format_datetime_type(const char * restrict name, struct sbuf * buffer);
 
 static inline struct entry entry_datetime(char * name) {
-	return entry_generic(name, entry_format_datetime_value, entry_format_datetime_type);
+	return entry_typed(name, ENTRY_TYPE_DATETIME, entry_format_datetime_value, entry_format_datetime_type);
 }
 
 static inline void entry_init_datetime(struct entry * entry, char * name) {
@@ -133,9 +205,55 @@ static inline void entry_init_datetime(struct entry * entry, char * name) {
 
 void entry_destroy(struct entry * entry);
 
+/**
+ * Formats a value of a built-in type (without the entry name). Inlined
+ * into loops that format many values, so that the type dispatch is a
+ * simple branch instead of an indirect call.
+ */
+inline static const char *
+entry_format_typed_value(
+	enum entry_type type, int precision, union entry_value * v, sbuf_t * output
+) {
+	switch (type) {
+	case ENTRY_TYPE_BOOLEAN:
+		return v->as_boolean
+			? sbuf_append_literal(output, "true")
+			: sbuf_append_literal(output, "false");
+
+	case ENTRY_TYPE_SIGNED:
+		return sbuf_append_int64(output, v->as_signed);
+
+	case ENTRY_TYPE_DOUBLE:
+		return (precision == ENTRY_PRECISION_SHORTEST)
+			? sbuf_append_double(output, v->as_double)
+			: sbuf_append_double_fixed(output, v->as_double, precision);
+
+	case ENTRY_TYPE_STRING:
+		return json_append_cstring(output, v->as_string);
+
+	case ENTRY_TYPE_DATETIME:
+		return entry_format_datetime(&v->as_timespec, output);
+
+	default:
+		assert(false && "custom entries have no typed value formatter");
+		return NULL;
+	}
+}
+
+
+/**
+ * Formats the name and a value of the given entry. Values of built-in
+ * types are formatted directly, using the precision of the entry, only
+ * custom entries are formatted through their value formatter.
+ */
 inline static const char *
 entry_format_value(struct entry * e, union entry_value * v, sbuf_t * output) {
-	return e->format_value(e->name, v, output);
+	if (e->type == ENTRY_TYPE_CUSTOM) {
+		return e->format_value(e->name, v, output);
+	}
+
+	json_append_key(output, e->name);
+	return entry_format_typed_value(e->type, e->precision, v, output);
 }
 
 
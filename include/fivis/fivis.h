@@ -11,12 +11,17 @@
 
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdio.h>
 
 #include <curl/curl.h>
 
 #include "entry.h"
+#include "histogram.h"
 #include "sbuf.h"
 #include "list.h"
+#include "sbchain.h"
+#include "schema.h"
+#include "workers.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -24,6 +29,110 @@ extern "C" {
 
 //
 
+/**
+ * Statistics of the last request performed using a FIVIS context.
+ */
+struct fivis_request_stats {
+	/** Size of the request body before compression. */
+	size_t body_size;
+
+	/** Size of the request body sent, i.e., after compression. */
+	size_t sent_size;
+
+	/** CPU time spent compressing the request body (in nanoseconds). */
+	uint64_t compress_ns;
+};
+
+
+/**
+ * Connection statistics of a FIVIS context, counting the requests which
+ * reused an existing connection and the new connections established.
+ * Connections established by pre-warming are counted separately.
+ */
+struct fivis_connection_stats {
+	/** Number of requests performed (not counting pre-warming). */
+	size_t requests;
+
+	/** Number of successful requests which reused an existing connection. */
+	size_t reused_connections;
+
+	/** Number of new connections (i.e., TCP and TLS handshakes) made by requests. */
+	size_t new_connections;
+
+	/** Number of new connections made by pre-warming. */
+	size_t prewarm_connections;
+};
+
+
+/**
+ * Histograms of the requests performed using a FIVIS context. The times
+ * are the durations of the phases of a transfer (in microseconds), as
+ * reported by CURL. The connection setup phases are recorded only for
+ * transfers which established a new connection.
+ */
+struct fivis_request_histograms {
+	/** Time to resolve the host name. */
+	struct histogram namelookup_us;
+
+	/** Time to establish the (TCP) connection. */
+	struct histogram connect_us;
+
+	/** Time of the TLS handshake. */
+	struct histogram tls_us;
+
+	/**
+	 * Time from the start of sending the request to the first byte of the
+	 * response, i.e., the time to send the request and process it. Some
+	 * CURL versions report the first byte as soon as they start sending a
+	 * body pulled by a callback (e.g., a compressed body), which makes this
+	 * time close to zero for such requests.
+	 */
+	struct histogram first_byte_us;
+
+	/** Total time of the transfer. */
+	struct histogram total_us;
+
+	/** Average upload speed (in bytes per second). */
+	struct histogram upload_speed;
+
+	/** Size of the request body before compression (in bytes). */
+	struct histogram body_bytes;
+
+	/** Size of the request body sent (in bytes). */
+	struct histogram sent_bytes;
+
+	/** Number of data records in a request, if known. */
+	struct histogram records;
+};
+
+
+/** Maximum number of response body bytes kept in a response. */
+#define FIVIS_RESPONSE_SIZE_MAX ((size_t) 64 << 10)
+
+
+/**
+ * Response to the last request performed using a FIVIS context. The
+ * response body is captured into a buffer reused between requests.
+ */
+struct fivis_response {
+	/** HTTP response code, zero if no response was received. */
+	long code;
+
+	/** Delay requested by the Retry-After header (in seconds), or zero. */
+	long retry_after_secs;
+
+	/** Response body (at most FIVIS_RESPONSE_SIZE_MAX bytes). */
+	struct sbuf body;
+};
+
+
+/** Represents a transport delivering requests (opaque). */
+struct fivis_transport;
+
+/** Represents a stream compressing request bodies (see gzip.h). */
+struct gzip_stream;
+
+
 /**
  * Represents a FIVIS context.
  */
@@ -32,13 +141,42 @@ struct fivis {
 	char curl_error[CURL_ERROR_SIZE];
 	CURLU * api_url;
 	struct curl_slist * http_headers;
+
+	/** HTTP headers used for compressed requests. */
+	struct curl_slist * http_headers_gzip;
+
+	/** Compression level of request bodies, zero if disabled. */
+	int compression_level;
+
+	/**
+	 * Compression stream reused by requests with compressed bodies, or
+	 * NULL if not needed yet. Uses the current compression level.
+	 */
+	struct gzip_stream * gzip;
+
+	struct fivis_request_stats last_stats;
+
+	struct fivis_connection_stats connection_stats;
+
+	struct fivis_request_histograms histograms;
+
+	/** Transport delivering the requests (see fivis_init_transport()). */
+	const struct fivis_transport * transport;
+
+	/** Output stream of the file transport, or NULL. */
+	FILE * output;
+
+	/** Line assembled by the file transport, reused between requests. */
+	struct sbuf output_line;
+
+	struct fivis_response response;
 };
 
 
 /**
  * An error code returned by the fivis_signals_perform_request() function.
- * With the exception of FIVIS_ERR_NETWORK, most errors are probably permanent
- * and not worth retrying.
+ * Only errors marked as transient are worth retrying, see also
+ * fivis_result_is_transient().
  */
 typedef enum fivis_result {
 	/** The function completed normally. */
@@ -56,10 +194,31 @@ typedef enum fivis_result {
 	/** A location error occurred. Most likely misconfigured URL. Permanent. */
 	FIVIS_ERR_LOCATION = 4,
 
-	/** An error occured at the server. Mostly permanent. */
+	/** An error occured at the server (HTTP 5xx). May be transient. */
 	FIVIS_ERR_SERVER = 5,
+
+	/**
+	 * The server is overloaded or rate-limiting (HTTP 429 or 503). Transient,
+	 * retry after the delay requested by the server, if any.
+	 */
+	FIVIS_ERR_RETRY_LATER = 6,
+
+	/** The request is too large (HTTP 413). Permanent for the request. */
+	FIVIS_ERR_TOO_LARGE = 7,
+
+	/** The request timed out. May be transient. */
+	FIVIS_ERR_TIMEOUT = 8,
+
+	/** The server rejected the request (other HTTP 4xx). Permanent. */
+	FIVIS_ERR_CLIENT = 9,
 } fivis_result_t;
 
+/**
+ * Returns true if the given result indicates a transient error, i.e., the
+ * request may succeed if retried later.
+ */
+bool fivis_result_is_transient(fivis_result_t result);
+
 /**
  * Initializes the FIVIS module. Should be called once per process execution.
  * Returns true if the initialization succeeded, and false if there was a
@@ -81,12 +240,109 @@ const char * fivis_last_error(void);
  */
 struct fivis * fivis_init(const char * api_host, const char * api_token);
 
+/**
+ * Type of a transport delivering requests. Selects the meaning of the
+ * target parameter of fivis_init_transport().
+ */
+typedef enum fivis_transport_type {
+	/** HTTP(S) requests to the target API host. */
+	FIVIS_TRANSPORT_HTTP = 0,
+
+	/**
+	 * HTTP requests over a Unix domain socket with the target path, e.g.,
+	 * to a local relay. Avoids TLS on the loopback path.
+	 */
+	FIVIS_TRANSPORT_UNIX = 1,
+
+	/** Discards the requests, e.g., to measure the client overhead. */
+	FIVIS_TRANSPORT_NULL = 2,
+
+	/**
+	 * Appends the requests to the target file (or pipe) as newline-delimited
+	 * JSON, one request per line, e.g., for offline replay. The requests
+	 * are never compressed.
+	 */
+	FIVIS_TRANSPORT_FILE = 3,
+} fivis_transport_type_t;
+
+/**
+ * Allocates and initializes a FIVIS context delivering requests using the
+ * given type of transport to the given target (ignored by the null
+ * transport), with the given API token.
+ */
+struct fivis * fivis_init_transport(
+	fivis_transport_type_t type, const char * target, const char * api_token
+);
+
+/** Returns the name of the transport used by the given FIVIS context. */
+const char * fivis_transport_name(const struct fivis * fivis);
+
 /**
  * Releases resources associated with the given FIVIS context, including
  * the FIVIS context.
  */
 void fivis_cleanup(struct fivis * fivis);
 
+/**
+ * Sets the gzip compression level (1-9) of request bodies sent using the
+ * given FIVIS context. Level 0 disables compression. The request bodies
+ * are compressed while being sent, without making a compressed copy.
+ * Returns false if the level is not valid.
+ */
+bool fivis_set_compression(struct fivis * fivis, int level);
+
+/**
+ * Returns the statistics of the last request performed using the given
+ * FIVIS context, i.e., the compression ratio and the CPU cost.
+ */
+const struct fivis_request_stats * fivis_last_request_stats(const struct fivis * fivis);
+
+/**
+ * Enables or disables HTTP/2 for requests sent using the given FIVIS
+ * context. HTTP/2 is only used over TLS, if the server supports it.
+ * Returns false on failure.
+ */
+bool fivis_set_http2(struct fivis * fivis, bool enable);
+
+/**
+ * Establishes a connection to the API endpoint ahead of a request, e.g.,
+ * shortly before a scheduled flush, so that the request does not need to
+ * wait for DNS resolution and the TCP and TLS handshakes. Reuses an open
+ * connection if possible. Returns false if the connection fails.
+ */
+bool fivis_prewarm(struct fivis * fivis);
+
+/**
+ * Returns the connection statistics of the given FIVIS context, i.e.,
+ * how many requests reused a connection and how many connections were
+ * established by requests and by pre-warming.
+ */
+const struct fivis_connection_stats * fivis_connection_stats(const struct fivis * fivis);
+
+/**
+ * Returns the histograms of the requests performed using the given FIVIS
+ * context since it was created or since the histograms were reset.
+ */
+const struct fivis_request_histograms * fivis_request_histograms(const struct fivis * fivis);
+
+/** Resets the request histograms of the given FIVIS context. */
+void fivis_reset_request_histograms(struct fivis * fivis);
+
+/**
+ * Records the number of data records in the last request performed using
+ * the given FIVIS context. Streaming requests record the number of records
+ * automatically, but the records of requests formatted in advance are not
+ * known to the context.
+ */
+void fivis_record_request_records(struct fivis * fivis, size_t record_count);
+
+/**
+ * Returns the response to the last request performed using the given
+ * FIVIS context, including the response code, the Retry-After delay, and
+ * the (possibly truncated) response body.
+ */
+const struct fivis_response * fivis_last_response(const struct fivis * fivis);
+
 
 const char * fivis_signals_format_request(
 	const char * partner_id, const char * signal_set_id, struct list * schema,
@@ -95,10 +351,214 @@ const char * fivis_signals_format_request(
 	struct sbuf * output
 );
 
+/**
+ * Formats a request like fivis_signals_format_request(), but uses a schema
+ * compiled by schema_compile(), which avoids walking the list of signals
+ * and re-rendering signal names for every data record. If with_schema is
+ * true, the request includes the 'schema' attribute with the types of the
+ * compiled schema signals.
+ */
+const char * fivis_signals_format_compiled_request(
+	const char * partner_id, const char * signal_set_id, bool with_schema,
+	struct schema * schema,
+	union entry_value * (* next_value) (void *), void * next_value_state,
+	struct sbuf * output
+);
+
+/**
+ * Formats a request like fivis_signals_format_compiled_request(), but takes
+ * the data records from the given batches (see struct schema_batch) instead
+ * of calling a function for each value.
+ */
+const char * fivis_signals_format_batch_request(
+	const char * partner_id, const char * signal_set_id, bool with_schema,
+	struct schema * schema,
+	const struct schema_batch * batches, size_t batch_count,
+	struct sbuf * output
+);
+
+/**
+ * Formats a request like fivis_signals_format_batch_request(), but formats
+ * large batches concurrently using the given pool of workers (see
+ * schema_format_batches_parallel()). The output is identical.
+ */
+const char * fivis_signals_format_batch_request_parallel(
+	const char * partner_id, const char * signal_set_id, bool with_schema,
+	struct schema * schema,
+	const struct schema_batch * batches, size_t batch_count,
+	struct workers * workers, struct sbuf * output
+);
+
+/**
+ * Formats a request like fivis_signals_format_compiled_request(), but
+ * appends it to a segmented buffer, which avoids copying the request when
+ * the buffer grows. Suitable for large requests. Returns true on success,
+ * false on failure.
+ */
+bool fivis_signals_format_compiled_request_chain(
+	const char * partner_id, const char * signal_set_id, bool with_schema,
+	struct schema * schema,
+	union entry_value * (* next_value) (void *), void * next_value_state,
+	struct sbchain * output
+);
+
+/**
+ * Estimates the size of a request formatted by the function above with the
+ * given number of data records. Reserving the estimated size in the output
+ * buffer (see sbuf_reserve()) before formatting the request usually avoids
+ * all reallocations while formatting.
+ */
+size_t fivis_signals_estimate_request_size(
+	const char * partner_id, const char * signal_set_id, bool with_schema,
+	struct schema * schema, size_t record_count
+);
+
+/**
+ * Returns the largest number of data records for which the estimated size
+ * of a request (see above) does not exceed the given size. Returns zero if
+ * even a request with a single record may exceed the size.
+ */
+size_t fivis_signals_estimate_request_records(
+	const char * partner_id, const char * signal_set_id, bool with_schema,
+	struct schema * schema, size_t size_max
+);
+
 fivis_result_t fivis_signals_perform_request(
 	struct fivis * fivis, const char * data, size_t size
 );
 
+/**
+ * Performs a request formatted while it is being sent. The request is
+ * formatted like by fivis_signals_format_compiled_request(), but records
+ * are formatted only when CURL needs more data to send, so formatting
+ * overlaps with sending and the memory needed does not depend on the
+ * number of records. The next_value function is called from within
+ * CURL callbacks. The request cannot be repeated, because the values
+ * are consumed.
+ */
+fivis_result_t fivis_signals_perform_streaming_request(
+	struct fivis * fivis,
+	const char * partner_id, const char * signal_set_id, bool with_schema,
+	struct schema * schema,
+	union entry_value * (* next_value) (void *), void * next_value_state
+);
+
+/**
+ * Performs a request with data stored in a segmented buffer. The segments
+ * are passed to CURL one after another, without flattening them into a
+ * single string first. The buffer must not be modified during the call.
+ */
+fivis_result_t fivis_signals_perform_chain_request(
+	struct fivis * fivis, const struct sbchain * data
+);
+
+//
+
+/**
+ * Represents a sender which keeps multiple requests in flight at once, using
+ * a separate CURL session for each request (opaque). The requests complete
+ * in any order, but their results are reported in submission order. The
+ * request bodies are sent uncompressed; fivis_set_compression() only applies
+ * to FIVIS contexts.
+ */
+struct fivis_sender;
+
+/**
+ * Allocates and initializes a sender for the given host with the given API
+ * token. The window determines the maximum number of pending requests, i.e.,
+ * requests submitted, but not yet reported as completed.
+ */
+struct fivis_sender * fivis_sender_init(
+	const char * api_host, const char * api_token, size_t window
+);
+
+/**
+ * Releases resources associated with the given sender, including the
+ * sender. Aborts pending requests.
+ */
+void fivis_sender_cleanup(struct fivis_sender * sender);
+
+/** Returns the number of pending requests. */
+size_t fivis_sender_pending_count(const struct fivis_sender * sender);
+
+/** Returns true if no more requests can be submitted. */
+bool fivis_sender_is_full(const struct fivis_sender * sender);
+
+/**
+ * Submits a request with the given data and starts sending it. The data
+ * must remain valid until the request is reported as completed. The tag
+ * is reported together with the result of the request. Returns true on
+ * success, false if the request could not be submitted, e.g., because the
+ * sender is full.
+ */
+bool fivis_sender_submit(
+	struct fivis_sender * sender, const char * data, size_t size, void * tag
+);
+
+/**
+ * Lets the pending requests progress. If the oldest pending request has not
+ * completed yet, waits for network activity for up to the given timeout.
+ * Returns false if an error occurred.
+ */
+bool fivis_sender_poll(struct fivis_sender * sender, int timeout_ms);
+
+/**
+ * Reports the completion of the oldest pending request. Returns true and
+ * stores its result and tag (if tag is not NULL) if the oldest pending
+ * request has completed, otherwise returns false.
+ */
+bool fivis_sender_next_completed(
+	struct fivis_sender * sender, fivis_result_t * result, void ** tag
+);
+
+/**
+ * Returns the Retry-After delay (in seconds) of the last request reported
+ * by fivis_sender_next_completed(), or zero if the server did not ask for
+ * a delay.
+ */
+long fivis_sender_retry_after(const struct fivis_sender * sender);
+
+//
+
+/**
+ * Represents a thread-safe pool of FIVIS contexts (opaque). The contexts
+ * share DNS, TLS session, and connection caches, so that a connection (or
+ * TLS session) established by one context can be reused by the others.
+ */
+struct fivis_pool;
+
+/**
+ * Allocates and initializes a pool of the given number of FIVIS contexts
+ * for the given host with the given API token. Returns a pointer to the
+ * pool on success, NULL on failure.
+ */
+struct fivis_pool * fivis_pool_init(
+	const char * api_host, const char * api_token, size_t size
+);
+
+/**
+ * Releases resources associated with the given pool, including the pool
+ * and its contexts. All contexts must be returned to the pool.
+ */
+void fivis_pool_cleanup(struct fivis_pool * pool);
+
+/** Returns the number of contexts in the given pool. */
+size_t fivis_pool_size(const struct fivis_pool * pool);
+
+/**
+ * Checks out a context from the given pool, waiting until a context is
+ * available. The context must be used only by the calling thread until it
+ * is returned to the pool using fivis_pool_release().
+ */
+struct fivis * fivis_pool_acquire(struct fivis_pool * pool);
+
+/**
+ * Returns a context checked out using fivis_pool_acquire() to the pool.
+ * Returns false if the context does not belong to the pool or is not
+ * checked out, e.g., when it is released twice.
+ */
+bool fivis_pool_release(struct fivis_pool * pool, struct fivis * fivis);
+
 //
 
 #ifdef __cplusplus
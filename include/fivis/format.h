@@ -0,0 +1,211 @@
+/**
+ * Formatting of numbers into character arrays.
+ *
+ * The functions write the decimal representation of a value to the given
+ * destination and return a pointer just past the last character written.
+ * The output is not zero-terminated. The caller is responsible for making
+ * sure that the destination has room for the maximum length of the output.
+ */
+
+#ifndef _FORMAT_H_
+#define _FORMAT_H_
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "dtoa.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+
+/** Maximum length of a formatted 64-bit unsigned integer. */
+#define FORMAT_UINT64_LENGTH_MAX 20
+
+/** Maximum length of a formatted 64-bit signed integer. */
+#define FORMAT_INT64_LENGTH_MAX 20
+
+/**
+ * Maximum length of a formatted fixed-point number: sign, 19 digits of
+ * a 64-bit magnitude plus a leading zero, and a decimal point.
+ */
+#define FORMAT_FIXED_LENGTH_MAX 22
+
+/** Maximum length of a formatted double value. */
+#define FORMAT_DOUBLE_LENGTH_MAX DTOA_BUFFER_SIZE
+
+/** Maximum number of decimals of a fixed-point number. */
+#define FORMAT_DECIMALS_MAX 18
+
+
+/** Pairs of decimal digits for values 0-99, used to halve the divisions. */
+extern const char format_digit_pairs[200];
+
+/** Powers of ten representable in a 64-bit unsigned integer. */
+extern const uint64_t format_pow10[FORMAT_DECIMALS_MAX + 1];
+
+
+/** Returns the number of decimal digits of the given value. */
+static inline unsigned int
+format_count_digits(uint64_t value) {
+	unsigned int result = 1;
+	while (true) {
+		if (value < 10) return result;
+		if (value < 100) return result + 1;
+		if (value < 1000) return result + 2;
+		if (value < 10000) return result + 3;
+
+		value /= 10000;
+		result += 4;
+	}
+}
+
+
+/**
+ * Writes the given number of least significant digits of the value
+ * backwards, ending just before the given end pointer.
+ */
+static inline void
+__format_digits_backwards(char * end, uint64_t value, unsigned int digits) {
+	while (digits >= 2) {
+		const char * pair = &format_digit_pairs[(value % 100) * 2];
+		value /= 100;
+
+		*--end = pair[1];
+		*--end = pair[0];
+		digits -= 2;
+	}
+
+	if (digits > 0) {
+		*--end = (char) ('0' + value % 10);
+	}
+}
+
+
+static inline char *
+format_uint64(char * dest, uint64_t value) {
+	unsigned int digits = format_count_digits(value);
+	__format_digits_backwards(dest + digits, value, digits);
+	return dest + digits;
+}
+
+
+/**
+ * Formats an unsigned integer padded with leading zeros to at least the
+ * given width (at most FORMAT_UINT64_LENGTH_MAX).
+ */
+static inline char *
+format_uint64_padded(char * dest, uint64_t value, unsigned int width) {
+	unsigned int digits = format_count_digits(value);
+	if (digits < width) {
+		digits = width;
+	}
+
+	__format_digits_backwards(dest + digits, value, digits);
+	return dest + digits;
+}
+
+
+static inline char *
+format_int64(char * dest, int64_t value) {
+	if (value < 0) {
+		// Negate in unsigned arithmetic to handle INT64_MIN.
+		*dest++ = '-';
+		return format_uint64(dest, -(uint64_t) value);
+	} else {
+		return format_uint64(dest, (uint64_t) value);
+	}
+}
+
+
+/**
+ * Formats a fixed-point number, i.e., an integer scaled by 10^decimals,
+ * so that 12345 with 2 decimals is formatted as "123.45".
+ */
+static inline char *
+format_fixed(char * dest, int64_t value, unsigned int decimals) {
+	assert(decimals <= FORMAT_DECIMALS_MAX);
+
+	if (decimals == 0) {
+		return format_int64(dest, value);
+	}
+
+	uint64_t magnitude = (value < 0) ? -(uint64_t) value : (uint64_t) value;
+	if (value < 0) {
+		*dest++ = '-';
+	}
+
+	uint64_t scale = format_pow10[decimals];
+	dest = format_uint64(dest, magnitude / scale);
+	*dest++ = '.';
+
+	__format_digits_backwards(dest + decimals, magnitude % scale, decimals);
+	return dest + decimals;
+}
+
+
+/**
+ * Formats a double value in the shortest representation which reads back
+ * as the same value. NaN and infinite values are formatted as "null".
+ */
+static inline char *
+format_double(char * dest, double value) {
+	return dest + dtoa_shortest(value, dest);
+}
+
+
+/**
+ * Formats a double value rounded to the given number of decimals using
+ * snprintf(), dropping the sign of negative values which round to zero.
+ * The slow path of format_double_fixed().
+ */
+char * format_double_fixed_exact(char * dest, double value, unsigned int decimals);
+
+
+/**
+ * Formats a double value rounded to the given number of decimals, with the
+ * same digits as printf("%.*f"). The sign of negative values which round
+ * to zero is dropped, i.e., they are formatted as "0.00" (not "-0.00").
+ * Values which do not fit into a fixed-point number with the given number
+ * of decimals are formatted in the shortest form.
+ */
+static inline char *
+format_double_fixed(char * dest, double value, unsigned int decimals) {
+	assert(decimals <= FORMAT_DECIMALS_MAX);
+
+	// This also catches NaN and infinite values.
+	double scaled = value * (double) format_pow10[decimals];
+	if (!(scaled > (double) INT64_MIN && scaled < (double) INT64_MAX)) {
+		return format_double(dest, value);
+	}
+
+	double magnitude = (scaled < 0) ? -scaled : scaled;
+	uint64_t whole = (uint64_t) magnitude;
+	double fraction = magnitude - (double) whole;
+
+	//
+	// The scaled value may differ from the exact product by half an ulp,
+	// which decides the rounding only if the fraction is that close to a
+	// half. Such values (and values too large to have a fraction) are
+	// rounded exactly by the slow path.
+	//
+	double error_max = magnitude * 0x1p-52;
+	if (fraction - 0.5 <= error_max && 0.5 - fraction <= error_max) {
+		return format_double_fixed_exact(dest, value, decimals);
+	}
+
+	int64_t fixed = (int64_t) (whole + (fraction > 0.5));
+	return format_fixed(dest, (scaled < 0) ? -fixed : fixed, decimals);
+}
+
+//
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _FORMAT_H_ */
@@ -0,0 +1,106 @@
+/**
+ * Streaming gzip compression.
+ *
+ * Compresses data pulled from a source function into the gzip format
+ * while it is being read, so that the compressed data never needs to be
+ * stored as a whole. The stream keeps track of the number of bytes read
+ * and produced, and of the CPU time spent compressing.
+ */
+
+#ifndef _GZIP_H_
+#define _GZIP_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <zlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+
+/** Value returned by read functions to indicate failure. */
+#define GZIP_READ_ERROR ((size_t) -1)
+
+/** Size of the buffer for uncompressed data read from the source. */
+#define GZIP_INPUT_SIZE ((size_t) 16 << 10)
+
+
+/**
+ * Function providing uncompressed data. Copies up to the given number
+ * of bytes to the buffer and returns the number of bytes copied, zero at
+ * the end of the data, or GZIP_READ_ERROR on failure.
+ */
+typedef size_t (* gzip_source_t) (char * buffer, size_t size, void * arg);
+
+
+/** Represents a stream compressing data provided by a source function. */
+struct gzip_stream {
+	z_stream zstream;
+
+	gzip_source_t source;
+	void * source_arg;
+
+	/** Set when the source has no more data. */
+	bool input_done;
+
+	/** Set when all compressed data has been produced. */
+	bool finished;
+
+	/** Number of uncompressed bytes read from the source. */
+	size_t input_bytes;
+
+	/** Number of compressed bytes produced. */
+	size_t output_bytes;
+
+	/** CPU time spent compressing (in nanoseconds). */
+	uint64_t compress_ns;
+
+	/** Uncompressed data read from the source. */
+	char input[GZIP_INPUT_SIZE];
+};
+
+
+/**
+ * Initializes a stream compressing data from the given source using the
+ * given compression level (1-9). Returns true on success, false on failure.
+ */
+bool gzip_stream_init(
+	struct gzip_stream * stream, int level,
+	gzip_source_t source, void * source_arg
+);
+
+
+/**
+ * Restarts the stream to compress data from the given source, keeping the
+ * compression level and the memory allocated for the stream. The data
+ * compressed so far are discarded. Returns true on success, false on
+ * failure.
+ */
+bool gzip_stream_reset(
+	struct gzip_stream * stream, gzip_source_t source, void * source_arg
+);
+
+
+/** Releases the resources held by the stream. */
+void gzip_stream_destroy(struct gzip_stream * stream);
+
+
+/**
+ * Reads compressed data from the stream. Copies up to the given number of
+ * bytes to the destination and returns the number of bytes copied, which
+ * is zero only at the end of the stream. Returns GZIP_READ_ERROR if the
+ * source or the compression fails.
+ */
+size_t gzip_stream_read(struct gzip_stream * stream, char * dest, size_t size);
+
+//
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _GZIP_H_ */
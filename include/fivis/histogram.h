@@ -0,0 +1,89 @@
+/**
+ * Histogram of unsigned integer values with fixed buckets.
+ *
+ * The buckets have logarithmic widths: each power of two is split into
+ * HISTOGRAM_SUB_BUCKETS buckets of equal width, so that the relative error
+ * of a value derived from a bucket is below 1 / HISTOGRAM_SUB_BUCKETS for
+ * any value. Recording a value only increments a counter, which makes the
+ * histogram cheap enough to update for every request.
+ */
+
+#ifndef _HISTOGRAM_H_
+#define _HISTOGRAM_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+
+/** Number of bits of a value (below its most significant bit) selecting a bucket. */
+#define HISTOGRAM_SUB_BITS 2
+
+/** Number of buckets per power of two. */
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+
+/** Number of buckets covering all 64-bit values. */
+#define HISTOGRAM_BUCKET_COUNT ((64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+
+/** Represents a histogram. */
+struct histogram {
+	/** Number of values recorded. */
+	uint64_t count;
+
+	/** Sum of the values recorded (wraps around on overflow). */
+	uint64_t sum;
+
+	/** Smallest and largest values recorded (valid if count > 0). */
+	uint64_t min;
+	uint64_t max;
+
+	/** Number of values recorded in each bucket. */
+	uint64_t buckets[HISTOGRAM_BUCKET_COUNT];
+};
+
+
+/** Removes all values from the histogram. */
+void histogram_reset(struct histogram * histogram);
+
+
+/** Returns the index of the bucket holding the given value. */
+size_t histogram_bucket(uint64_t value);
+
+
+/** Returns the smallest value held by the bucket with the given index. */
+uint64_t histogram_bucket_min(size_t bucket);
+
+
+/** Returns the largest value held by the bucket with the given index. */
+uint64_t histogram_bucket_max(size_t bucket);
+
+
+/** Records a value in the histogram. */
+void histogram_record(struct histogram * histogram, uint64_t value);
+
+
+/** Returns the mean of the recorded values, or zero if there are none. */
+double histogram_mean(const struct histogram * histogram);
+
+
+/**
+ * Returns the value below or at which the given fraction (0-1) of the
+ * recorded values lies, approximated by the largest value of its bucket,
+ * but never above the largest value recorded. Returns zero if there are
+ * no values.
+ */
+uint64_t histogram_quantile(const struct histogram * histogram, double fraction);
+
+//
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _HISTOGRAM_H_ */
@@ -0,0 +1,52 @@
+/**
+ * JSON string escaping.
+ *
+ * Appends strings to a string buffer as quoted JSON strings. Quotes,
+ * backslashes and control characters are escaped, and invalid UTF-8
+ * sequences are replaced by the U+FFFD replacement character, so that
+ * the resulting document is always valid JSON.
+ */
+
+#ifndef _JSON_H_
+#define _JSON_H_
+
+#include <stddef.h>
+
+#include "sbuf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+
+/**
+ * Appends the given number of bytes of a string as a quoted and escaped
+ * JSON string. Returns a pointer to the contents of the buffer on success,
+ * or NULL if the operation fails.
+ */
+char * json_append_string(sbuf_t * sb, const char * restrict str, size_t length);
+
+
+/**
+ * Appends a zero-terminated string as a quoted and escaped JSON string.
+ * Returns a pointer to the contents of the buffer on success, or NULL if
+ * the operation fails.
+ */
+char * json_append_cstring(sbuf_t * sb, const char * restrict str);
+
+
+/**
+ * Appends a JSON object member prefix in the form `"key": `, with the key
+ * quoted and escaped. Returns a pointer to the contents of the buffer on
+ * success, or NULL if the operation fails.
+ */
+char * json_append_key(sbuf_t * sb, const char * restrict key);
+
+//
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _JSON_H_ */
@@ -0,0 +1,309 @@
+/**
+ * Segmented string buffer.
+ *
+ * Allows appending strings into a chain of fixed-size segments. Unlike the
+ * simple string buffer, the chain never reallocates or copies its contents
+ * when it grows, which keeps the peak memory usage close to the size of the
+ * contents even for very large buffers. The contents are not contiguous and
+ * are not zero-terminated. They are meant to be consumed segment by segment,
+ * e.g., by a transport sending the segments one after another.
+ *
+ * Segments are taken from (and returned to) an optional segment pool, which
+ * keeps released segments for reuse.
+ */
+
+#ifndef _SBCHAIN_H_
+#define _SBCHAIN_H_
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "sbuf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+
+/** Represents a segment of a segmented string buffer. */
+struct sbchain_segment {
+	/** The next segment in the chain, or NULL. */
+	struct sbchain_segment * next;
+
+	/** Number of bytes used in the segment. */
+	size_t length;
+
+	/** Contents of the segment (SBCHAIN_SEGMENT_CAPACITY bytes). */
+	char data[];
+};
+
+
+/** Size of a segment, including the segment header (64 KiB). */
+#define SBCHAIN_SEGMENT_SIZE ((size_t) 64 << 10)
+
+/** Number of content bytes in a segment. */
+#define SBCHAIN_SEGMENT_CAPACITY \
+	(SBCHAIN_SEGMENT_SIZE - offsetof(struct sbchain_segment, data))
+
+
+/**
+ * Represents a pool of free segments. The pool is not thread-safe, so it
+ * should be only used by chains used by a single thread at a time.
+ */
+struct sbchain_pool {
+	/** List of free segments. */
+	struct sbchain_segment * free;
+
+	/** Number of free segments. */
+	size_t free_count;
+
+	/** Maximum number of free segments kept in the pool. */
+	size_t free_max;
+};
+
+
+/**
+ * Constant initializer for a segment pool keeping at most the given number
+ * of free segments.
+ */
+#define SBCHAIN_POOL_INIT(max) \
+	(struct sbchain_pool) { .free = NULL, .free_count = 0, .free_max = (max) }
+
+
+/** Releases all free segments kept in the given pool. */
+void sbchain_pool_destroy(struct sbchain_pool * pool);
+
+
+/** Represents a segmented string buffer. */
+struct sbchain {
+	/** The first segment of the chain, or NULL. */
+	struct sbchain_segment * head;
+
+	/** The last segment of the chain, or NULL. */
+	struct sbchain_segment * tail;
+
+	/** Total number of bytes in all segments. */
+	size_t length;
+
+	/** Pool to take segments from, or NULL to allocate them directly. */
+	struct sbchain_pool * pool;
+};
+
+
+/**
+ * Constant initializer for a segmented string buffer using the given
+ * segment pool (may be NULL).
+ */
+#define SBCHAIN_INIT(segment_pool) \
+	(struct sbchain) { .head = NULL, .tail = NULL, .length = 0, .pool = (segment_pool) }
+
+
+/** Initializes the given chain to use the given segment pool (may be NULL). */
+void sbchain_init(struct sbchain * chain, struct sbchain_pool * pool);
+
+
+/**
+ * Destroys the chain. Returns all segments to the pool (or releases them).
+ * The chain structure can be reused.
+ */
+void sbchain_destroy(struct sbchain * chain);
+
+
+/**
+ * Clears the contents of the chain. Keeps the first segment for reuse and
+ * returns the others to the pool (or releases them).
+ */
+void sbchain_clear(struct sbchain * chain);
+
+
+/** Returns the total length of the chain contents. */
+static inline size_t
+sbchain_length(const struct sbchain * chain) {
+	return chain->length;
+}
+
+
+/** Returns true if the chain is empty. */
+static inline bool
+sbchain_is_empty(const struct sbchain * chain) {
+	return chain->length == 0;
+}
+
+
+/**
+ * Appends a new empty segment to the chain. Returns a pointer to the
+ * segment, or NULL if the segment cannot be allocated.
+ */
+struct sbchain_segment * sbchain_add_segment(struct sbchain * chain);
+
+
+/**
+ * Makes room for appending up to the given number of contiguous bytes (at
+ * most SBCHAIN_SEGMENT_CAPACITY) and returns a pointer to the end of the
+ * chain contents, where the caller can write directly. If the last segment
+ * does not have enough room, the rest of it remains unused and the write
+ * continues in a new segment. The write is completed by calling
+ * sbchain_commit(). Returns NULL if a segment cannot be allocated.
+ */
+static inline char *
+sbchain_extend(struct sbchain * chain, size_t length) {
+	assert(length <= SBCHAIN_SEGMENT_CAPACITY);
+
+	struct sbchain_segment * tail = chain->tail;
+	if (tail == NULL || SBCHAIN_SEGMENT_CAPACITY - tail->length < length) {
+		tail = sbchain_add_segment(chain);
+		if (tail == NULL) {
+			return NULL;
+		}
+	}
+
+	return tail->data + tail->length;
+}
+
+
+/**
+ * Completes a direct write started by sbchain_extend(). The given pointer
+ * points just past the last byte written.
+ */
+static inline void
+sbchain_commit(struct sbchain * chain, char * end) {
+	struct sbchain_segment * tail = chain->tail;
+	size_t length = end - tail->data;
+
+	chain->length += length - tail->length;
+	tail->length = length;
+}
+
+
+/**
+ * Appends the given number of bytes to the chain. The bytes are copied
+ * verbatim and may span several segments. Returns true on success, false
+ * if the operation fails.
+ */
+bool sbchain_append_bytes(struct sbchain * chain, const char * restrict data, size_t length);
+
+
+/**
+ * Appends the given string to the chain (the string is copied). Returns true
+ * on success, false if the operation fails.
+ */
+bool sbchain_append(struct sbchain * chain, const char * restrict str);
+
+
+/**
+ * Appends a string literal to the chain. The length of the literal is
+ * determined at compile time, so this only works with literals.
+ */
+#define sbchain_append_literal(chain, literal) \
+	sbchain_append_bytes((chain), "" literal, sizeof(literal) - 1)
+
+
+/** Appends the contents of the given string buffer to the chain. */
+bool sbchain_append_sbuf(struct sbchain * chain, sbuf_t * sb);
+
+
+/** Appends a single character to the chain. */
+bool sbchain_append_char(struct sbchain * chain, char c);
+
+
+/** Appends the decimal representation of a signed integer to the chain. */
+bool sbchain_append_int64(struct sbchain * chain, int64_t value);
+
+
+/** Appends the decimal representation of an unsigned integer to the chain. */
+bool sbchain_append_uint64(struct sbchain * chain, uint64_t value);
+
+
+/**
+ * Appends the decimal representation of an unsigned integer to the chain,
+ * padded with leading zeros to at least the given width (at most 20 digits).
+ */
+bool sbchain_append_uint64_padded(struct sbchain * chain, uint64_t value, unsigned int width);
+
+
+/**
+ * Appends a fixed-point number (an integer scaled by 10^decimals) to the
+ * chain. See sbuf_append_fixed().
+ */
+bool sbchain_append_fixed(struct sbchain * chain, int64_t value, unsigned int decimals);
+
+
+/**
+ * Appends the shortest decimal representation of a double value to the
+ * chain. See sbuf_append_double().
+ */
+bool sbchain_append_double(struct sbchain * chain, double value);
+
+
+/**
+ * Appends a double value rounded to the given number of decimals to the
+ * chain. See sbuf_append_double_fixed().
+ */
+bool sbchain_append_double_fixed(struct sbchain * chain, double value, unsigned int decimals);
+
+
+/**
+ * Appends a quoted key followed by a colon and a space to the chain. The
+ * key is copied verbatim. See sbuf_append_key().
+ */
+bool sbchain_append_key(struct sbchain * chain, const char * restrict key);
+
+
+/**
+ * Appends a formatted string to the chain. Returns true on success, false
+ * if the operation fails.
+ */
+bool sbchain_vformat(struct sbchain * chain, const char * restrict format, va_list args);
+
+
+/**
+ * Appends a formatted string to the chain. Returns true on success, false
+ * if the operation fails.
+ */
+bool sbchain_format(struct sbchain * chain, const char * restrict format, ...);
+
+
+/**
+ * Copies the contents of the chain to the given string buffer, e.g., for
+ * debugging. Returns a pointer to the contents of the string buffer on
+ * success, or NULL if the operation fails.
+ */
+char * sbchain_copy_to_sbuf(const struct sbchain * chain, sbuf_t * sb);
+
+//
+
+/** Represents a position for reading the contents of a chain. */
+struct sbchain_reader {
+	/** The current segment, or NULL at the end of the chain. */
+	const struct sbchain_segment * segment;
+
+	/** Offset of the next byte in the current segment. */
+	size_t offset;
+};
+
+
+/** Initializes the reader to the start of the given chain. */
+static inline void
+sbchain_reader_init(struct sbchain_reader * reader, const struct sbchain * chain) {
+	*reader = (struct sbchain_reader) { .segment = chain->head, .offset = 0 };
+}
+
+
+/**
+ * Copies up to the given number of bytes from the current position of the
+ * reader to the destination and advances the reader. Returns the number of
+ * bytes copied, which is zero only at the end of the chain.
+ */
+size_t sbchain_read(struct sbchain_reader * reader, char * dest, size_t size);
+
+//
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SBCHAIN_H_ */
@@ -9,6 +9,7 @@
 #ifndef _SBUF_H_
 #define _SBUF_H_
 
+#include <inttypes.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stddef.h>
@@ -28,13 +29,24 @@ struct sbuf {
 
 	/** Offset of the next available byte. */
 	size_t next;
+
+	/**
+	 * Maximum number of bytes by which the buffer grows at once, or zero
+	 * for the default (SBUF_GROWTH_MAX_DEFAULT). Below this limit, the
+	 * buffer doubles its size whenever it needs to grow.
+	 */
+	size_t growth_max;
 };
 
 typedef struct sbuf sbuf_t;
 
 
+/** Default maximum growth step of a buffer (16 MiB). */
+#define SBUF_GROWTH_MAX_DEFAULT ((size_t) 16 << 20)
+
+
 /** Constant initializer for a string buffer. */
-#define SBUF_INIT() (sbuf_t) { .data = NULL, .size = 0, .next = 0 }
+#define SBUF_INIT() (sbuf_t) { .data = NULL, .size = 0, .next = 0, .growth_max = 0 }
 
 
 /** Initializes the given string buffer. */
@@ -53,6 +65,26 @@ void sbuf_destroy(sbuf_t * sb);
 void sbuf_clear(sbuf_t * sb);
 
 
+/**
+ * Sets the maximum number of bytes by which the buffer grows at once.
+ * Zero selects the default. The setting survives sbuf_destroy().
+ */
+static inline void
+sbuf_set_growth_max(sbuf_t * sb, size_t growth_max) {
+	sb->growth_max = growth_max;
+}
+
+
+/**
+ * Makes sure the buffer has room for at least the given total number of
+ * bytes (including the terminating zero byte), so that appending contents
+ * up to that size will not cause reallocation. Never shrinks the buffer.
+ * Returns a pointer to the contents of the buffer on success, or NULL if
+ * the buffer cannot be grown.
+ */
+char * sbuf_reserve(sbuf_t * sb, size_t size);
+
+
 /**
  * Appends a formatted string to the buffer. Returns a pointer to the contents
  * of the buffer on success, or NULL if the operation fails.
@@ -75,6 +107,94 @@ char * sbuf_format(sbuf_t * sb, const char * restrict format, ...);
 char * sbuf_append(sbuf_t * sb, const char * restrict str);
 
 
+/**
+ * Appends the given number of bytes to the buffer. The bytes are copied
+ * verbatim and the buffer contents remain zero-terminated. Returns a pointer
+ * to the contents of the buffer on success, or NULL if the operation fails.
+ */
+char * sbuf_append_bytes(sbuf_t * sb, const char * restrict data, size_t length);
+
+
+/**
+ * Appends a string literal to the buffer. The length of the literal is
+ * determined at compile time, so this only works with literals.
+ */
+#define sbuf_append_literal(sb, literal) \
+	sbuf_append_bytes((sb), "" literal, sizeof(literal) - 1)
+
+
+/**
+ * Appends a single character to the buffer. Returns a pointer to the
+ * contents of the buffer on success, or NULL if the operation fails.
+ */
+char * sbuf_append_char(sbuf_t * sb, char c);
+
+
+/**
+ * Appends the decimal representation of a signed integer to the buffer.
+ * Returns a pointer to the contents of the buffer on success, or NULL if
+ * the operation fails.
+ */
+char * sbuf_append_int64(sbuf_t * sb, int64_t value);
+
+
+/**
+ * Appends the decimal representation of an unsigned integer to the buffer.
+ * Returns a pointer to the contents of the buffer on success, or NULL if
+ * the operation fails.
+ */
+char * sbuf_append_uint64(sbuf_t * sb, uint64_t value);
+
+
+/**
+ * Appends the decimal representation of an unsigned integer to the buffer,
+ * padded with leading zeros to at least the given width (at most 20 digits).
+ * Returns a pointer to the contents of the buffer on success, or NULL if
+ * the operation fails.
+ */
+char * sbuf_append_uint64_padded(sbuf_t * sb, uint64_t value, unsigned int width);
+
+
+/**
+ * Appends a fixed-point number to the buffer. The value is interpreted as
+ * an integer scaled by 10^decimals, i.e., the value 12345 with 2 decimals
+ * is appended as "123.45". At most 18 decimals are supported. Returns a
+ * pointer to the contents of the buffer on success, or NULL if the operation
+ * fails.
+ */
+char * sbuf_append_fixed(sbuf_t * sb, int64_t value, unsigned int decimals);
+
+
+/**
+ * Appends the shortest decimal representation of a double value which
+ * reads back as the same value. NaN and infinite values are appended as
+ * "null". Returns a pointer to the contents of the buffer on success, or
+ * NULL if the operation fails.
+ */
+char * sbuf_append_double(sbuf_t * sb, double value);
+
+
+/**
+ * Appends a double value rounded to the given number of decimals (at most
+ * 18), with the same digits as printf("%.*f"). The sign of negative values
+ * which round to zero is dropped. Values too large to be represented as
+ * fixed-point numbers with the given number of decimals are appended in
+ * the shortest representation.
+ * Returns a pointer to the contents of the buffer on success, or NULL if
+ * the operation fails.
+ */
+char * sbuf_append_double_fixed(sbuf_t * sb, double value, unsigned int decimals);
+
+
+/**
+ * Appends a quoted key followed by a colon and a space, i.e., a JSON object
+ * member prefix in the form `"key": `. The key is copied verbatim. Returns a
+ * pointer to the contents of the buffer on success, or NULL if the operation
+ * fails.
+ */
+char * sbuf_append_key(sbuf_t * sb, const char * restrict key);
+
+
 char * sbuf_set_vformat(sbuf_t * sb, const char * restrict format, va_list args);
 
 
@@ -89,6 +209,47 @@ char * sbuf_set_format(sbuf_t * sb, const char * restrict format, ...);
 char * sbuf_set(sbuf_t * sb, const char * restrict str);
 
 
+/**
+ * Ensures that at least the given number of bytes can be written past the
+ * end of the buffer contents without reallocation. The buffer grows
+ * geometrically, so that a sequence of appends causes only a logarithmic
+ * number of reallocations. Returns a pointer to the contents of the buffer
+ * on success, or NULL if the buffer cannot be grown.
+ */
+char * sbuf_ensure_capacity(sbuf_t * sb, size_t capacity);
+
+
+/**
+ * Makes room for appending up to the given number of bytes (plus the
+ * terminating zero byte) and returns a pointer to the end of the buffer
+ * contents, where the caller can write directly. The write is completed
+ * by calling sbuf_commit(). Returns NULL if the buffer cannot be grown.
+ */
+static inline char *
+sbuf_extend(sbuf_t * sb, size_t length) {
+	if (sb->size - sb->next <= length) {
+		if (sbuf_ensure_capacity(sb, length + 1) == NULL) {
+			return NULL;
+		}
+	}
+
+	return sb->data + sb->next;
+}
+
+
+/**
+ * Completes a direct write started by sbuf_extend(). The given pointer
+ * points just past the last byte written. Terminates the buffer contents
+ * with a zero byte and returns a pointer to the contents of the buffer.
+ */
+static inline char *
+sbuf_commit(sbuf_t * sb, char * end) {
+	*end = '\0';
+	sb->next = end - sb->data;
+	return sb->data;
+}
+
+
 /** Returns true if the buffer is empty. */
 static inline bool sbuf_is_empty(sbuf_t * sb) {
 	return sb->data == NULL || sb->size == 0 || sb->next == 0;
@@ -0,0 +1,235 @@
+/**
+ * Compiled schema of a signal set.
+ *
+ * A compiled schema is built once from the 'id' signal and the list of
+ * signals, and allows formatting data rows without walking the list of
+ * entries or re-rendering signal names. It holds a contiguous array of
+ * signals, each with a pre-rendered key prefix and a type tag.
+ */
+
+#ifndef _SCHEMA_H_
+#define _SCHEMA_H_
+
+#include <stddef.h>
+
+#include "entry.h"
+#include "list.h"
+#include "sbchain.h"
+#include "sbuf.h"
+#include "workers.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+
+/** Represents a signal in a compiled schema. */
+struct schema_signal {
+	/**
+	 * Pre-rendered text preceding the value, i.e., the delimiter followed
+	 * by the quoted signal name and a colon. For custom entries, which
+	 * format the signal name themselves, only the delimiter.
+	 */
+	const char * prefix;
+
+	/** Length of the prefix. */
+	size_t prefix_length;
+
+	/** Type of the signal values. */
+	enum entry_type type;
+
+	/** Precision of double values. */
+	int precision;
+
+	/**
+	 * Maximum length of a formatted value, or zero if the length of
+	 * values of the signal type is not bounded.
+	 */
+	size_t value_length_max;
+
+	/**
+	 * Number of consecutive signals, starting with this one, which have
+	 * the same type and precision. Allows formatting runs of signals of
+	 * the same type in type-specialized loops.
+	 */
+	size_t run_length;
+
+	/** The original entry, used to format values of custom entries. */
+	struct entry * entry;
+};
+
+
+/** Represents a compiled schema. */
+struct schema {
+	/**
+	 * Number of signals, including the 'id' signal, which is always
+	 * the first signal in the array.
+	 */
+	size_t signal_count;
+
+	/** Array of signals. */
+	struct schema_signal * signals;
+
+	/** Storage for all signal prefixes. */
+	char * prefixes;
+
+	/**
+	 * Maximum length of a data record, not counting values of signals
+	 * with unbounded value length.
+	 */
+	size_t record_length_max;
+
+	/** Pre-rendered types of the signals (excluding the 'id' signal). */
+	struct sbuf types;
+};
+
+
+/**
+ * Compiles a schema from the given 'id' signal and an optional list of
+ * other signals. The entries must remain valid for the lifetime of the
+ * compiled schema. Returns a pointer to the compiled schema on success,
+ * NULL on failure.
+ */
+struct schema * schema_compile(struct entry * id_signal, struct list * signals);
+
+
+/** Releases the given compiled schema. Does not release the entries. */
+void schema_destroy(struct schema * schema);
+
+
+/**
+ * Appends the pre-rendered types of the schema signals (excluding the 'id'
+ * signal), i.e., the contents of the 'schema' attribute of a request.
+ */
+const char * schema_format_types(struct schema * schema, struct sbuf * output);
+
+
+/**
+ * Estimates the size of the given number of data records formatted by
+ * schema_format_data(). The estimate is an upper bound for signals of
+ * built-in types except strings. For strings and custom entries, it
+ * assumes typical value lengths.
+ */
+size_t schema_estimate_data_size(struct schema * schema, size_t record_count);
+
+
+/**
+ * Formats data records for as long as the next_value function returns
+ * non-NULL values. Each record starts with the 'id' signal value, followed
+ * by the values of the other signals in schema order.
+ */
+const char * schema_format_data(
+	struct schema * schema,
+	union entry_value * (* next_value) (void *), void * next_value_state,
+	struct sbuf * output
+);
+
+
+/**
+ * Formats a single data record starting with the given 'id' signal value,
+ * followed by the values of the other signals obtained from the next_value
+ * function. Allows formatting records one at a time, without knowing
+ * whether more records follow. Records other than the first are preceded
+ * by a separator. After the last record, schema_format_records_end() must
+ * be called. Returns a pointer to the contents of the output buffer on
+ * success, NULL on failure.
+ */
+const char * schema_format_record(
+	struct schema * schema, union entry_value * id_value,
+	union entry_value * (* next_value) (void *), void * next_value_state,
+	bool first_record, struct sbuf * output
+);
+
+
+/**
+ * Completes a sequence of the given number of records formatted using
+ * schema_format_record(). Returns a pointer to the contents of the output
+ * buffer on success, NULL on failure.
+ */
+const char * schema_format_records_end(size_t record_count, struct sbuf * output);
+
+
+/**
+ * Represents the values of a single signal in a batch of data records.
+ * The value in a given row is located at data + row * stride. The type of
+ * the values corresponds to the type of the signal:
+ *
+ * - ENTRY_TYPE_BOOLEAN: bool
+ * - ENTRY_TYPE_SIGNED: int64_t
+ * - ENTRY_TYPE_DOUBLE: double
+ * - ENTRY_TYPE_STRING: const char *
+ * - ENTRY_TYPE_DATETIME: struct timespec
+ * - ENTRY_TYPE_CUSTOM: union entry_value
+ *
+ * Values of a signal stored in an array have a stride equal to the size of
+ * the value (struct-of-arrays layout), values of a signal stored in an array
+ * of records have a stride equal to the size of the record (row-major layout).
+ */
+struct schema_column {
+	/** Pointer to the value in the first row. */
+	const void * data;
+
+	/** Distance between values in consecutive rows in bytes. */
+	size_t stride;
+};
+
+
+/**
+ * Represents a batch of data records, with a column for each signal of
+ * a compiled schema (including the 'id' signal), in schema order.
+ */
+struct schema_batch {
+	/** Number of rows (records) in the batch. */
+	size_t row_count;
+
+	/** Array of columns, one for each signal of the schema. */
+	const struct schema_column * columns;
+};
+
+
+/**
+ * Formats data records from the given batches, in order. Unlike
+ * schema_format_data(), the values are taken directly from the batch
+ * columns, without calling a function for each value. Returns a pointer
+ * to the contents of the output buffer on success, NULL on failure.
+ */
+const char * schema_format_batches(
+	struct schema * schema,
+	const struct schema_batch * batches, size_t batch_count,
+	struct sbuf * output
+);
+
+
+/**
+ * Formats data records from the given batches like schema_format_batches(),
+ * but splits large batches into chunks of rows, which are formatted
+ * concurrently by the given workers into separate buffers and then appended
+ * to the output buffer in order. Small batches (or a NULL pool of workers)
+ * are formatted by the calling thread. Returns a pointer to the contents of
+ * the output buffer on success, NULL on failure.
+ */
+const char * schema_format_batches_parallel(
+	struct schema * schema,
+	const struct schema_batch * batches, size_t batch_count,
+	struct workers * workers, struct sbuf * output
+);
+
+
+/**
+ * Formats data records like schema_format_data(), but appends them to a
+ * segmented buffer. Returns true on success, false on failure.
+ */
+bool schema_format_data_chain(
+	struct schema * schema,
+	union entry_value * (* next_value) (void *), void * next_value_state,
+	struct sbchain * output
+);
+
+//
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SCHEMA_H_ */
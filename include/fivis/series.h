@@ -0,0 +1,132 @@
+/**
+ * Compressed buffer of time series rows.
+ *
+ * Holds rows of values with a timestamp in a bounded number of fixed-size
+ * blocks, compressed in the style of the Gorilla time series database:
+ * timestamps are stored as variable-length deltas of deltas, doubles as
+ * the meaningful bits of the XOR with the previous value, and unsigned
+ * values (e.g., counters) as variable-length (zigzag) deltas from the
+ * previous value. The first row of each block is stored uncompressed, so
+ * that blocks can be decoded and released independently.
+ *
+ * Rows are appended at the end and read from the beginning. The buffer
+ * is not thread-safe.
+ */
+
+#ifndef _SERIES_H_
+#define _SERIES_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "entry.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+
+/** Identifies the encoding of the values in a column. */
+typedef enum series_type {
+	/** Unsigned values, stored as deltas from the previous value. */
+	SERIES_UNSIGNED = 0,
+
+	/** Double values, stored as the XOR with the previous value. */
+	SERIES_DOUBLE = 1,
+} series_type_t;
+
+
+/** Represents a compressed buffer of rows (opaque). */
+struct series;
+
+
+/**
+ * Function receiving a decoded row. The values are stored in the
+ * 'as_unsigned' or 'as_double' member, depending on the column type, and
+ * are only valid during the call.
+ */
+typedef void (* series_row_fn) (
+	void * arg, size_t index, const struct timespec * timestamp,
+	const union entry_value * values
+);
+
+
+/**
+ * Returns the smallest block size (in bytes) which can hold rows with the
+ * given number of columns.
+ */
+size_t series_block_size_min(size_t column_count);
+
+
+/**
+ * Creates a buffer for rows with the given column types, which uses at
+ * most the given number of blocks of the given size (in bytes). Returns
+ * a pointer to the buffer on success, NULL on failure.
+ */
+struct series * series_create(
+	const series_type_t * types, size_t column_count,
+	size_t block_size, size_t block_count
+);
+
+
+/** Releases the buffer and all its blocks. */
+void series_destroy(struct series * series);
+
+
+/**
+ * Appends a row to the buffer. Returns true on success, false if all
+ * blocks are full (or could not be allocated).
+ */
+bool series_append(
+	struct series * series, const struct timespec * timestamp,
+	const union entry_value * values
+);
+
+
+/**
+ * Decodes up to the given number of rows from the beginning of the buffer
+ * (without removing them) and passes them to the given function. Returns
+ * the number of rows decoded.
+ */
+size_t series_peek(struct series * series, size_t count, series_row_fn row, void * arg);
+
+
+/**
+ * Removes up to the given number of rows from the beginning of the buffer.
+ * Blocks are released once all their rows are removed. Returns the number
+ * of rows removed.
+ */
+size_t series_drop(struct series * series, size_t count);
+
+
+/**
+ * Removes the rows remaining in the oldest block, which releases the block.
+ * Returns the number of rows removed.
+ */
+size_t series_drop_block(struct series * series);
+
+
+/** Returns the number of rows in the buffer. */
+size_t series_row_count(const struct series * series);
+
+
+/** Returns the number of blocks in use. */
+size_t series_block_count(const struct series * series);
+
+
+/** Returns the maximum number of blocks. */
+size_t series_block_count_max(const struct series * series);
+
+
+/** Returns the number of bytes used by the compressed rows. */
+size_t series_compressed_size(const struct series * series);
+
+//
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SERIES_H_ */
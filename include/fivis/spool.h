@@ -0,0 +1,105 @@
+/**
+ * Persistent spool of pending requests.
+ *
+ * Keeps requests waiting to be sent in a directory, as an append-only log
+ * split into memory-mapped segment files. Each record carries a checksum
+ * and an acknowledgement flag, which is set in place once the request has
+ * been delivered (or rejected for good). Segments without pending records
+ * are deleted. When the spool is opened, the segments left by a previous
+ * run are scanned, records damaged by a crash are discarded, and the
+ * records not acknowledged become pending again.
+ *
+ * The size of the segment files is limited by a quota. When a new segment
+ * would exceed the quota, the oldest segments are evicted, including the
+ * pending records they hold. Because an acknowledgement may be lost in a
+ * crash, a record may be delivered more than once.
+ */
+
+#ifndef _SPOOL_H_
+#define _SPOOL_H_
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+
+/** Represents a spool (opaque). */
+struct spool;
+
+
+/**
+ * Represents a pending record. The data point into the memory-mapped
+ * segment and remain valid only until the next call to spool_append()
+ * or spool_ack().
+ */
+struct spool_record {
+	/** Identifier of the record, increasing with each record appended. */
+	uint64_t id;
+
+	const char * data;
+	size_t size;
+};
+
+
+/**
+ * Opens a spool in the given directory, creating the directory if it does
+ * not exist, and recovers the records left in it. New segment files have
+ * the given size (or the size of a record, if larger), and the total size
+ * of the segment files does not exceed the given quota. Returns a pointer
+ * to the spool on success, NULL on failure.
+ */
+struct spool * spool_open(const char * path, size_t segment_size, size_t quota);
+
+
+/** Closes the spool, keeping the pending records on disk. */
+void spool_close(struct spool * spool);
+
+
+/**
+ * Appends a record with the given data to the spool and flushes it to
+ * disk. Evicts the oldest segments if needed to stay within the quota.
+ * Stores the identifier of the record to the given location (if not
+ * NULL). Returns true on success, false on failure.
+ */
+bool spool_append(struct spool * spool, const char * data, size_t size, uint64_t * id);
+
+
+/**
+ * Acknowledges the record with the given identifier, so that it is no
+ * longer pending. Returns true on success, false if there is no such
+ * pending record.
+ */
+bool spool_ack(struct spool * spool, uint64_t id);
+
+
+/**
+ * Finds the oldest pending record with an identifier greater than the
+ * given one (use zero to start with the oldest record). Returns true if
+ * there is such a record, false otherwise.
+ */
+bool spool_next_pending(struct spool * spool, uint64_t after_id, struct spool_record * record);
+
+
+/** Returns the number of pending records. */
+size_t spool_pending_count(const struct spool * spool);
+
+
+/** Returns the total size of the segment files (in bytes). */
+size_t spool_disk_size(const struct spool * spool);
+
+
+/** Returns the number of pending records lost to evictions. */
+size_t spool_evicted_count(const struct spool * spool);
+
+//
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SPOOL_H_ */
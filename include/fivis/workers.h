@@ -0,0 +1,60 @@
+/**
+ * Simple pool of worker threads.
+ *
+ * Runs a number of independent tasks concurrently on a fixed set of worker
+ * threads. The calling thread participates in running the tasks and waits
+ * until all of them complete.
+ */
+
+#ifndef _WORKERS_H_
+#define _WORKERS_H_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+
+/** Represents a pool of worker threads (opaque). */
+struct workers;
+
+
+/**
+ * Creates a pool of workers running tasks on the given total number of
+ * threads, including the calling thread, i.e., the pool starts one thread
+ * less. Returns a pointer to the pool on success, NULL on failure.
+ */
+struct workers * workers_create(size_t thread_count);
+
+
+/** Stops the worker threads and releases the pool. */
+void workers_destroy(struct workers * workers);
+
+
+/**
+ * Returns the total number of threads running tasks, including the
+ * calling thread.
+ */
+size_t workers_thread_count(const struct workers * workers);
+
+
+/**
+ * Runs the given task function for each task index in the range from 0 to
+ * task_count (exclusive) and waits until all tasks complete. The tasks may
+ * run concurrently and in any order. The pool must not be used by multiple
+ * threads at the same time.
+ */
+void workers_run(
+	struct workers * workers, size_t task_count,
+	void (* task) (void * arg, size_t index), void * arg
+);
+
+//
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _WORKERS_H_ */
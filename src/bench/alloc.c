@@ -0,0 +1,115 @@
+/**
+ * Counting replacements of the standard memory allocation functions.
+ *
+ * The functions forward to the glibc allocator and count the number of
+ * allocations (including reallocations) and the number of bytes allocated,
+ * which allows the benchmarks to report allocations per operation and the
+ * peak memory usage.
+ */
+
+#include <errno.h>
+#include <malloc.h>
+#include <stddef.h>
+
+#include "bench.h"
+
+//
+
+extern void * __libc_malloc(size_t size);
+extern void * __libc_calloc(size_t count, size_t size);
+extern void * __libc_realloc(void * ptr, size_t size);
+extern void * __libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void * ptr);
+
+
+static size_t alloc_count = 0;
+
+static size_t alloc_bytes = 0;
+
+static size_t alloc_bytes_peak = 0;
+
+
+size_t
+bench_alloc_count(void) {
+	return __atomic_load_n(&alloc_count, __ATOMIC_RELAXED);
+}
+
+
+size_t
+bench_alloc_bytes_peak(void) {
+	return __atomic_load_n(&alloc_bytes_peak, __ATOMIC_RELAXED);
+}
+
+
+void
+bench_alloc_reset_peak(void) {
+	size_t bytes = __atomic_load_n(&alloc_bytes, __ATOMIC_RELAXED);
+	__atomic_store_n(&alloc_bytes_peak, bytes, __ATOMIC_RELAXED);
+}
+
+
+/** Accounts for allocated and released memory blocks. */
+static inline void *
+__account(void * allocated, size_t released) {
+	__atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+
+	size_t allocated_size = (allocated != NULL) ? malloc_usable_size(allocated) : 0;
+	size_t bytes = __atomic_add_fetch(&alloc_bytes, allocated_size - released, __ATOMIC_RELAXED);
+
+	// Racy, but good enough for the benchmarks.
+	if (bytes > __atomic_load_n(&alloc_bytes_peak, __ATOMIC_RELAXED)) {
+		__atomic_store_n(&alloc_bytes_peak, bytes, __ATOMIC_RELAXED);
+	}
+
+	return allocated;
+}
+
+
+void *
+malloc(size_t size) {
+	return __account(__libc_malloc(size), 0);
+}
+
+
+void *
+calloc(size_t count, size_t size) {
+	return __account(__libc_calloc(count, size), 0);
+}
+
+
+void *
+realloc(void * ptr, size_t size) {
+	size_t released = (ptr != NULL) ? malloc_usable_size(ptr) : 0;
+	void * result = __libc_realloc(ptr, size);
+
+	// On failure, the original block remains allocated.
+	return (result != NULL || size == 0) ? __account(result, released) : __account(NULL, 0);
+}
+
+
+void *
+aligned_alloc(size_t alignment, size_t size) {
+	return __account(__libc_memalign(alignment, size), 0);
+}
+
+
+int
+posix_memalign(void ** ptr, size_t alignment, size_t size) {
+	void * result = __account(__libc_memalign(alignment, size), 0);
+	if (result == NULL) {
+		return ENOMEM;
+	}
+
+	*ptr = result;
+	return 0;
+}
+
+
+void
+free(void * ptr) {
+	if (ptr != NULL) {
+		__atomic_fetch_sub(&alloc_bytes, malloc_usable_size(ptr), __ATOMIC_RELAXED);
+	}
+
+	__libc_free(ptr);
+}
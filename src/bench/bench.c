@@ -0,0 +1,171 @@
+/**
+ * Microbenchmarks for the FIVIS client library hot paths.
+ *
+ * Usage: bench [-j] [group ...]
+ *
+ * Runs the given groups of benchmarks, or all of them. With the -j option,
+ * the results are printed as JSON objects, one per line, which is suitable
+ * for tracking the results across versions.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fivis/json.h>
+#include <fivis/sbuf.h>
+#include <fivis/util.h>
+
+#include "bench.h"
+
+//
+
+/** Name of the benchmark group being run. */
+static const char * bench_group = "";
+
+/** Print results as JSON objects instead of text. */
+static bool bench_json_output = false;
+
+
+/** Prints a JSON object with the common attributes of a result. */
+static void
+__print_json_start(const char * name) {
+	sbuf_t line = SBUF_INIT();
+
+	sbuf_append_literal(&line, "{ ");
+	sbuf_append_key(&line, "group");
+	json_append_cstring(&line, bench_group);
+	sbuf_append_literal(&line, ", ");
+	sbuf_append_key(&line, "name");
+	json_append_cstring(&line, name);
+
+	fputs(sbuf_string(&line), stdout);
+	sbuf_destroy(&line);
+}
+
+
+static void
+__print_result(
+	const char * name, size_t runs, size_t ops, size_t bytes,
+	double secs, double allocs_per_run
+) {
+	double ns_per_op = secs * 1e9 / ops;
+	double mb_per_sec = bytes / secs / 1e6;
+
+	if (bench_json_output) {
+		__print_json_start(name);
+		printf(
+			", \"runs\": %zu, \"ops\": %zu, \"bytes\": %zu, \"secs\": %.9f"
+			", \"ns_per_op\": %.3f, \"mb_per_sec\": %.3f",
+			runs, ops, bytes, secs, ns_per_op, mb_per_sec
+		);
+
+		if (allocs_per_run >= 0) {
+			printf(", \"allocs_per_run\": %.3f", allocs_per_run);
+		}
+
+		printf(" }\n");
+
+	} else {
+		printf("%-52s %12.2f ns/op %10.2f MB/s", name, ns_per_op, mb_per_sec);
+		if (allocs_per_run >= 0) {
+			printf(" %10.2f allocs/run", allocs_per_run);
+		}
+
+		printf("\n");
+	}
+}
+
+
+void
+bench_stop(
+	const struct bench_timer * timer, const char * name,
+	size_t runs, size_t ops, size_t bytes
+) {
+	double secs = bench_now() - timer->start;
+	size_t allocs = bench_alloc_count() - timer->allocs;
+
+	__print_result(name, runs, ops, bytes, secs, (double) allocs / runs);
+}
+
+
+void
+bench_report(const char * name, size_t ops, size_t bytes, double secs) {
+	__print_result(name, 1, ops, bytes, secs, -1);
+}
+
+
+void
+bench_report_count(const char * name, const char * unit, double count) {
+	if (bench_json_output) {
+		__print_json_start(name);
+		printf(", \"unit\": \"%s\", \"count\": %.3f }\n", unit, count);
+	} else {
+		printf("%-52s %12.2f %s\n", name, count, unit);
+	}
+}
+
+//
+
+static const struct {
+	const char * name;
+	void (* run) (void);
+} bench_groups[] = {
+	{ "sbuf", bench_sbuf },
+	{ "entry", bench_entry },
+	{ "datetime", bench_datetime },
+	{ "schema", bench_schema },
+	{ "json", bench_json },
+	{ "request", bench_request },
+	{ "sweep", bench_sweep },
+	{ "parallel", bench_parallel },
+	{ "procstat", bench_procstat },
+	{ "gzip", bench_gzip },
+	{ "transport", bench_transport },
+	{ "series", bench_series },
+};
+
+
+/** Returns true if the given group was selected on the command line. */
+static bool
+__is_selected(const char * group, int argc, char * argv[]) {
+	bool any = false;
+	for (int i = 1; i < argc; i++) {
+		if (argv[i][0] == '-') {
+			continue;
+		}
+
+		if (strcmp(argv[i], group) == 0) {
+			return true;
+		}
+
+		any = true;
+	}
+
+	// No groups given means all groups.
+	return !any;
+}
+
+
+int
+main(int argc, char * argv[]) {
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-j") == 0) {
+			bench_json_output = true;
+
+		} else if (argv[i][0] == '-') {
+			fprintf(stderr, "usage: %s [-j] [group ...]\n", argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	for (size_t i = 0; i < sizeof_array(bench_groups); i++) {
+		if (__is_selected(bench_groups[i].name, argc, argv)) {
+			bench_group = bench_groups[i].name;
+			bench_groups[i].run();
+		}
+	}
+
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,99 @@
+/**
+ * Simple microbenchmark harness.
+ */
+
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+//
+
+/** Returns the current value of the monotonic clock in seconds. */
+static inline double
+bench_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+/** Returns the number of memory allocations performed so far. */
+size_t bench_alloc_count(void);
+
+/** Returns the peak number of allocated bytes since the last reset. */
+size_t bench_alloc_bytes_peak(void);
+
+/** Resets the peak number of allocated bytes to the current number. */
+void bench_alloc_reset_peak(void);
+
+
+/** Represents the start of a measurement. */
+struct bench_timer {
+	double start;
+	size_t allocs;
+};
+
+
+/** Starts a measurement of time and memory allocations. */
+static inline void
+bench_start(struct bench_timer * timer) {
+	timer->allocs = bench_alloc_count();
+	timer->start = bench_now();
+}
+
+
+/**
+ * Stops a measurement and reports the result. The run count (e.g., the
+ * number of requests) is used to compute allocations per run, the operation
+ * count (e.g., the number of values) to compute time per operation, and the
+ * byte count to compute throughput.
+ */
+void bench_stop(
+	const struct bench_timer * timer, const char * name,
+	size_t runs, size_t ops, size_t bytes
+);
+
+
+/**
+ * Reports the result of a benchmark measured without a timer. Allocations
+ * are not reported.
+ */
+void bench_report(const char * name, size_t ops, size_t bytes, double secs);
+
+
+/**
+ * Reports a count associated with a benchmark, e.g., the number of
+ * allocations per operation.
+ */
+void bench_report_count(const char * name, const char * unit, double count);
+
+//
+
+void bench_sbuf(void);
+
+void bench_entry(void);
+
+void bench_datetime(void);
+
+void bench_schema(void);
+
+void bench_json(void);
+
+void bench_request(void);
+
+void bench_sweep(void);
+
+void bench_parallel(void);
+
+void bench_procstat(void);
+
+void bench_gzip(void);
+
+void bench_transport(void);
+
+void bench_series(void);
+
+#endif /* _BENCH_H_ */
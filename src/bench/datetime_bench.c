@@ -0,0 +1,74 @@
+/**
+ * Benchmarks comparing gmtime-based datetime formatting with the cached
+ * datetime formatter.
+ */
+
+#include <assert.h>
+#include <string.h>
+#include <time.h>
+
+#include <fivis/entry.h>
+#include <fivis/sbuf.h>
+
+#include "bench.h"
+
+//
+
+static const size_t row_count = 1000000;
+
+// Formatted twice per row, like the 'id' and 'ts' signals in cpumon.
+static const size_t values_per_row = 2;
+
+
+static const char *
+format_datetime_gmtime(const struct timespec * ts, sbuf_t * output) {
+	struct tm datetime;
+	gmtime_r(&ts->tv_sec, &datetime);
+	int msec = ts->tv_nsec / 1000000;
+
+	return sbuf_format(
+		output, "\"%04d-%02d-%02dT%02d:%02d:%02d.%03dZ\"",
+		1900 + datetime.tm_year, datetime.tm_mon + 1, datetime.tm_mday,
+		datetime.tm_hour, datetime.tm_min, datetime.tm_sec, msec
+	);
+}
+
+
+static void
+run(
+	const char * name, const char * (* format) (const struct timespec *, sbuf_t *),
+	sbuf_t * output
+) {
+	// Hours of 1-second samples, starting at 2020-01-01T00:00:00Z.
+	struct timespec ts = { .tv_sec = 1577836800, .tv_nsec = 123000000 };
+	size_t bytes = 0;
+
+	struct bench_timer timer;
+	bench_start(&timer);
+	for (size_t row = 0; row < row_count; row++) {
+		sbuf_clear(output);
+		for (size_t i = 0; i < values_per_row; i++) {
+			format(&ts, output);
+		}
+
+		bytes += sbuf_length(output);
+		ts.tv_sec++;
+	}
+	bench_stop(&timer, name, row_count, row_count * values_per_row, bytes);
+}
+
+
+void
+bench_datetime(void) {
+	sbuf_t gmtime_output = SBUF_INIT();
+	sbuf_t cached_output = SBUF_INIT();
+
+	run("datetime (gmtime + printf)", format_datetime_gmtime, &gmtime_output);
+	run("datetime (cached)", entry_format_datetime, &cached_output);
+
+	// Both variants must produce identical output.
+	assert(strcmp(sbuf_string(&gmtime_output), sbuf_string(&cached_output)) == 0);
+
+	sbuf_destroy(&gmtime_output);
+	sbuf_destroy(&cached_output);
+}
@@ -0,0 +1,102 @@
+/**
+ * Benchmarks of the value formatters of the built-in entry types.
+ */
+
+#include <stdio.h>
+
+#include <fivis/entry.h>
+#include <fivis/sbuf.h>
+
+#include "bench.h"
+
+//
+
+static const size_t value_count = 2000000;
+
+// Values formatted into the buffer before clearing it.
+static const size_t values_per_clear = 1000;
+
+
+/**
+ * Formats values produced by the given function using the given entry,
+ * through the generic entry_format_value() dispatch.
+ */
+static void
+run(
+	const char * name, struct entry * entry,
+	void (* make_value) (size_t, union entry_value *)
+) {
+	sbuf_t output = SBUF_INIT();
+	size_t bytes = 0;
+
+	struct bench_timer timer;
+	bench_start(&timer);
+	for (size_t i = 0; i < value_count; i++) {
+		if (i % values_per_clear == 0) {
+			bytes += sbuf_length(&output);
+			sbuf_clear(&output);
+		}
+
+		union entry_value value;
+		make_value(i, &value);
+		entry_format_value(entry, &value, &output);
+	}
+	bytes += sbuf_length(&output);
+	bench_stop(&timer, name, value_count / values_per_clear, value_count, bytes);
+
+	sbuf_destroy(&output);
+}
+
+
+static void
+make_boolean(size_t index, union entry_value * value) {
+	value->as_boolean = (index & 1) != 0;
+}
+
+
+static void
+make_signed(size_t index, union entry_value * value) {
+	value->as_signed = (int64_t) (index * 2654435761u) - (1 << 30);
+}
+
+
+static void
+make_double(size_t index, union entry_value * value) {
+	value->as_double = (double) (index % 10007) / 100;
+}
+
+
+static void
+make_string(size_t index, union entry_value * value) {
+	static const char * strings[] = {
+		"idle", "rack-12.node-0457", "path \"C:\\\\temp\"",
+	};
+
+	value->as_string = strings[index % 3];
+}
+
+
+static void
+make_datetime(size_t index, union entry_value * value) {
+	value->as_timespec = (struct timespec) {
+		.tv_sec = 1577836800 + index, .tv_nsec = (index % 1000) * 1000000
+	};
+}
+
+
+void
+bench_entry(void) {
+	struct entry boolean = entry_boolean("flag");
+	struct entry signed_int = entry_signed("count");
+	struct entry double_shortest = entry_double("cpu0_user");
+	struct entry double_fixed = entry_double_fixed("cpu0_user", 2);
+	struct entry string = entry_string("host");
+	struct entry datetime = entry_datetime("ts");
+
+	run("entry_format_boolean_value", &boolean, make_boolean);
+	run("entry_format_signed_value", &signed_int, make_signed);
+	run("entry_format_double_value (shortest)", &double_shortest, make_double);
+	run("entry_format_double_value (2 decimals)", &double_fixed, make_double);
+	run("entry_format_string_value", &string, make_string);
+	run("entry_format_datetime_value", &datetime, make_datetime);
+}
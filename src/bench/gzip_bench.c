@@ -0,0 +1,164 @@
+/**
+ * Benchmarks of request body compression.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <common/checked.h>
+
+#include <fivis/entry.h>
+#include <fivis/fivis.h>
+#include <fivis/gzip.h>
+#include <fivis/schema.h>
+#include <fivis/sbuf.h>
+
+#include "bench.h"
+
+//
+
+// Request similar to a cpumon request with 64 CPUs and 10 times per CPU.
+static const size_t signal_count = 650;
+static const size_t row_count = 300;
+
+static const size_t request_count = 10;
+
+// Size of the buffer the compressed data is read into (like CURL's).
+static const size_t output_size = 64 << 10;
+
+
+struct values_state {
+	union entry_value * values;
+	size_t count;
+	size_t next;
+};
+
+
+static union entry_value *
+next_value(void * arg) {
+	struct values_state * state = (struct values_state *) arg;
+	if (state->next >= state->count) {
+		return NULL;
+	}
+
+	return &state->values[state->next++];
+}
+
+
+struct buffer_source {
+	const char * data;
+	size_t size;
+	size_t offset;
+};
+
+
+static size_t
+buffer_read(char * buffer, size_t size, void * arg) {
+	struct buffer_source * source = (struct buffer_source *) arg;
+
+	size_t avail = source->size - source->offset;
+	size_t result = (size < avail) ? size : avail;
+	memcpy(buffer, source->data + source->offset, result);
+
+	source->offset += result;
+	return result;
+}
+
+
+/**
+ * Compresses the request a number of times using the given compression
+ * level and reports the compression throughput (in uncompressed bytes),
+ * the compression ratio, and the CPU time per uncompressed megabyte.
+ */
+static void
+run(int level, sbuf_t * request, char * output) {
+	struct gzip_stream * stream = checked_malloc(sizeof(struct gzip_stream));
+
+	size_t output_bytes = 0;
+	uint64_t compress_ns = 0;
+
+	struct bench_timer timer;
+	bench_start(&timer);
+	for (size_t i = 0; i < request_count; i++) {
+		struct buffer_source source = {
+			.data = request->data, .size = sbuf_length(request), .offset = 0
+		};
+
+		bool init = gzip_stream_init(stream, level, buffer_read, &source);
+		assert(init);
+
+		size_t length;
+		while ((length = gzip_stream_read(stream, output, output_size)) > 0) {
+			assert(length != GZIP_READ_ERROR);
+			output_bytes += length;
+		}
+
+		compress_ns += stream->compress_ns;
+		gzip_stream_destroy(stream);
+	}
+
+	size_t input_bytes = request_count * sbuf_length(request);
+
+	char name[64];
+	snprintf(name, sizeof(name), "gzip level %d", level);
+	bench_stop(&timer, name, request_count, input_bytes, input_bytes);
+
+	snprintf(name, sizeof(name), "gzip level %d ratio", level);
+	bench_report_count(name, "x", (double) input_bytes / output_bytes);
+
+	snprintf(name, sizeof(name), "gzip level %d CPU time", level);
+	bench_report_count(name, "ms/MB", compress_ns / 1e6 / (input_bytes / 1e6));
+
+	free(stream);
+}
+
+
+void
+bench_gzip(void) {
+	struct entry id_signal = entry_datetime("id");
+	struct list signals = LIST_INIT(signals);
+
+	struct entry * entries = checked_malloc(signal_count * sizeof(struct entry));
+	char (* names)[16] = checked_malloc(signal_count * sizeof(*names));
+	for (size_t i = 0; i < signal_count; i++) {
+		snprintf(names[i], sizeof(names[i]), "cpu%zu_t%zu", i / 10, i % 10);
+		entry_init_double_fixed(&entries[i], names[i], 2);
+		list_add_last(&signals, &entries[i].link);
+	}
+
+	// Pseudo-random percentages, so that the values do not repeat.
+	size_t value_count = row_count * (1 + signal_count);
+	union entry_value * values = checked_malloc(value_count * sizeof(union entry_value));
+	uint32_t seed = 12345;
+	for (size_t i = 0; i < value_count; i++) {
+		if (i % (1 + signal_count) == 0) {
+			values[i].as_timespec = (struct timespec) { .tv_sec = 1577836800 + i };
+		} else {
+			seed = seed * 1103515245 + 12345;
+			values[i].as_double = (double) ((seed >> 16) % 10000) / 100;
+		}
+	}
+
+	struct schema * schema = schema_compile(&id_signal, &signals);
+	assert(schema != NULL);
+
+	sbuf_t request = SBUF_INIT();
+	struct values_state state = { .values = values, .count = value_count, .next = 0 };
+	fivis_signals_format_compiled_request(
+		"partner", "signal-set", false, schema, next_value, &state, &request
+	);
+
+	char * output = checked_malloc(output_size);
+	run(1, &request, output);
+	run(3, &request, output);
+	run(6, &request, output);
+	run(9, &request, output);
+	free(output);
+
+	sbuf_destroy(&request);
+	schema_destroy(schema);
+	free(values);
+	free(names);
+	free(entries);
+}
@@ -0,0 +1,58 @@
+/**
+ * Benchmarks of JSON string escaping compared to plain copying.
+ */
+
+#include <string.h>
+
+#include <fivis/json.h>
+#include <fivis/sbuf.h>
+
+#include "bench.h"
+
+//
+
+static const size_t string_count = 1000000;
+
+
+static const char * host_tag = "rack-12.node-0457.example.org";
+
+static const char * command_line =
+	"/usr/lib/jvm/java-17-openjdk/bin/java -Xms4g -Xmx16g -XX:+UseG1GC "
+	"-Dlog4j.configurationFile=/etc/service/log4j2.xml -cp /opt/service/lib/* "
+	"org.example.service.Main --config /etc/service/config.yaml --port 8080";
+
+static const char * escaped_line =
+	"key=\"value\"\tpath=C:\\Program Files\\Service\nnext line with \"quotes\"";
+
+
+static void
+run(const char * name, const char * str, bool escape) {
+	sbuf_t output = SBUF_INIT();
+	size_t length = strlen(str);
+	size_t bytes = 0;
+
+	struct bench_timer timer;
+	bench_start(&timer);
+	for (size_t i = 0; i < string_count; i++) {
+		sbuf_clear(&output);
+		if (escape) {
+			json_append_string(&output, str, length);
+		} else {
+			sbuf_append_bytes(&output, str, length);
+		}
+
+		bytes += length;
+	}
+	bench_stop(&timer, name, string_count, string_count, bytes);
+	sbuf_destroy(&output);
+}
+
+
+void
+bench_json(void) {
+	run("copy host tag", host_tag, false);
+	run("json escape host tag", host_tag, true);
+	run("copy command line", command_line, false);
+	run("json escape command line", command_line, true);
+	run("json escape dirty string", escaped_line, true);
+}
@@ -0,0 +1,109 @@
+/**
+ * Benchmarks of parallel formatting of large batches.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <common/checked.h>
+
+#include <fivis/entry.h>
+#include <fivis/schema.h>
+#include <fivis/sbuf.h>
+#include <fivis/workers.h>
+
+#include "bench.h"
+
+//
+
+// Wide rows as produced by cpumon on a 64-core machine.
+static const size_t signal_count = 650;
+
+// Rows of distinct values, repeated to form a large batch.
+static const size_t block_row_count = 500;
+static const size_t block_count = 20;
+
+
+void
+bench_parallel(void) {
+	struct entry id_signal = entry_datetime("id");
+	struct list signals = LIST_INIT(signals);
+
+	struct entry * entries = checked_malloc(signal_count * sizeof(struct entry));
+	char (* names)[16] = checked_malloc(signal_count * sizeof(*names));
+	for (size_t i = 0; i < signal_count; i++) {
+		snprintf(names[i], sizeof(names[i]), "cpu%zu_t%zu", i / 10, i % 10);
+		entry_init_double_fixed(&entries[i], names[i], 2);
+		list_add_last(&signals, &entries[i].link);
+	}
+
+	// Row-major values: id timestamp followed by percentages.
+	size_t row_length = 1 + signal_count;
+	union entry_value * values = checked_malloc(block_row_count * row_length * sizeof(union entry_value));
+	for (size_t row = 0; row < block_row_count; row++) {
+		union entry_value * row_values = &values[row * row_length];
+		row_values[0].as_timespec = (struct timespec) { .tv_sec = 1577836800 + row };
+		for (size_t i = 1; i <= signal_count; i++) {
+			row_values[i].as_double = (double) ((row * 31 + i * 17) % 10000) / 100;
+		}
+	}
+
+	struct schema_column * columns = checked_malloc(row_length * sizeof(struct schema_column));
+	for (size_t i = 0; i < row_length; i++) {
+		columns[i] = (struct schema_column) {
+			.data = &values[i], .stride = row_length * sizeof(union entry_value)
+		};
+	}
+
+	// All batches share the same block of rows.
+	struct schema_batch * batches = checked_malloc(block_count * sizeof(struct schema_batch));
+	for (size_t i = 0; i < block_count; i++) {
+		batches[i] = (struct schema_batch) { .row_count = block_row_count, .columns = columns };
+	}
+
+	struct schema * schema = schema_compile(&id_signal, &signals);
+	assert(schema != NULL);
+
+	//
+
+	size_t value_count = block_count * block_row_count * row_length;
+	long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+
+	struct sbuf reference = SBUF_INIT();
+	schema_format_batches(schema, batches, block_count, &reference);
+
+	// Warm up the output buffer, so that all runs reuse its memory.
+	struct sbuf output = SBUF_INIT();
+	schema_format_batches(schema, batches, block_count, &output);
+
+	for (long thread_count = 1; thread_count <= cpu_count || thread_count == 1; thread_count *= 2) {
+		struct workers * workers = workers_create(thread_count);
+		assert(workers != NULL);
+
+		sbuf_clear(&output);
+
+		char name[64];
+		snprintf(name, sizeof(name), "format batch (%ld threads)", thread_count);
+
+		struct bench_timer timer;
+		bench_start(&timer);
+		schema_format_batches_parallel(schema, batches, block_count, workers, &output);
+		bench_stop(&timer, name, 1, value_count, sbuf_length(&output));
+
+		// Parallel formatting must produce identical output.
+		assert(strcmp(sbuf_string(&output), sbuf_string(&reference)) == 0);
+
+		workers_destroy(workers);
+	}
+
+	sbuf_destroy(&output);
+	sbuf_destroy(&reference);
+	schema_destroy(schema);
+	free(batches);
+	free(columns);
+	free(values);
+	free(names);
+	free(entries);
+}
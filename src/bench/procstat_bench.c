@@ -0,0 +1,95 @@
+/**
+ * Benchmarks of parsing synthetic /proc/stat contents.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+
+#include <common/checked.h>
+
+#include <fivis/entry.h>
+#include <fivis/sbuf.h>
+#include <fivis/util.h>
+
+#include "procstat.h"
+
+#include "bench.h"
+
+//
+
+static const size_t cpu_counts[] = { 1, 4, 16, 64, 256, 1024 };
+
+static const size_t time_count = 10;
+
+// Number of values parsed per measurement (at least one file).
+static const size_t values_per_measurement = 2000000;
+
+
+/**
+ * Generates /proc/stat contents for the given number of CPUs, including
+ * the summary line and the lines following the CPU lines.
+ */
+static void
+make_proc_stat(size_t cpu_count, sbuf_t * output) {
+	sbuf_clear(output);
+
+	for (size_t cpu = 0; cpu <= cpu_count; cpu++) {
+		if (cpu == 0) {
+			sbuf_append_literal(output, "cpu ");
+		} else {
+			sbuf_format(output, "cpu%zu", cpu - 1);
+		}
+
+		// Summary times are larger, like in the real file.
+		uint64_t scale = (cpu == 0) ? cpu_count : 1;
+		for (size_t time = 0; time < time_count; time++) {
+			uint64_t value = (time < 8) ? scale * (1000003 * (cpu + 1) * (time + 7) % 98765431) : 0;
+			sbuf_append_char(output, ' ');
+			sbuf_append_uint64(output, value);
+		}
+
+		sbuf_append_char(output, '\n');
+	}
+
+	sbuf_append_literal(output, "intr 123456789 0 9 0 0 0 0 0 0 0 0 0 0 0 0 0\n");
+	sbuf_append_literal(output, "ctxt 987654321\nbtime 1577836800\nprocesses 123456\n");
+	sbuf_append_literal(output, "procs_running 2\nprocs_blocked 0\n");
+}
+
+
+void
+bench_procstat(void) {
+	sbuf_t contents = SBUF_INIT();
+
+	for (size_t c = 0; c < sizeof_array(cpu_counts); c++) {
+		size_t cpu_count = cpu_counts[c];
+		make_proc_stat(cpu_count, &contents);
+
+		const char * buffer = sbuf_string(&contents);
+		assert((size_t) proc_stat_get_cpu_count(buffer) == cpu_count + 1);
+		assert((size_t) proc_stat_get_time_count(buffer) == time_count);
+
+		size_t value_count = (cpu_count + 1) * time_count;
+		union entry_value * values = checked_malloc(value_count * sizeof(union entry_value));
+
+		size_t repeat_count = values_per_measurement / value_count;
+		if (repeat_count == 0) {
+			repeat_count = 1;
+		}
+
+		char name[64];
+		snprintf(name, sizeof(name), "proc_stat_parse_times (%zu cpus)", cpu_count);
+
+		struct bench_timer timer;
+		bench_start(&timer);
+		for (size_t i = 0; i < repeat_count; i++) {
+			ssize_t parsed = proc_stat_parse_times(buffer, value_count, values);
+			assert((size_t) parsed == value_count);
+		}
+		bench_stop(&timer, name, repeat_count, repeat_count * value_count, repeat_count * sbuf_length(&contents));
+
+		free(values);
+	}
+
+	sbuf_destroy(&contents);
+}
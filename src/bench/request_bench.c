@@ -0,0 +1,203 @@
+/**
+ * Benchmarks of request buffer allocation behavior.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+
+#include <common/checked.h>
+
+#include <fivis/entry.h>
+#include <fivis/fivis.h>
+#include <fivis/sbchain.h>
+#include <fivis/schema.h>
+#include <fivis/sbuf.h>
+
+#include "bench.h"
+
+//
+
+static const size_t signal_count = 650;
+static const size_t row_count = 300;
+static const size_t request_count = 20;
+
+static const size_t small_append_count = 1000000;
+
+static const size_t large_row_count = 3000;
+
+
+struct values_state {
+	union entry_value * values;
+	size_t count;
+	size_t next;
+
+	/** Total number of values to return, cycling through the values. */
+	size_t limit;
+};
+
+
+static union entry_value *
+next_value(void * arg) {
+	struct values_state * state = (struct values_state *) arg;
+	if (state->next >= state->limit) {
+		return NULL;
+	}
+
+	return &state->values[state->next++ % state->count];
+}
+
+
+/**
+ * Formats a number of requests and reports allocations per request. If
+ * reuse is true, the output buffer is kept between requests. If reserve
+ * is true, the buffer is sized using the request size estimate.
+ */
+static void
+run(
+	const char * name, struct schema * schema, union entry_value * values,
+	size_t value_count, bool reuse, bool reserve
+) {
+	sbuf_t output = SBUF_INIT();
+	size_t bytes = 0;
+
+	struct bench_timer timer;
+	bench_start(&timer);
+	for (size_t i = 0; i < request_count; i++) {
+		if (reuse) {
+			sbuf_clear(&output);
+		} else {
+			sbuf_destroy(&output);
+		}
+
+		if (reserve) {
+			sbuf_reserve(&output, fivis_signals_estimate_request_size(
+				"partner", "signal-set", false, schema, row_count
+			));
+		}
+
+		struct values_state state = {
+			.values = values, .count = value_count, .limit = value_count
+		};
+		fivis_signals_format_compiled_request(
+			"partner", "signal-set", false, schema, next_value, &state, &output
+		);
+
+		bytes += sbuf_length(&output);
+	}
+	bench_stop(&timer, name, request_count, request_count * value_count, bytes);
+
+	sbuf_destroy(&output);
+}
+
+
+static void
+run_small_appends(void) {
+	sbuf_t output = SBUF_INIT();
+	size_t allocs_before = bench_alloc_count();
+
+	for (size_t i = 0; i < small_append_count; i++) {
+		sbuf_append_literal(&output, "\"cpu0_user\": 12.34, ");
+	}
+
+	size_t allocs = bench_alloc_count() - allocs_before;
+
+	char name[64];
+	snprintf(name, sizeof(name), "%zu MB from small appends", sbuf_length(&output) >> 20);
+	bench_report_count(name, "allocs", allocs);
+
+	sbuf_destroy(&output);
+}
+
+
+/**
+ * Formats a large request into a string buffer or a segmented buffer and
+ * reports the time, the number of allocations, and the peak memory usage.
+ */
+static void
+run_large(
+	const char * name, struct schema * schema, union entry_value * values,
+	size_t value_count, struct sbchain * chain
+) {
+	struct values_state state = {
+		.values = values, .count = value_count,
+		.limit = large_row_count * schema->signal_count
+	};
+
+	sbuf_t output = SBUF_INIT();
+
+	bench_alloc_reset_peak();
+	size_t bytes_before = bench_alloc_bytes_peak();
+
+	struct bench_timer timer;
+	bench_start(&timer);
+
+	size_t length;
+	if (chain != NULL) {
+		fivis_signals_format_compiled_request_chain(
+			"partner", "signal-set", false, schema, next_value, &state, chain
+		);
+		length = sbchain_length(chain);
+
+	} else {
+		fivis_signals_format_compiled_request(
+			"partner", "signal-set", false, schema, next_value, &state, &output
+		);
+		length = sbuf_length(&output);
+	}
+
+	bench_stop(&timer, name, 1, state.limit, length);
+	size_t peak = bench_alloc_bytes_peak() - bytes_before;
+
+	char label[64];
+	snprintf(label, sizeof(label), "%s peak memory", name);
+	bench_report_count(label, "MB/MB of output", (double) peak / length);
+
+	sbuf_destroy(&output);
+}
+
+
+void
+bench_request(void) {
+	struct entry id_signal = entry_datetime("id");
+	struct list signals = LIST_INIT(signals);
+
+	struct entry * entries = checked_malloc(signal_count * sizeof(struct entry));
+	char (* names)[16] = checked_malloc(signal_count * sizeof(*names));
+	for (size_t i = 0; i < signal_count; i++) {
+		snprintf(names[i], sizeof(names[i]), "cpu%zu_t%zu", i / 10, i % 10);
+		entry_init_double_fixed(&entries[i], names[i], 2);
+		list_add_last(&signals, &entries[i].link);
+	}
+
+	size_t value_count = row_count * (1 + signal_count);
+	union entry_value * values = checked_malloc(value_count * sizeof(union entry_value));
+	for (size_t i = 0; i < value_count; i++) {
+		if (i % (1 + signal_count) == 0) {
+			values[i].as_timespec = (struct timespec) { .tv_sec = 1577836800 + i };
+		} else {
+			values[i].as_double = (double) (i % 10000) / 100;
+		}
+	}
+
+	struct schema * schema = schema_compile(&id_signal, &signals);
+	assert(schema != NULL);
+
+	run("request (fresh buffer)", schema, values, value_count, false, false);
+	run("request (fresh buffer, reserved)", schema, values, value_count, false, true);
+	run("request (reused buffer, reserved)", schema, values, value_count, true, true);
+	run_small_appends();
+
+	struct sbchain_pool pool = SBCHAIN_POOL_INIT(1024);
+	struct sbchain chain = SBCHAIN_INIT(&pool);
+	run_large("large request (sbuf)", schema, values, value_count, NULL);
+	run_large("large request (chain)", schema, values, value_count, &chain);
+	sbchain_destroy(&chain);
+	run_large("large request (chain, pooled)", schema, values, value_count, &chain);
+	sbchain_destroy(&chain);
+	sbchain_pool_destroy(&pool);
+
+	schema_destroy(schema);
+	free(values);
+	free(names);
+	free(entries);
+}
@@ -0,0 +1,104 @@
+/**
+ * Benchmarks comparing printf-based formatting with typed appenders.
+ */
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fivis/sbuf.h>
+#include <fivis/util.h>
+
+#include "bench.h"
+
+//
+
+static const size_t field_count = 100;
+static const size_t row_count = 20000;
+
+static const char * field_name = "cpu12_softirq";
+
+
+static void
+format_row_printf(sbuf_t * output, int64_t seed) {
+	sbuf_format(output, "%s", "\n{ ");
+	for (size_t i = 0; i < field_count; i++) {
+		sbuf_format(output, "\"%s\": %" PRId64 "", field_name, seed * (int64_t) i);
+		sbuf_format(output, "%s", ", ");
+	}
+	sbuf_format(output, "%s", " }");
+}
+
+
+static void
+format_row_typed(sbuf_t * output, int64_t seed) {
+	sbuf_append_literal(output, "\n{ ");
+	for (size_t i = 0; i < field_count; i++) {
+		sbuf_append_key(output, field_name);
+		sbuf_append_int64(output, seed * (int64_t) i);
+		sbuf_append_literal(output, ", ");
+	}
+	sbuf_append_literal(output, " }");
+}
+
+
+static size_t
+run(const char * name, void (* format_row) (sbuf_t *, int64_t), sbuf_t * output) {
+	size_t bytes = 0;
+
+	struct bench_timer timer;
+	bench_start(&timer);
+	for (size_t row = 0; row < row_count; row++) {
+		sbuf_clear(output);
+		format_row(output, row * 7919);
+		bytes += sbuf_length(output);
+	}
+	bench_stop(&timer, name, row_count, row_count * field_count, bytes);
+
+	return bytes;
+}
+
+
+/** Appends strings of the given length to a buffer which keeps growing. */
+static void
+run_append(const char * name, size_t length) {
+	char * str = (char *) malloc(length + 1);
+	memset(str, 'x', length);
+	str[length] = '\0';
+
+	sbuf_t output = SBUF_INIT();
+	size_t count = (64 << 20) / length;
+
+	struct bench_timer timer;
+	bench_start(&timer);
+	for (size_t i = 0; i < count; i++) {
+		sbuf_append(&output, str);
+	}
+	bench_stop(&timer, name, 1, count, sbuf_length(&output));
+
+	sbuf_destroy(&output);
+	free(str);
+}
+
+
+void
+bench_sbuf(void) {
+	sbuf_t printf_output = SBUF_INIT();
+	sbuf_t typed_output = SBUF_INIT();
+
+	size_t printf_bytes = run("sbuf_format (printf)", format_row_printf, &printf_output);
+	size_t typed_bytes = run("sbuf_append_* (typed)", format_row_typed, &typed_output);
+
+	// Both variants must produce identical output.
+	assert(printf_bytes == typed_bytes);
+	assert(strcmp(sbuf_string(&printf_output), sbuf_string(&typed_output)) == 0);
+
+	sbuf_destroy(&printf_output);
+	sbuf_destroy(&typed_output);
+
+	run_append("sbuf_append (16 B strings)", 16);
+	run_append("sbuf_append (256 B strings)", 256);
+	run_append("sbuf_append (4 KiB strings)", 4096);
+}
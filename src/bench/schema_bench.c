@@ -0,0 +1,164 @@
+/**
+ * Benchmarks comparing data formatting by walking the list of entries
+ * with formatting using a compiled schema, with values provided either
+ * by a function or by a batch of columns.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <common/checked.h>
+
+#include <fivis/entry.h>
+#include <fivis/schema.h>
+#include <fivis/sbuf.h>
+
+#include "bench.h"
+
+//
+
+// Wide rows as produced by cpumon: (cpu count + 1) x 10 time signals.
+static const size_t cpu_count = 64;
+static const size_t time_count = 10;
+static const size_t row_count = 200;
+static const size_t repeat_count = 10;
+
+
+struct values_state {
+	union entry_value * values;
+	size_t count;
+	size_t next;
+};
+
+
+static union entry_value *
+next_value(void * arg) {
+	struct values_state * state = (struct values_state *) arg;
+	return (state->next < state->count) ? &state->values[state->next++] : NULL;
+}
+
+
+/** Formats data records the way the request formatter used to. */
+static void
+format_data_list(
+	struct entry * id_signal, struct list * signals,
+	struct values_state * state, struct sbuf * output
+) {
+	union entry_value * value = next_value(state);
+	while (value != NULL) {
+		sbuf_append_literal(output, "\n{ ");
+		entry_format_value(id_signal, value, output);
+
+		struct entry * signal;
+		list_for_each_item(signal, signals, link) {
+			value = next_value(state);
+			if (value != NULL) {
+				sbuf_append_literal(output, ", ");
+				entry_format_value(signal, value, output);
+			}
+		}
+
+		value = next_value(state);
+		if (value != NULL) {
+			sbuf_append_literal(output, " },");
+		} else {
+			sbuf_append_literal(output, " }\n");
+		}
+	}
+}
+
+
+void
+bench_schema(void) {
+	size_t signal_count = (cpu_count + 1) * time_count;
+	size_t value_count = row_count * (1 + signal_count);
+
+	// Signals and their names.
+	struct entry id_signal = entry_datetime("id");
+	struct list signals = LIST_INIT(signals);
+
+	struct entry * entries = checked_malloc(signal_count * sizeof(struct entry));
+	char (* names)[16] = checked_malloc(signal_count * sizeof(*names));
+	for (size_t i = 0; i < signal_count; i++) {
+		snprintf(names[i], sizeof(names[i]), "cpu%zu_t%zu", i / time_count, i % time_count);
+		entry_init_double_fixed(&entries[i], names[i], 2);
+		list_add_last(&signals, &entries[i].link);
+	}
+
+	// Values: rows of id timestamps followed by percentages.
+	union entry_value * values = checked_malloc(value_count * sizeof(union entry_value));
+	for (size_t row = 0; row < row_count; row++) {
+		union entry_value * row_values = &values[row * (1 + signal_count)];
+		row_values[0].as_timespec = (struct timespec) { .tv_sec = 1577836800 + row };
+		for (size_t i = 1; i <= signal_count; i++) {
+			row_values[i].as_double = (double) ((row * 31 + i * 17) % 10000) / 100;
+		}
+	}
+
+	//
+
+	struct sbuf list_output = SBUF_INIT();
+	struct sbuf schema_output = SBUF_INIT();
+	size_t bytes = 0;
+
+	struct bench_timer timer;
+	bench_start(&timer);
+	for (size_t i = 0; i < repeat_count; i++) {
+		struct values_state state = { .values = values, .count = value_count };
+		sbuf_clear(&list_output);
+		format_data_list(&id_signal, &signals, &state, &list_output);
+		bytes += sbuf_length(&list_output);
+	}
+	bench_stop(&timer, "format data (entry list)", repeat_count, repeat_count * value_count, bytes);
+
+	struct schema * schema = schema_compile(&id_signal, &signals);
+	assert(schema != NULL);
+
+	bytes = 0;
+	bench_start(&timer);
+	for (size_t i = 0; i < repeat_count; i++) {
+		struct values_state state = { .values = values, .count = value_count };
+		sbuf_clear(&schema_output);
+		schema_format_data(schema, next_value, &state, &schema_output);
+		bytes += sbuf_length(&schema_output);
+	}
+	bench_stop(&timer, "format data (compiled schema)", repeat_count, repeat_count * value_count, bytes);
+
+	// Both variants must produce identical output.
+	assert(strcmp(sbuf_string(&list_output), sbuf_string(&schema_output)) == 0);
+
+	// Row-major batch: columns point into the first row of values.
+	struct schema_column * columns = checked_malloc((1 + signal_count) * sizeof(struct schema_column));
+	columns[0] = (struct schema_column) {
+		.data = &values[0].as_timespec, .stride = (1 + signal_count) * sizeof(union entry_value)
+	};
+
+	for (size_t i = 1; i <= signal_count; i++) {
+		columns[i] = (struct schema_column) {
+			.data = &values[i].as_double, .stride = columns[0].stride
+		};
+	}
+
+	struct schema_batch batch = { .row_count = row_count, .columns = columns };
+
+	bytes = 0;
+	bench_start(&timer);
+	for (size_t i = 0; i < repeat_count; i++) {
+		sbuf_clear(&list_output);
+		schema_format_batches(schema, &batch, 1, &list_output);
+		bytes += sbuf_length(&list_output);
+	}
+	bench_stop(&timer, "format data (compiled schema, batch)", repeat_count, repeat_count * value_count, bytes);
+
+	assert(strcmp(sbuf_string(&list_output), sbuf_string(&schema_output)) == 0);
+
+	free(columns);
+
+	schema_destroy(schema);
+	sbuf_destroy(&schema_output);
+	sbuf_destroy(&list_output);
+	free(values);
+	free(names);
+	free(entries);
+}
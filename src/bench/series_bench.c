@@ -0,0 +1,145 @@
+/**
+ * Benchmarks of the compressed time series buffer.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <common/checked.h>
+
+#include <fivis/entry.h>
+#include <fivis/series.h>
+
+#include "bench.h"
+
+//
+
+// Samples similar to cpumon samples with 64 CPUs and 10 times per CPU.
+static const size_t column_count = 650;
+static const size_t row_count = 300;
+
+static const size_t block_size = 64 << 10;
+
+static const size_t repeat_count = 10;
+
+
+struct decode_state {
+	union entry_value * values;
+	uint64_t checksum;
+};
+
+
+static void
+decode_row(void * arg, size_t index, const struct timespec * timestamp, const union entry_value * values) {
+	struct decode_state * state = (struct decode_state *) arg;
+	memcpy(&state->values[index * column_count], values, column_count * sizeof(union entry_value));
+	state->checksum += timestamp->tv_sec;
+}
+
+
+/**
+ * Appends the rows to a buffer and decodes them again, a number of times,
+ * and reports the throughput (in uncompressed bytes) and the compression
+ * ratio relative to the size of the uncompressed values.
+ */
+static void
+run(const char * label, series_type_t type, union entry_value * rows, struct timespec * timestamps) {
+	series_type_t * types = checked_malloc(column_count * sizeof(series_type_t));
+	for (size_t i = 0; i < column_count; i++) {
+		types[i] = type;
+	}
+
+	size_t block_count = 2 * row_count * column_count * sizeof(union entry_value) / block_size;
+	struct series * series = series_create(types, column_count, block_size, block_count);
+	assert(series != NULL);
+
+	size_t raw_bytes = row_count * (1 + column_count) * sizeof(union entry_value);
+	size_t compressed_bytes = 0;
+
+	char name[64];
+	struct bench_timer timer;
+
+	snprintf(name, sizeof(name), "series append %s", label);
+	bench_start(&timer);
+	for (size_t i = 0; i < repeat_count; i++) {
+		for (size_t row = 0; row < row_count; row++) {
+			bool appended = series_append(series, &timestamps[row], &rows[row * column_count]);
+			assert(appended);
+		}
+
+		compressed_bytes = series_compressed_size(series);
+		series_drop(series, row_count);
+	}
+
+	bench_stop(&timer, name, repeat_count, repeat_count * row_count * column_count, repeat_count * raw_bytes);
+
+	for (size_t row = 0; row < row_count; row++) {
+		series_append(series, &timestamps[row], &rows[row * column_count]);
+	}
+
+	struct decode_state state = {
+		.values = checked_malloc(row_count * column_count * sizeof(union entry_value)),
+		.checksum = 0
+	};
+
+	snprintf(name, sizeof(name), "series decode %s", label);
+	bench_start(&timer);
+	for (size_t i = 0; i < repeat_count; i++) {
+		size_t decoded = series_peek(series, row_count, decode_row, &state);
+		assert(decoded == row_count);
+	}
+
+	bench_stop(&timer, name, repeat_count, repeat_count * row_count * column_count, repeat_count * raw_bytes);
+
+	for (size_t i = 0; i < row_count * column_count; i++) {
+		assert(state.values[i].as_unsigned == rows[i].as_unsigned);
+	}
+
+	snprintf(name, sizeof(name), "series %s ratio", label);
+	bench_report_count(name, "x", (double) raw_bytes / compressed_bytes);
+
+	free(state.values);
+	series_destroy(series);
+	free(types);
+}
+
+
+void
+bench_series(void) {
+	union entry_value * rows = checked_malloc(row_count * column_count * sizeof(union entry_value));
+	struct timespec * timestamps = checked_malloc(row_count * sizeof(struct timespec));
+
+	//
+	// Timestamps 12 seconds apart, with a jitter of a few milliseconds,
+	// and CPU times (in ticks) consumed during the sample period.
+	//
+	uint32_t seed = 12345;
+	for (size_t row = 0; row < row_count; row++) {
+		seed = seed * 1103515245 + 12345;
+		timestamps[row] = (struct timespec) {
+			.tv_sec = 1577836800 + 12 * row, .tv_nsec = ((seed >> 16) % 5000) * 1000
+		};
+
+		for (size_t i = 0; i < column_count; i++) {
+			seed = seed * 1103515245 + 12345;
+			// Mostly idle (the fourth time), some user and system time.
+			size_t time = i % 10;
+			uint64_t ticks = (seed >> 16) % ((time < 3) ? 50 : (time == 3) ? 100 : 3);
+			rows[row * column_count + i].as_unsigned = (time == 3) ? 1100 + ticks : ticks;
+		}
+	}
+
+	run("ticks", SERIES_UNSIGNED, rows, timestamps);
+
+	// Percentages with two decimals, as in cpumon requests.
+	for (size_t i = 0; i < row_count * column_count; i++) {
+		uint64_t ticks = rows[i].as_unsigned;
+		rows[i].as_double = (double) (ticks * 100 / 12) / 100;
+	}
+
+	run("percentages", SERIES_DOUBLE, rows, timestamps);
+
+	free(timestamps);
+	free(rows);
+}
@@ -0,0 +1,145 @@
+/**
+ * Benchmarks of request formatting over a range of schema widths and
+ * batch sizes.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+
+#include <common/checked.h>
+
+#include <fivis/entry.h>
+#include <fivis/fivis.h>
+#include <fivis/schema.h>
+#include <fivis/sbuf.h>
+#include <fivis/util.h>
+
+#include "bench.h"
+
+//
+
+static const size_t signal_counts[] = { 10, 100, 1000, 10000 };
+static const size_t row_counts[] = { 1, 10, 100, 1000, 10000 };
+
+// Number of values formatted per measurement (at least one request).
+static const size_t values_per_measurement = 2000000;
+
+// Larger requests are skipped to keep the memory usage reasonable.
+static const size_t request_values_max = 10000000;
+
+
+/** Generates values on the fly: an 'id' timestamp followed by doubles. */
+struct values_state {
+	size_t row_length;
+	size_t limit;
+	size_t next;
+	union entry_value value;
+};
+
+
+static union entry_value *
+next_value(void * arg) {
+	struct values_state * state = (struct values_state *) arg;
+	if (state->next >= state->limit) {
+		return NULL;
+	}
+
+	size_t index = state->next++;
+	size_t column = index % state->row_length;
+	if (column == 0) {
+		state->value.as_timespec = (struct timespec) { .tv_sec = 1577836800 + index };
+	} else {
+		state->value.as_double = (double) ((index * 17) % 10000) / 100;
+	}
+
+	return &state->value;
+}
+
+
+static void
+run(
+	const char * variant, struct entry * id_signal, struct list * signals,
+	struct schema * schema, size_t signal_count, size_t row_count
+) {
+	size_t row_length = 1 + signal_count;
+	size_t request_values = row_count * row_length;
+	size_t request_count = values_per_measurement / request_values;
+	if (request_count == 0) {
+		request_count = 1;
+	}
+
+	sbuf_t output = SBUF_INIT();
+	size_t bytes = 0;
+
+	char name[96];
+	snprintf(
+		name, sizeof(name), "%s (%zu signals x %zu rows)",
+		variant, signal_count, row_count
+	);
+
+	struct bench_timer timer;
+	bench_start(&timer);
+	for (size_t i = 0; i < request_count; i++) {
+		struct values_state state = { .row_length = row_length, .limit = request_values };
+
+		sbuf_clear(&output);
+		if (schema == NULL) {
+			fivis_signals_format_request(
+				"partner", "signal-set", NULL, id_signal, signals,
+				next_value, &state, &output
+			);
+		} else {
+			fivis_signals_format_compiled_request(
+				"partner", "signal-set", false, schema,
+				next_value, &state, &output
+			);
+		}
+
+		bytes += sbuf_length(&output);
+	}
+	bench_stop(&timer, name, request_count, request_count * request_values, bytes);
+
+	sbuf_destroy(&output);
+}
+
+
+void
+bench_sweep(void) {
+	size_t signal_count_max = signal_counts[sizeof_array(signal_counts) - 1];
+
+	struct entry * entries = checked_malloc(signal_count_max * sizeof(struct entry));
+	char (* names)[16] = checked_malloc(signal_count_max * sizeof(*names));
+	for (size_t i = 0; i < signal_count_max; i++) {
+		snprintf(names[i], sizeof(names[i]), "cpu%zu_t%zu", i / 10, i % 10);
+		entry_init_double_fixed(&entries[i], names[i], 2);
+	}
+
+	struct entry id_signal = entry_datetime("id");
+
+	for (size_t s = 0; s < sizeof_array(signal_counts); s++) {
+		size_t signal_count = signal_counts[s];
+
+		struct list signals = LIST_INIT(signals);
+		for (size_t i = 0; i < signal_count; i++) {
+			list_add_last(&signals, &entries[i].link);
+		}
+
+		struct schema * schema = schema_compile(&id_signal, &signals);
+		assert(schema != NULL);
+
+		for (size_t r = 0; r < sizeof_array(row_counts); r++) {
+			size_t row_count = row_counts[r];
+			if (row_count * (1 + signal_count) > request_values_max) {
+				continue;
+			}
+
+			run("format_request", &id_signal, &signals, NULL, signal_count, row_count);
+			run("format_compiled_request", &id_signal, &signals, schema, signal_count, row_count);
+		}
+
+		schema_destroy(schema);
+	}
+
+	free(names);
+	free(entries);
+}
@@ -0,0 +1,114 @@
+/**
+ * Benchmarks of the client overhead of sending requests, measured using
+ * the transports which do not involve the network.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+
+#include <common/checked.h>
+
+#include <fivis/entry.h>
+#include <fivis/fivis.h>
+#include <fivis/schema.h>
+#include <fivis/sbuf.h>
+
+#include "bench.h"
+
+//
+
+// Request similar to a cpumon request with 64 CPUs and 10 times per CPU.
+static const size_t signal_count = 650;
+static const size_t row_count = 300;
+
+static const size_t request_count = 20;
+
+
+struct values_state {
+	union entry_value * values;
+	size_t count;
+	size_t next;
+};
+
+
+static union entry_value *
+next_value(void * arg) {
+	struct values_state * state = (struct values_state *) arg;
+	if (state->next >= state->count) {
+		return NULL;
+	}
+
+	return &state->values[state->next++];
+}
+
+
+/**
+ * Sends a number of streamed requests using a context with the given
+ * transport and compression level, and reports the time per value.
+ */
+static void
+run(
+	const char * name, fivis_transport_type_t type, const char * target,
+	int level, struct schema * schema, union entry_value * values, size_t value_count
+) {
+	struct fivis * fivis = fivis_init_transport(type, target, "token");
+	assert(fivis != NULL);
+
+	bool compression = fivis_set_compression(fivis, level);
+	assert(compression);
+
+	size_t bytes = 0;
+
+	struct bench_timer timer;
+	bench_start(&timer);
+	for (size_t i = 0; i < request_count; i++) {
+		struct values_state state = { .values = values, .count = value_count, .next = 0 };
+		fivis_result_t result = fivis_signals_perform_streaming_request(
+			fivis, "partner", "signal-set", false, schema, next_value, &state
+		);
+
+		assert(result == FIVIS_OK);
+		bytes += fivis_last_request_stats(fivis)->body_size;
+	}
+	bench_stop(&timer, name, request_count, request_count * value_count, bytes);
+
+	fivis_cleanup(fivis);
+}
+
+
+void
+bench_transport(void) {
+	struct entry id_signal = entry_datetime("id");
+	struct list signals = LIST_INIT(signals);
+
+	struct entry * entries = checked_malloc(signal_count * sizeof(struct entry));
+	char (* names)[16] = checked_malloc(signal_count * sizeof(*names));
+	for (size_t i = 0; i < signal_count; i++) {
+		snprintf(names[i], sizeof(names[i]), "cpu%zu_t%zu", i / 10, i % 10);
+		entry_init_double_fixed(&entries[i], names[i], 2);
+		list_add_last(&signals, &entries[i].link);
+	}
+
+	size_t value_count = row_count * (1 + signal_count);
+	union entry_value * values = checked_malloc(value_count * sizeof(union entry_value));
+	for (size_t i = 0; i < value_count; i++) {
+		if (i % (1 + signal_count) == 0) {
+			values[i].as_timespec = (struct timespec) { .tv_sec = 1577836800 + i };
+		} else {
+			values[i].as_double = (double) (i % 10000) / 100;
+		}
+	}
+
+	struct schema * schema = schema_compile(&id_signal, &signals);
+	assert(schema != NULL);
+
+	run("streamed request (null)", FIVIS_TRANSPORT_NULL, NULL, 0, schema, values, value_count);
+	run("streamed request (null, gzip 1)", FIVIS_TRANSPORT_NULL, NULL, 1, schema, values, value_count);
+	run("streamed request (null, gzip 6)", FIVIS_TRANSPORT_NULL, NULL, 6, schema, values, value_count);
+	run("streamed request (file)", FIVIS_TRANSPORT_FILE, "/dev/null", 0, schema, values, value_count);
+
+	schema_destroy(schema);
+	free(values);
+	free(names);
+	free(entries);
+}
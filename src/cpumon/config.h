@@ -2,7 +2,9 @@
  * FIVIS configuration.
  *
  * Define FIVIS host, secret token for API access, partner identifier,
- * and a signal set identifier.
+ * and a signal set identifier. Optionally define the gzip compression
+ * level of requests, the limits of the request size, and the directory
+ * and the disk quota of the spool of unsent requests.
  */
 
 #ifndef _CONFIG_H_
@@ -29,5 +31,34 @@
 #  error Please define FIVIS_SIGNAL_SET_ID (e.g., in config.h)!
 #endif
 
+#ifndef FIVIS_COMPRESSION_LEVEL
+#  define FIVIS_COMPRESSION_LEVEL 6
+#endif
+
+// Maximum size of a request body (in bytes, before compression).
+#ifndef FIVIS_REQUEST_SIZE_MAX
+#  define FIVIS_REQUEST_SIZE_MAX (4 << 20)
+#endif
+
+// Maximum number of samples (data records) in a request.
+#ifndef FIVIS_REQUEST_SAMPLES_MAX
+#  define FIVIS_REQUEST_SAMPLES_MAX 100
+#endif
+
+// Directory keeping unsent requests on disk, NULL to keep them only in memory.
+#ifndef FIVIS_SPOOL_PATH
+#  define FIVIS_SPOOL_PATH NULL
+#endif
+
+// Maximum disk space used by the spool (in bytes).
+#ifndef FIVIS_SPOOL_QUOTA
+#  define FIVIS_SPOOL_QUOTA (256 << 20)
+#endif
+
+// Number of parallel connections draining a backlog, 0 to disable backfill.
+#ifndef FIVIS_BACKFILL_CONNECTIONS
+#  define FIVIS_BACKFILL_CONNECTIONS 4
+#endif
+
 
 #endif /* _CONFIG_H_ */
@@ -9,6 +9,7 @@
 
 #include <unistd.h>
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -19,14 +20,20 @@
 #include <common/error.h>
 #include <common/checked.h>
 
+#include <fivis/batching.h>
 #include <fivis/entry.h>
 #include <fivis/fivis.h>
+#include <fivis/json.h>
 #include <fivis/list.h>
+#include <fivis/schema.h>
+#include <fivis/series.h>
+#include <fivis/spool.h>
 #include <fivis/debug.h>
 #include <fivis/util.h>
 
 #include "config.h"
 #include "procfile.h"
+#include "procstat.h"
 
 //
 
@@ -41,10 +48,45 @@ static const char * fivis_signal_set_id = FIVIS_SIGNAL_SET_ID;
 static const int cpumon_sample_period_secs = 12;
 static const int cpumon_sample_count = 3600 / cpumon_sample_period_secs;
 
-static const int cpumon_dump_period_secs = 60;
+// Size of the blocks of the compressed sample history.
+static const size_t cpumon_history_block_size = 16 << 10;
+
+// Occupancy of the sample history at which older samples are merged into
+// samples covering longer periods (in seconds), one period after another.
+static const int cpumon_downsample_percent = 60;
+static const int cpumon_downsample_periods_secs[] = { 60, 300 };
+
+// Number of samples decoded at once when downsampling the history.
+static const size_t cpumon_downsample_chunk_samples = 64;
+
+// Bounds of the adaptive interval between dumps.
+static const int cpumon_dump_period_min_secs = 1;
+static const int cpumon_dump_period_max_secs = 60;
+
+// Limits of the size of a request.
+static const size_t cpumon_request_size_max = FIVIS_REQUEST_SIZE_MAX;
+static const size_t cpumon_request_samples_max = FIVIS_REQUEST_SAMPLES_MAX;
+
+// Location and limits of the spool of unsent requests.
+static const char * cpumon_spool_path = FIVIS_SPOOL_PATH;
+static const size_t cpumon_spool_quota = FIVIS_SPOOL_QUOTA;
+static const size_t cpumon_spool_segment_size = 16 << 20;
+
+// Number of parallel connections draining a backlog, and the backlog size
+// (in requests) which makes the backlog drained by them.
+static const size_t cpumon_backfill_connections = FIVIS_BACKFILL_CONNECTIONS;
+static const size_t cpumon_backfill_min_requests = 2;
+
 static const int cpumon_dump_retry_secs = 20;
 static const int cpumon_dump_check_secs = 5;
-static const int cpumon_dump_empty_min = cpumon_sample_count / 10;
+// Occupancy of the sample history at which unsent requests are given up.
+static const int cpumon_history_full_percent = 90;
+
+// Time before a dump to pre-warm the connection to the server.
+static const int cpumon_prewarm_lead_secs = 5;
+
+// Number of decimals in CPU usage percentages.
+static const int cpumon_percent_decimals = 2;
 
 //
 
@@ -92,95 +134,6 @@ fail_result:
 }
 
 
-static ssize_t
-proc_stat_get_cpu_count(const char * restrict buffer) {
-	ssize_t result = 0;
-
-	const char * current = buffer;
-	while (true) {
-		// Check prefix.
-		if (strspn(current, "cpu") != strlen("cpu")) {
-			return result;
-		}
-
-		// Find end of line.
-		current = strchr(current, '\n');
-		if (current == NULL) {
-			return result;
-		}
-
-		current++;
-		result++;
-	}
-}
-
-
-static ssize_t
-proc_stat_get_time_count(const char * restrict buffer) {
-	ssize_t result = 0;
-
-	static const char * prefix = "cpu ";
-	int length = strlen(prefix);
-
-	const char * current = strstr(buffer, prefix);
-	if (current != NULL)  {
-		current += length;
-
-		uint64_t dummy;
-		while (sscanf(current, "%" SCNu64 "%n", &dummy, &length) == 1) {
-			current += length;
-			result++;
-		}
-	}
-
-	return result;
-}
-
-
-static ssize_t
-proc_stat_parse_times(
-	const char * restrict buffer, size_t count, union entry_value * values
-) {
-	static const char * prefix = "cpu";
-	ssize_t result = 0;
-
-	const char * current = buffer;
-	while (true) {
-		// Validate 'cpu ' or 'cpu* ' line prefix.
-		if (strstr(current, prefix) == NULL) {
-			// Neither prefix found, stop parsing.
-			return result;
-		}
-
-		// Make sure the next character is space.
-		current = strchr(current, ' ');
-		if (current == NULL) {
-			return result;
-		}
-
-		// Parse the columns
-		uint64_t value;
-		int length;
-		while (sscanf(current, "%" SCNu64 "%n", &value, &length) == 1) {
-			current += length;
-
-			if (result >= count) {
-				// Value count reached, stop parsing.
-				return result;
-			}
-
-			values->as_unsigned = value;
-			values++;
-
-			result++;
-		}
-
-		sscanf(current, "\n%n", &length);
-		current += length;
-	}
-}
-
-
 static char *
 supply_cpu_name(size_t index) {
 	// Index 0 corresponds to the CPU with summary times accross all CPUS.
@@ -236,7 +189,7 @@ checked_create_time_signals(ssize_t cpu_count, ssize_t time_count, struct list *
 			check_error(name == NULL, "failed to create signal name: %s_%s\n", cpu_name, time_name);
 
 			struct entry * signal = &time_signals[cpu_index][time_index];
-			entry_init_double(signal, name);
+			entry_init_double_fixed(signal, name, cpumon_percent_decimals);
 
 			list_add_last(signals, &signal->link);
 		}
@@ -265,6 +218,31 @@ nanosleep_secs(time_t secs) {
 }
 
 
+static struct timespec
+timespec_after_secs(const struct timespec * ts, double secs) {
+	time_t whole_secs = (time_t) secs;
+	struct timespec result = {
+		.tv_sec = ts->tv_sec + whole_secs,
+		.tv_nsec = ts->tv_nsec + (long) ((secs - whole_secs) * 1e9)
+	};
+
+	if (result.tv_nsec >= 1000000000) {
+		result.tv_sec++;
+		result.tv_nsec -= 1000000000;
+	}
+
+	return result;
+}
+
+
+static double
+elapsed_secs(const struct timespec * start) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+
 static int
 compare_timespec(struct timespec * ts1, struct timespec * ts2) {
 	if (ts1->tv_sec < ts2->tv_sec) {
@@ -310,21 +288,185 @@ sample_zero_times(struct sample * sample, size_t time_count) {
 }
 
 
+/**
+ * Creates a compressed history for samples with the given number of
+ * CPU time values, using at most the given number of blocks of the given
+ * size. The CPU times are stored as deltas from the previous sample.
+ */
+static struct series *
+checked_create_history(size_t value_count, size_t block_size, size_t block_count) {
+	series_type_t * types = checked_malloc(value_count * sizeof(series_type_t));
+	for (size_t i = 0; i < value_count; i++) {
+		types[i] = SERIES_UNSIGNED;
+	}
+
+	struct series * result = series_create(types, value_count, block_size, block_count);
+	check_error(result == NULL, "failed to create sample history");
+
+	free(types);
+	return result;
+}
+
+
 struct cpumon_args {
 	volatile bool cpumon_stop;
 	struct procfile * proc_stat;
 	size_t time_values_count;
 
-	struct list empty_samples;
-	struct list full_samples;
+	// Compressed history of samples waiting to be sent.
+	struct series * history;
+	size_t history_block_size;
+	size_t history_block_count;
+
+	// Number of history blocks in use after the last downsampling.
+	size_t downsample_block_count;
 
 	pthread_mutex_t samples_mutex;
-	pthread_cond_t empty_samples_cond;
+	pthread_cond_t full_samples_cond;
 
 	struct sample * last_sample[2];
 };
 
 
+/**
+ * Merges consecutive samples falling into the same period into a single
+ * sample, which holds the CPU times of all the merged samples and the
+ * timestamp of the last one. Only the given number of the oldest samples
+ * are merged, the others are kept as they are.
+ */
+struct downsampler {
+	struct series * target;
+	size_t value_count;
+	time_t period_secs;
+	size_t merge_count;
+	size_t seen_count;
+	size_t lost_count;
+
+	// Sample being merged, if any.
+	bool pending;
+	time_t pending_period;
+	struct timespec pending_ts;
+	union entry_value * pending_values;
+};
+
+
+static void
+downsampler_append(struct downsampler * ds, const struct timespec * ts, const union entry_value * values) {
+	if (!series_append(ds->target, ts, values)) {
+		ds->lost_count++;
+	}
+}
+
+
+static void
+downsampler_flush(struct downsampler * ds) {
+	if (ds->pending) {
+		downsampler_append(ds, &ds->pending_ts, ds->pending_values);
+		ds->pending = false;
+	}
+}
+
+
+static void
+downsample_sample(void * arg, size_t index, const struct timespec * ts, const union entry_value * values) {
+	struct downsampler * ds = (struct downsampler *) arg;
+	bool merge = ds->seen_count < ds->merge_count;
+	time_t period = ts->tv_sec / ds->period_secs;
+	ds->seen_count++;
+
+	if (merge && ds->pending && period == ds->pending_period) {
+		for (size_t i = 0; i < ds->value_count; i++) {
+			ds->pending_values[i].as_unsigned += values[i].as_unsigned;
+		}
+
+		ds->pending_ts = *ts;
+		return;
+	}
+
+	downsampler_flush(ds);
+
+	if (merge) {
+		memcpy(ds->pending_values, values, ds->value_count * sizeof(union entry_value));
+		ds->pending_ts = *ts;
+		ds->pending_period = period;
+		ds->pending = true;
+	} else {
+		downsampler_append(ds, ts, values);
+	}
+}
+
+
+/**
+ * Replaces the history with a new one, in which the given number of the
+ * oldest samples are merged into samples covering the given period. The
+ * samples are moved a chunk at a time, so that the blocks of the old
+ * history are released as the new history grows. Must be called with
+ * the samples mutex held.
+ */
+static void
+downsample_history(struct cpumon_args * args, time_t period_secs, size_t merge_count) {
+	struct series * history = args->history;
+	struct downsampler ds = {
+		.target = checked_create_history(
+			args->time_values_count, args->history_block_size, args->history_block_count
+		),
+		.value_count = args->time_values_count,
+		.period_secs = period_secs,
+		.merge_count = merge_count,
+		.pending_values = checked_malloc(args->time_values_count * sizeof(union entry_value)),
+	};
+
+	size_t chunk_count;
+	while ((chunk_count = series_peek(history, cpumon_downsample_chunk_samples, downsample_sample, &ds)) > 0) {
+		series_drop(history, chunk_count);
+	}
+
+	downsampler_flush(&ds);
+
+	if (ds.lost_count > 0) {
+		warn("failed to store %zu downsampled samples, samples dropped\n", ds.lost_count);
+	}
+
+	free(ds.pending_values);
+	series_destroy(history);
+	args->history = ds.target;
+}
+
+
+/**
+ * Downsamples the oldest half of the history, one period after another,
+ * while the history occupancy is above the threshold. Does nothing if
+ * the history did not grow since the last downsampling, i.e., when the
+ * samples could not be merged any further. Must be called with the
+ * samples mutex held. Returns the number of samples merged away.
+ */
+static size_t
+downsample_history_if_needed(struct cpumon_args * args) {
+	size_t block_count_limit = args->history_block_count * cpumon_downsample_percent / 100;
+	if (series_block_count(args->history) < block_count_limit) {
+		args->downsample_block_count = 0;
+		return 0;
+	}
+
+	if (series_block_count(args->history) <= args->downsample_block_count) {
+		return 0;
+	}
+
+	size_t old_count = series_row_count(args->history);
+	for (size_t i = 0; i < sizeof_array(cpumon_downsample_periods_secs); i++) {
+		size_t merge_count = series_row_count(args->history) / 2;
+		downsample_history(args, cpumon_downsample_periods_secs[i], merge_count);
+
+		if (series_block_count(args->history) < block_count_limit) {
+			break;
+		}
+	}
+
+	args->downsample_block_count = series_block_count(args->history);
+	return old_count - series_row_count(args->history);
+}
+
+
 static void *
 cpumon_main(struct cpumon_args * args) {
 	assert(args != NULL);
@@ -339,7 +481,8 @@ cpumon_main(struct cpumon_args * args) {
 	sample_zero_times(last_sample, args->time_values_count);
 
 	// Current sample to fill.
-	struct sample * sample = NULL;
+	size_t sample_size = sizeof(struct sample) + args->time_values_count * sizeof(union entry_value);
+	struct sample * sample = (struct sample *) checked_malloc(sample_size);
 
 	while (!args->cpumon_stop) {
 		//
@@ -370,41 +513,10 @@ cpumon_main(struct cpumon_args * args) {
 
 
 		//
-		// Lock the mutex and get empty sample for signal values. This may
-		// involve waiting on a condition variable for the main thread to
-		// return empty sample structures.
+		// Fill in the sample values by parsing the contents of the
+		// /proc/stat file to get all time values for all CPUs. If we
+		// parsed less values than expected, retry everything.
 		//
-		if (sample == NULL) {
-			checked_mutex_lock(&args->samples_mutex);
-
-			while (list_is_empty(&args->empty_samples)) {
-				debug("cpumon: no empty samples available, waiting\n");
-
-				checked_cond_wait(&args->empty_samples_cond, &args->samples_mutex);
-				if (args->cpumon_stop) {
-					// Unlock mutex before terminating.
-					checked_mutex_unlock(&args->samples_mutex);
-					goto terminate;
-				}
-			}
-
-			struct list * item = list_remove(args->empty_samples.next);
-
-			checked_mutex_unlock(&args->samples_mutex);
-
-			sample = list_item_var(item, sample, link);
-			debug("cpumon: acquired empty sample\n");
-		}
-
-		//
-		// Fill in the sample values. This means setting the 'id' and 'ts'
-		// signal values and then parsing the contents of the /proc/stat
-		// file to get all time values for all CPUs. If we parsed less
-		// values than expected, retry everything.
-		//
-		sample->id_value.as_timespec = ts;
-		sample->ts_value.as_timespec = ts;
-
 		size_t expected_count = args->time_values_count;
 		size_t values_read = proc_stat_parse_times(
 			procfile_string(args->proc_stat), expected_count, &sample->time_values[0]
@@ -429,20 +541,50 @@ cpumon_main(struct cpumon_args * args) {
 		last_sample = snap_sample;
 
 		//
-		// Put the sample in the list of full samples for the main thread
-		// to consume. Lock the sample mutex to make sure the main thread
-		// is not accessing it at the same time.
+		// Append the sample to the history for the main thread to consume.
+		// Lock the sample mutex to make sure the main thread is not
+		// accessing the history at the same time. As the history fills up,
+		// merge the older samples into coarser ones. If the history is full
+		// nevertheless, evict the oldest samples to make room for the new
+		// ones.
 		//
 		debug("cpumon: produced full sample\n");
 
+		size_t evicted_count = 0;
+		bool appended = false;
+
 		checked_mutex_lock(&args->samples_mutex);
-		list_add_last(&args->full_samples, &sample->link);
+		size_t merged_count = downsample_history_if_needed(args);
+		while (!(appended = series_append(args->history, &ts, &sample->time_values[0]))) {
+			size_t dropped_count = series_drop_block(args->history);
+			if (dropped_count == 0) {
+				break;
+			}
+
+			evicted_count += dropped_count;
+		}
+
+		size_t history_count = series_row_count(args->history);
+		checked_cond_signal(&args->full_samples_cond);
 		checked_mutex_unlock(&args->samples_mutex);
 
-		sample = NULL;
+		if (merged_count > 0) {
+			warn(
+				"sample history filling up, %zu older samples merged, %zu samples left\n",
+				merged_count, history_count
+			);
+		}
+
+		if (evicted_count > 0) {
+			warn("sample history full, %zu oldest samples dropped\n", evicted_count);
+		}
+
+		if (!appended) {
+			warn("failed to store sample in history, sample dropped\n");
+		}
 	}
 
-terminate:
+	free(sample);
 	debug("cpumon: thread finished\n");
 	return (void *) EXIT_SUCCESS;
 }
@@ -455,13 +597,13 @@ convert_times_to_percentages(size_t cpu_count, size_t time_count, union entry_va
 	union entry_value (* values)[time_count] = (union entry_value (*)[time_count]) first;
 
 	// Sum rows and convert values to fractions of the sum.
-	for (int cpu = 0; cpu < cpu_count; cpu++) {
+	for (size_t cpu = 0; cpu < cpu_count; cpu++) {
 		uint64_t sum = 0;
-		for (int time = 0; time < time_count; time++) {
+		for (size_t time = 0; time < time_count; time++) {
 			sum += values[cpu][time].as_unsigned;
 		}
 
-		for (int time = 0; time < time_count; time++) {
+		for (size_t time = 0; time < time_count; time++) {
 			double fraction = (double) values[cpu][time].as_unsigned / sum;
 			values[cpu][time].as_double = fraction * 100;
 		}
@@ -497,56 +639,633 @@ checked_global_init() {
 
 
 
-struct next_value_state {
-	struct list samples;
+/**
+ * Returns true if the second sample immediately follows the first sample
+ * in memory, i.e., both samples belong to the same batch of rows.
+ */
+static inline bool
+sample_is_adjacent(struct sample * first, struct sample * second, size_t sample_size) {
+	return (char *) second == (char *) first + sample_size;
+}
+
+
+/**
+ * Returns the number of batches needed to describe the given list of
+ * samples. Samples adjacent in memory belong to the same batch.
+ */
+static size_t
+count_sample_batches(struct list * samples, size_t sample_size) {
+	size_t result = 0;
+
+	struct sample * prev = NULL;
+	struct sample * sample;
+	list_for_each_item(sample, samples, link) {
+		if (prev == NULL || !sample_is_adjacent(prev, sample, sample_size)) {
+			result++;
+		}
+
+		prev = sample;
+	}
+
+	return result;
+}
+
+
+/**
+ * Describes a batch of rows starting with the given sample. The columns
+ * point to the values in the first sample, with the stride of a sample.
+ */
+static void
+describe_sample_batch(
+	struct sample * first, size_t row_count, size_t sample_size,
+	size_t value_count, struct schema_column * columns, struct schema_batch * batch
+) {
+	// The 'id' signal is a custom entry, it takes the whole value.
+	columns[0] = (struct schema_column) { .data = &first->id_value, .stride = sample_size };
+	columns[1] = (struct schema_column) { .data = &first->ts_value.as_timespec, .stride = sample_size };
+
+	for (size_t index = 0; index < value_count; index++) {
+		columns[2 + index] = (struct schema_column) {
+			.data = &first->time_values[index].as_double, .stride = sample_size
+		};
+	}
+
+	*batch = (struct schema_batch) { .row_count = row_count, .columns = columns };
+}
+
+
+/**
+ * Describes the given list of samples as a sequence of batches of rows.
+ * The arrays of batches and columns must be large enough for the number
+ * of batches returned by count_sample_batches(). Returns the number of
+ * batches.
+ */
+static size_t
+describe_sample_batches(
+	struct list * samples, size_t sample_size, size_t value_count,
+	struct schema_batch * batches, struct schema_column * columns
+) {
+	size_t column_count = 2 + value_count;
+	size_t batch_count = 0;
+
+	struct sample * first = NULL;
+	struct sample * prev = NULL;
+	size_t row_count = 0;
+
 	struct sample * sample;
-	union entry_value * next_value;
-	size_t next_index;
+	list_for_each_item(sample, samples, link) {
+		if (prev != NULL && !sample_is_adjacent(prev, sample, sample_size)) {
+			describe_sample_batch(
+				first, row_count, sample_size, value_count,
+				&columns[batch_count * column_count], &batches[batch_count]
+			);
+
+			batch_count++;
+			first = NULL;
+		}
+
+		if (first == NULL) {
+			first = sample;
+			row_count = 0;
+		}
+
+		row_count++;
+		prev = sample;
+	}
+
+	if (first != NULL) {
+		describe_sample_batch(
+			first, row_count, sample_size, value_count,
+			&columns[batch_count * column_count], &batches[batch_count]
+		);
+
+		batch_count++;
+	}
+
+	return batch_count;
+}
+
+
+/**
+ * Formats a request with the given samples into the request buffer.
+ * Returns the request string on success, NULL on failure.
+ */
+static const char *
+format_samples(
+	struct list * samples, size_t sample_size, size_t value_count,
+	struct schema * schema, bool with_schema, struct sbuf * request
+) {
+	size_t batch_count = count_sample_batches(samples, sample_size);
+	struct schema_batch * batches = checked_malloc(batch_count * sizeof(struct schema_batch));
+	struct schema_column * columns = checked_malloc(
+		batch_count * schema->signal_count * sizeof(struct schema_column)
+	);
+
+	describe_sample_batches(samples, sample_size, value_count, batches, columns);
+
+	sbuf_clear(request);
+	sbuf_reserve(request, fivis_signals_estimate_request_size(
+		FIVIS_PARTNER_ID, FIVIS_SIGNAL_SET_ID, with_schema,
+		schema, list_size(samples)
+	));
+
+	const char * result = fivis_signals_format_batch_request(
+		FIVIS_PARTNER_ID, FIVIS_SIGNAL_SET_ID, with_schema,
+		schema, batches, batch_count, request
+	);
+
+	free(columns);
+	free(batches);
+	return result;
+}
+
+
+/**
+ * Moves up to the given number of samples from the beginning of one
+ * list to the end of another. Returns the number of samples moved.
+ */
+static size_t
+move_samples(struct list * from, struct list * to, size_t count) {
+	size_t result = 0;
+	while (result < count && ! list_is_empty(from)) {
+		struct list * item = list_remove_after(from);
+		list_add_last(to, item);
+		result++;
+	}
+
+	return result;
+}
+
+
+/**
+ * Moves all samples of a piece back to the beginning of the list of
+ * samples, keeping their order.
+ */
+static void
+put_back_samples(struct list * samples, struct list * piece) {
+	while (! list_is_empty(piece)) {
+		struct list * item = list_remove_before(piece);
+		list_add_first(samples, item);
+	}
+}
+
+
+struct sample_decoder {
+	char * storage;
+	size_t sample_size;
 	size_t value_count;
+	struct list * samples;
 };
 
 
-static union entry_value *
-cpumon_next_value(void * arg) {
-	struct next_value_state * state = (struct next_value_state *) arg;
+/**
+ * Stores a sample decoded from the history into the slot with the given
+ * index and appends it to the list of samples.
+ */
+static void
+decode_sample(void * arg, size_t index, const struct timespec * ts, const union entry_value * values) {
+	struct sample_decoder * decoder = (struct sample_decoder *) arg;
+	struct sample * sample = (struct sample *) (decoder->storage + index * decoder->sample_size);
+
+	sample->id_value.as_timespec = *ts;
+	sample->ts_value.as_timespec = *ts;
+	memcpy(&sample->time_values[0], values, decoder->value_count * sizeof(union entry_value));
+
+	list_add_last(decoder->samples, &sample->link);
+}
+
+
+/**
+ * Removes up to the given number of the oldest samples from the history
+ * and decodes them into consecutive slots of the given storage, appending
+ * them to the given list. Returns the number of samples.
+ */
+static size_t
+grab_samples(
+	struct cpumon_args * args, size_t count, char * storage,
+	size_t sample_size, struct list * samples
+) {
+	struct sample_decoder decoder = {
+		.storage = storage, .sample_size = sample_size,
+		.value_count = args->time_values_count, .samples = samples
+	};
+
+	checked_mutex_lock(&args->samples_mutex);
+
+	size_t result = series_peek(args->history, count, decode_sample, &decoder);
+	series_drop(args->history, result);
+
+	checked_mutex_unlock(&args->samples_mutex);
+	return result;
+}
+
+
+/**
+ * Grows the given piece of samples, which is waiting to be sent again,
+ * with up to the given number of samples collected since, and formats the
+ * request again. The samples are decoded into the storage slots following
+ * those in use, so that they stay adjacent to the samples of the piece.
+ * Samples which would make the request too large are moved to the given
+ * list of samples still to be sent. Returns the number of samples added
+ * to the piece.
+ */
+static size_t
+coalesce_samples(
+	struct cpumon_args * args, size_t count, char * storage, size_t * storage_used,
+	size_t sample_size, int cpu_count, int time_count,
+	struct schema * schema, bool with_schema,
+	struct list * piece, struct list * samples, struct sbuf * request
+) {
+	struct list added = LIST_INIT(added);
+	size_t added_count = grab_samples(
+		args, count, storage + *storage_used * sample_size, sample_size, &added
+	);
+
+	if (added_count == 0) {
+		return 0;
+	}
+
+	*storage_used += added_count;
+
+	struct sample * sample;
+	list_for_each_item(sample, &added, link) {
+		convert_times_to_percentages(cpu_count, time_count, &sample->time_values[0]);
+	}
+
+	move_samples(&added, piece, SIZE_MAX);
+
+	size_t value_count = args->time_values_count;
+	const char * request_string = format_samples(
+		piece, sample_size, value_count, schema, with_schema, request
+	);
+
+	if (request_string != NULL && sbuf_length(request) <= cpumon_request_size_max) {
+		return added_count;
+	}
+
+	// Send the new samples separately and format the original piece again.
+	for (size_t i = 0; i < added_count; i++) {
+		list_add_first(samples, list_remove_before(piece));
+	}
+
+	format_samples(piece, sample_size, value_count, schema, with_schema, request);
+	return 0;
+}
+
+
+/**
+ * Returns true if the blocks of the sample history are almost all used,
+ * i.e., the 'cpumon' thread will soon have to drop the oldest samples.
+ */
+static bool
+history_is_nearly_full(struct cpumon_args * args) {
+	checked_mutex_lock(&args->samples_mutex);
+
+	size_t used_count = series_block_count(args->history);
+	size_t max_count = series_block_count_max(args->history);
+	size_t sample_count = series_row_count(args->history);
+	size_t compressed_size = series_compressed_size(args->history);
+
+	checked_mutex_unlock(&args->samples_mutex);
+
+	debug(
+		"main: %zu samples in history, %zu bytes in %zu of %zu blocks\n",
+		sample_count, compressed_size, used_count, max_count
+	);
+
+	return used_count * 100 >= max_count * cpumon_history_full_percent;
+}
+
+
+/**
+ * Waits until the given (absolute, real) time or until there is the given
+ * number of full samples, whichever comes first. Returns true if there are
+ * enough full samples, false otherwise.
+ */
+static bool
+wait_for_full_samples(struct cpumon_args * args, const struct timespec * until, size_t count) {
+	checked_mutex_lock(&args->samples_mutex);
+
+	bool waiting = true;
+	while (waiting && series_row_count(args->history) < count) {
+		waiting = checked_cond_timedwait(&args->full_samples_cond, &args->samples_mutex, until);
+	}
+
+	bool result = series_row_count(args->history) >= count;
+
+	checked_mutex_unlock(&args->samples_mutex);
+	return result;
+}
+
+
+/**
+ * Sends the requests left in the spool, oldest first, until there are no
+ * more or a request fails with a transient error. Requests which fail
+ * permanently are dropped.
+ */
+static void
+send_spooled_requests(struct fivis * fivis, struct spool * spool) {
+	struct spool_record record;
+	uint64_t after_id = 0;
+
+	while (spool_next_pending(spool, after_id, &record)) {
+		after_id = record.id;
+
+		debug("main: performing spooled FIVIS request %" PRIu64 "\n", record.id);
+		fivis_result_t fivis_result = fivis_signals_perform_request(fivis, record.data, record.size);
+		if (fivis_result != FIVIS_OK && fivis_result_is_transient(fivis_result)) {
+			warn("spooled FIVIS request failed, retry later: %s\n", fivis_last_error());
+			break;
+		}
+
+		if (fivis_result != FIVIS_OK) {
+			warn("spooled FIVIS request failed permanently, request dropped: %s\n", fivis_last_error());
+		}
 
-	// First-time initialization.
-	if (state->sample == NULL) {
-		if (list_is_empty(&state->samples)) {
-			return NULL;
+		spool_ack(spool, record.id);
+	}
+
+	debug("main: %zu spooled requests left\n", spool_pending_count(spool));
+}
+
+//
+
+/**
+ * Backfill of a backlog of samples. The backlog is drained by worker
+ * threads, each sending requests over its own connection, independently
+ * of the live samples sent by the main thread.
+ */
+struct backfill {
+	volatile bool stop;
+	struct cpumon_args * args;
+	struct fivis_pool * pool;
+	struct schema * schema;
+
+	int cpu_count;
+	int time_count;
+	size_t sample_size;
+
+	// Samples per request, and blocks available to the sample histories.
+	size_t request_sample_max;
+	size_t history_block_count;
+
+	pthread_mutex_t mutex;
+	struct series * backlog;
+	size_t total_count;
+	size_t sent_count;
+	size_t dropped_count;
+	size_t finished_count;
+	struct timespec start;
+
+	size_t worker_count;
+	pthread_t * workers;
+};
+
+
+/**
+ * Removes a request worth of the oldest samples from the backlog and
+ * decodes them into the given storage, appending them to the given list.
+ * Evicts the oldest samples of the backlog if the backlog and the live
+ * history together use more blocks than available. Returns the number of
+ * samples.
+ */
+static size_t
+grab_backlog_samples(struct backfill * backfill, char * storage, struct list * samples) {
+	struct cpumon_args * args = backfill->args;
+
+	checked_mutex_lock(&args->samples_mutex);
+	size_t live_block_count = series_block_count(args->history);
+	checked_mutex_unlock(&args->samples_mutex);
+
+	struct sample_decoder decoder = {
+		.storage = storage, .sample_size = backfill->sample_size,
+		.value_count = args->time_values_count, .samples = samples
+	};
+
+	checked_mutex_lock(&backfill->mutex);
+
+	size_t evicted_count = 0;
+	while (live_block_count + series_block_count(backfill->backlog) > backfill->history_block_count) {
+		size_t dropped_count = series_drop_block(backfill->backlog);
+		if (dropped_count == 0) {
+			break;
 		}
 
-		// Get the first sample and prepare 'id' signal value as the next.
-		state->sample = list_item_var(state->samples.next, state->sample, link);
-		state->next_value = &state->sample->id_value;
+		evicted_count += dropped_count;
 	}
 
-	assert(state->sample != NULL);
+	backfill->dropped_count += evicted_count;
+
+	size_t result = series_peek(
+		backfill->backlog, backfill->request_sample_max, decode_sample, &decoder
+	);
+
+	series_drop(backfill->backlog, result);
+
+	checked_mutex_unlock(&backfill->mutex);
+
+	if (evicted_count > 0) {
+		warn("sample history full, %zu oldest backlog samples dropped\n", evicted_count);
+	}
+
+	return result;
+}
+
+
+/** Accounts for samples sent or dropped and reports the backfill progress. */
+static void
+report_backfill_progress(struct backfill * backfill, size_t sent_count, size_t dropped_count) {
+	checked_mutex_lock(&backfill->mutex);
+
+	backfill->sent_count += sent_count;
+	backfill->dropped_count += dropped_count;
+
+	size_t done_count = backfill->sent_count + backfill->dropped_count;
+	size_t total_count = backfill->total_count;
+	size_t total_dropped_count = backfill->dropped_count;
+
+	checked_mutex_unlock(&backfill->mutex);
+
+	debug(
+		"backfill: %zu of %zu samples done (%.0f%%), %zu dropped, %.1f seconds\n",
+		done_count, total_count, 100.0 * done_count / total_count,
+		total_dropped_count, elapsed_secs(&backfill->start)
+	);
+}
+
+
+/**
+ * Sends a backfill request, retrying after transient failures until the
+ * request succeeds, fails permanently, is found too large, or until the
+ * backfill is asked to stop. Returns the result of the last attempt.
+ */
+static fivis_result_t
+perform_backfill_request(
+	struct backfill * backfill, struct fivis * fivis,
+	struct sbuf * request, size_t piece_count
+) {
+	while (true) {
+		fivis_result_t fivis_result = fivis_signals_perform_request(
+			fivis, sbuf_string(request), sbuf_length(request)
+		);
+
+		fivis_record_request_records(fivis, piece_count);
+
+		if (fivis_result == FIVIS_OK || fivis_result == FIVIS_ERR_TOO_LARGE) {
+			return fivis_result;
+		}
+
+		if (!fivis_result_is_transient(fivis_result)) {
+			return fivis_result;
+		}
+
+		// Wait as long as the server asked, if it asked for more.
+		int retry_delay = cpumon_dump_retry_secs;
+		long retry_after = fivis_last_response(fivis)->retry_after_secs;
+		if (fivis_result == FIVIS_ERR_RETRY_LATER && retry_after > retry_delay) {
+			retry_delay = (int) retry_after;
+		}
+
+		warn("backfill request failed, retry in %d seconds: %s\n", retry_delay, fivis_last_error());
+		while (retry_delay > 0) {
+			retry_delay -= nanosleep_secs(cpumon_dump_check_secs);
+
+			if (backfill->stop) {
+				return fivis_result;
+			}
+		}
+	}
+}
+
+
+/**
+ * Drains the backlog, one request worth of samples at a time, until the
+ * backlog is empty. Requests which turn out too large are split in halves.
+ */
+static void *
+backfill_main(struct backfill * backfill) {
+	struct fivis * fivis = fivis_pool_acquire(backfill->pool);
+	fivis_set_compression(fivis, FIVIS_COMPRESSION_LEVEL);
+
+	size_t sample_size = backfill->sample_size;
+	size_t value_count = backfill->args->time_values_count;
+	char * sample_storage = (char *) checked_malloc(backfill->request_sample_max * sample_size);
+	struct sbuf request = SBUF_INIT();
+
+	size_t piece_limit = backfill->request_sample_max;
+	while (!backfill->stop) {
+		struct list samples = LIST_INIT(samples);
+		if (grab_backlog_samples(backfill, sample_storage, &samples) == 0) {
+			break;
+		}
+
+		struct sample * sample;
+		list_for_each_item(sample, &samples, link) {
+			convert_times_to_percentages(backfill->cpu_count, backfill->time_count, &sample->time_values[0]);
+		}
+
+		while (! list_is_empty(&samples) && !backfill->stop) {
+			struct list piece = LIST_INIT(piece);
+			size_t piece_count = move_samples(&samples, &piece, piece_limit);
+
+			const char * request_string = format_samples(
+				&piece, sample_size, value_count, backfill->schema, false, &request
+			);
+
+			if (request_string == NULL) {
+				error("failed to format backfill request, samples dropped\n");
+				report_backfill_progress(backfill, 0, piece_count + list_size(&samples));
+				break;
+			}
+
+			if (sbuf_length(&request) > cpumon_request_size_max && piece_count > 1) {
+				piece_limit = (piece_count + 1) / 2;
+				put_back_samples(&samples, &piece);
+				continue;
+			}
+
+			fivis_result_t fivis_result = perform_backfill_request(
+				backfill, fivis, &request, piece_count
+			);
+
+			if (fivis_result == FIVIS_ERR_TOO_LARGE && piece_count > 1) {
+				warn("backfill request too large, splitting %zu samples\n", piece_count);
+				piece_limit = (piece_count + 1) / 2;
+				put_back_samples(&samples, &piece);
+				continue;
+			}
+
+			if (fivis_result == FIVIS_OK) {
+				report_backfill_progress(backfill, piece_count, 0);
+			} else {
+				warn("backfill request failed, request dropped: %s\n", fivis_last_error());
+				report_backfill_progress(backfill, 0, piece_count);
+			}
+		}
+	}
+
+	sbuf_destroy(&request);
+	free(sample_storage);
+	fivis_pool_release(backfill->pool, fivis);
+
+	checked_mutex_lock(&backfill->mutex);
+	backfill->finished_count++;
+	checked_mutex_unlock(&backfill->mutex);
+	return (void *) EXIT_SUCCESS;
+}
+
+
+/** Starts the backfill workers draining the given backlog. */
+static void
+start_backfill(struct backfill * backfill, struct series * backlog) {
+	backfill->stop = false;
+	backfill->backlog = backlog;
+	backfill->total_count = series_row_count(backlog);
+	backfill->sent_count = 0;
+	backfill->dropped_count = 0;
+	backfill->finished_count = 0;
+	clock_gettime(CLOCK_MONOTONIC, &backfill->start);
+
+	debug(
+		"backfill: draining %zu samples over %zu connections\n",
+		backfill->total_count, backfill->worker_count
+	);
+
+	void * (* start) (void * ) = (void * (*) (void *)) backfill_main;
+	for (size_t i = 0; i < backfill->worker_count; i++) {
+		int thread_result = pthread_create(&backfill->workers[i], NULL, start, backfill);
+		check_std_error(thread_result != 0, "failed to create backfill thread");
+	}
+}
 
-	// Serve current 'next_value' and prepare the next 'next_value'.
-	union entry_value * value = state->next_value;
-	if (value == &state->sample->id_value) {
-		// We are serving 'id' signal value, prepare 'ts' as next.
-		state->next_value = &state->sample->ts_value;
-		state->next_index = 0;
 
-	} else if (state->next_index < state->value_count) {
-		// We are serving 'ts' or a CPU time value, prepare next CPU time.
-		state->next_value = &state->sample->time_values[state->next_index];
-		state->next_index++;
+/** Returns true if all backfill workers have finished. */
+static bool
+backfill_is_finished(struct backfill * backfill) {
+	checked_mutex_lock(&backfill->mutex);
+	bool result = backfill->finished_count == backfill->worker_count;
+	checked_mutex_unlock(&backfill->mutex);
+	return result;
+}
 
-	} else if (state->sample->link.next != &state->samples) {
-		// We are serving the last CPU time value. Move to next sample and
-		// prepare its 'id' signal value as the next.
-		state->sample = list_item_var(state->sample->link.next, state->sample, link);
-		state->next_value = &state->sample->id_value;
 
-	} else if (value != NULL) {
-		// We are serving the last value. There will be no more.
-		state->next_value = NULL;
+/**
+ * Waits for the backfill workers to finish and releases the backlog.
+ * The workers must have finished, or must have been asked to stop.
+ */
+static void
+finish_backfill(struct backfill * backfill) {
+	for (size_t i = 0; i < backfill->worker_count; i++) {
+		checked_thread_join(backfill->workers[i]);
 	}
 
-	return value;
+	debug(
+		"backfill: finished, %zu samples sent, %zu dropped in %.1f seconds\n",
+		backfill->sent_count, backfill->dropped_count, elapsed_secs(&backfill->start)
+	);
+
+	series_destroy(backfill->backlog);
+	backfill->backlog = NULL;
 }
 
 
@@ -554,7 +1273,10 @@ const char *
 id_format_datetime_value(
 	const char * restrict name, union entry_value * value, struct sbuf * buffer
 ) {
-	return sbuf_format(buffer, "\"%s\": \"%011d\"", name, value->as_timespec.tv_sec);
+	json_append_key(buffer, name);
+	sbuf_append_char(buffer, '"');
+	sbuf_append_uint64_padded(buffer, value->as_timespec.tv_sec, 11);
+	return sbuf_append_char(buffer, '"');
 }
 
 
@@ -572,6 +1294,39 @@ main(int argc, char * argv[]) {
 		exit(EXIT_FAILURE);
 	}
 
+	if (!fivis_set_compression(fivis, FIVIS_COMPRESSION_LEVEL)) {
+		error("fivis: %s\n", fivis_last_error());
+		exit(EXIT_FAILURE);
+	}
+
+	//
+	// Keep the requests in a spool on disk until they are sent, so that
+	// requests which could not be sent during an outage survive dropping
+	// the samples and a restart of the monitor.
+	//
+	struct spool * spool = NULL;
+	if (cpumon_spool_path != NULL) {
+		spool = spool_open(cpumon_spool_path, cpumon_spool_segment_size, cpumon_spool_quota);
+		if (spool == NULL) {
+			error("failed to open spool in %s\n", cpumon_spool_path);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	//
+	// Drain a backlog of samples over a pool of additional connections,
+	// so that the backlog does not hold up the live samples.
+	//
+	struct fivis_pool * backfill_pool = NULL;
+	if (cpumon_backfill_connections > 0) {
+		backfill_pool = fivis_pool_init(FIVIS_API_HOST, FIVIS_API_TOKEN, cpumon_backfill_connections);
+		if (backfill_pool == NULL) {
+			error("fivis: %s\n", fivis_last_error());
+			error("failed to initialize FIVIS backfill connections\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
 	struct procfile * proc_stat = procfile_open("/proc/stat");
 	if (proc_stat == NULL) {
 		error("failed to open /proc/stat\n");
@@ -602,6 +1357,10 @@ main(int argc, char * argv[]) {
 	int time_count = proc_stat_get_time_count(procfile_string(proc_stat));
 	checked_create_time_signals(cpu_count, time_count, &signals);
 
+	// Compile the schema once, it is used for every request.
+	struct schema * schema = schema_compile(&id_signal, &signals);
+	check_error(schema == NULL, "failed to compile signal schema");
+
 	//
 	// Start the CPU usage monitoring thread and periodically
 	// flush the samples collected by the thread.
@@ -611,158 +1370,419 @@ main(int argc, char * argv[]) {
 	size_t value_count = cpu_count * time_count;
 	size_t sample_size = sizeof(struct sample) + value_count * sizeof(union entry_value);
 
+	//
+	// Keep the samples waiting to be sent in a compressed history, which
+	// uses as much memory as the predefined number of uncompressed samples
+	// would. The CPU times are stored as deltas from the previous sample,
+	// which take a byte or two instead of a whole entry value, so that the
+	// history holds many more samples during an outage.
+	//
+	size_t history_block_size = series_block_size_min(value_count);
+	if (history_block_size < cpumon_history_block_size) {
+		history_block_size = cpumon_history_block_size;
+	}
+
+	size_t history_block_count = cpumon_sample_count * sample_size / history_block_size;
+	if (history_block_count < 2) {
+		history_block_count = 2;
+	}
+
 	// Prepare data for sampler thread.
 	struct cpumon_args cpumon_args = {
 		.cpumon_stop = false,
 		.proc_stat = proc_stat,
 		.time_values_count = value_count,
-		.empty_samples = LIST_INIT(cpumon_args.empty_samples),
-		.full_samples = LIST_INIT(cpumon_args.full_samples),
+		.history = checked_create_history(value_count, history_block_size, history_block_count),
+		.history_block_size = history_block_size,
+		.history_block_count = history_block_count,
+		.downsample_block_count = 0,
 		.samples_mutex = PTHREAD_MUTEX_INITIALIZER,
-		.empty_samples_cond = PTHREAD_COND_INITIALIZER,
+		.full_samples_cond = PTHREAD_COND_INITIALIZER,
 		.last_sample = {
 			(struct sample *) checked_malloc(sample_size),
 			(struct sample *) checked_malloc(sample_size)
 		}
 	};
 
-	// Allocate predefined number of data chunks.
-	for (int i = 0; i < cpumon_sample_count; i++) {
-		struct sample * sample = (struct sample *) checked_malloc(sample_size);
-		list_add_last(&cpumon_args.empty_samples, &sample->link);
-	}
-
-
 	pthread_t cpumon_thread = checked_start_cpumon(&cpumon_args);
 
 	//
 
 	struct sbuf request = SBUF_INIT();
-	struct list * schema = &signals;
+	bool with_schema = true;
 
-	struct timespec next_dump;
-	clock_gettime(CLOCK_REALTIME, &next_dump);
-	next_dump.tv_sec += cpumon_dump_period_secs;
+	//
+	// Limit the number of samples in a request so that the estimated
+	// request size (including the schema) does not exceed the maximum.
+	//
+	size_t request_sample_max = fivis_signals_estimate_request_records(
+		FIVIS_PARTNER_ID, FIVIS_SIGNAL_SET_ID, true, schema, cpumon_request_size_max
+	);
 
+	if (request_sample_max > cpumon_request_samples_max) {
+		request_sample_max = cpumon_request_samples_max;
+	} else if (request_sample_max == 0) {
+		warn("a single sample may exceed the maximum request size\n");
+		request_sample_max = 1;
+	}
 
-	while (true) {
-		// Sleep until given time and schedule next sleep from the wakup.
-		clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &next_dump, NULL);
+	size_t dump_sample_count = cpumon_dump_period_max_secs / cpumon_sample_period_secs;
+	if (dump_sample_count > request_sample_max) {
+		dump_sample_count = request_sample_max;
+	}
 
-		clock_gettime(CLOCK_REALTIME, &next_dump);
-		next_dump.tv_sec += cpumon_dump_period_secs;
+	debug("main: at most %zu samples per request\n", request_sample_max);
 
-		// Lock the sample list mutex.
+	//
+	// Samples taken from the history are decoded into a single array, so
+	// that they can be passed to the request formatter as a single batch
+	// of rows.
+	//
+	char * sample_storage = (char *) checked_malloc(request_sample_max * sample_size);
+
+	struct backfill backfill = {
+		.stop = false,
+		.args = &cpumon_args,
+		.pool = backfill_pool,
+		.schema = schema,
+		.cpu_count = cpu_count,
+		.time_count = time_count,
+		.sample_size = sample_size,
+		.request_sample_max = request_sample_max,
+		.history_block_count = history_block_count,
+		.mutex = PTHREAD_MUTEX_INITIALIZER,
+		.backlog = NULL,
+		.worker_count = cpumon_backfill_connections,
+		.workers = (backfill_pool != NULL) ? checked_malloc(cpumon_backfill_connections * sizeof(pthread_t)) : NULL,
+	};
+
+	//
+	// The number of samples per request and the interval between requests
+	// adapt to the request latency and errors. Without a backlog, a dump
+	// sends the samples collected during the longest interval. With a
+	// backlog (e.g., after a network outage), dumps follow each other after
+	// the shortest interval, so that the backlog drains at the rate the
+	// link can sustain.
+	//
+	struct batching batching;
+	batching_init(&batching, &(struct batching_config) {
+		.rows_min = dump_sample_count,
+		.rows_max = request_sample_max,
+		.rows_initial = dump_sample_count,
+		.rows_increase = dump_sample_count,
+		.rows_decrease = 0.5,
+		.latency_tolerance = 1.0,
+		.interval_min_secs = cpumon_dump_period_min_secs,
+		.interval_max_secs = cpumon_dump_period_max_secs,
+	});
+
+	//
+	// Requests found too large are split into pieces with at most the
+	// given number of samples. The limit persists, so that the following
+	// requests are not sent just to be refused by the server again.
+	//
+	size_t piece_limit = request_sample_max;
+
+	while (true) {
 		checked_mutex_lock(&cpumon_args.samples_mutex);
+		size_t backlog_count = series_row_count(cpumon_args.history);
+		checked_mutex_unlock(&cpumon_args.samples_mutex);
 
-		// Grab full samples.
-		if (! list_is_empty(&cpumon_args.full_samples)) {
-			struct next_value_state next_value_state = {
-				.samples = LIST_INIT(next_value_state.samples),
-				.value_count = value_count,
-			};
+		if (backfill.backlog != NULL && backfill_is_finished(&backfill)) {
+			finish_backfill(&backfill);
+		}
 
-			while (! list_is_empty(&cpumon_args.full_samples)) {
-				struct list * item = list_remove_after(&cpumon_args.full_samples);
-				list_add_last(&next_value_state.samples, item);
-			}
+		//
+		// With a backlog of more than a few requests (e.g., after a network
+		// outage) and the link working again (a request with the schema has
+		// been sent), hand the backlog over to the backfill workers, which
+		// drain it over their own connections in requests with as many
+		// samples as allowed. New samples go to a new history and are sent
+		// as usual, without waiting behind the backlog.
+		//
+		if (backfill_pool != NULL && backfill.backlog == NULL && !with_schema
+			&& backlog_count > cpumon_backfill_min_requests * request_sample_max
+		) {
+			struct series * live = checked_create_history(
+				value_count, history_block_size, history_block_count
+			);
 
-			// Unlock the mutex for processing.
+			checked_mutex_lock(&cpumon_args.samples_mutex);
+			struct series * backlog = cpumon_args.history;
+			cpumon_args.history = live;
+			backlog_count = series_row_count(live);
 			checked_mutex_unlock(&cpumon_args.samples_mutex);
 
-			//
-			// Convert the CPU time samples to percentages, format the
-			// request and send it to the server. The first request will
-			// include a schema part, the subsequent requests will not.
-			//
-			// When sending the request, keep trying for some time, but
-			// stop when we run out of empty samples.
-			//
-			struct sample * sample;
-			list_for_each_item(sample, &next_value_state.samples, link) {
-				convert_times_to_percentages(cpu_count, time_count, &sample->time_values[0]);
+			start_backfill(&backfill, backlog);
+		}
+
+		double dump_interval = batching_interval(&batching, backlog_count);
+		debug(
+			"main: next dump in %.1f seconds, %zu samples waiting, batch size %zu\n",
+			dump_interval, backlog_count, batching_rows(&batching)
+		);
+
+		struct timespec now;
+		clock_gettime(CLOCK_REALTIME, &now);
+		struct timespec next_dump = timespec_after_secs(&now, dump_interval);
+
+		//
+		// Dump the samples when the time is up or when the samples waiting
+		// fill a request, whichever comes first. Pre-warm the connection
+		// shortly before the dump, so that the request does not pay for the
+		// connection setup if the previous connection was closed while
+		// idle. Dumps following each other closely reuse the connection.
+		//
+		bool request_full = false;
+		if (dump_interval > 2 * cpumon_prewarm_lead_secs) {
+			struct timespec next_prewarm = next_dump;
+			next_prewarm.tv_sec -= cpumon_prewarm_lead_secs;
+			request_full = wait_for_full_samples(&cpumon_args, &next_prewarm, request_sample_max);
+
+			if (!fivis_prewarm(fivis)) {
+				debug("main: failed to pre-warm FIVIS connection: %s\n", fivis_last_error());
 			}
+		}
+
+		if (!request_full) {
+			request_full = wait_for_full_samples(&cpumon_args, &next_dump, request_sample_max);
+		}
 
-			sbuf_clear(&request);
-			const char * request_string = fivis_signals_format_request(
-				FIVIS_PARTNER_ID, FIVIS_SIGNAL_SET_ID, schema,
-				&id_signal, &signals, cpumon_next_value, &next_value_state,
-				&request
+		if (request_full) {
+			debug("main: samples waiting fill a request, dumping early\n");
+		}
+
+		// Grab full samples, up to the current batch size.
+		struct list samples = LIST_INIT(samples);
+		size_t storage_used = grab_samples(
+			&cpumon_args, batching_rows(&batching), sample_storage, sample_size, &samples
+		);
+
+		//
+		// Convert the CPU time samples to percentages, format the requests
+		// and send them to the server. The first request will include a
+		// schema part, the subsequent requests will not.
+		//
+		// A piece of samples which turns out to be too large, either when
+		// formatted or for the server, is split in halves, which are sent
+		// independently. Only the piece which failed is retried. When
+		// sending a request, keep trying until it succeeds, or, when the
+		// request is in the spool, until the sample history is about to
+		// overflow.
+		//
+		struct sample * sample;
+		list_for_each_item(sample, &samples, link) {
+			convert_times_to_percentages(cpu_count, time_count, &sample->time_values[0]);
+		}
+
+		bool format_failed = false;
+		while (! list_is_empty(&samples)) {
+			struct list piece = LIST_INIT(piece);
+			size_t piece_count = move_samples(&samples, &piece, piece_limit);
+
+			const char * request_string = format_samples(
+				&piece, sample_size, value_count, schema, with_schema, &request
 			);
 
 			if (request_string == NULL) {
 				error("failed to format FIVIS signals request\n");
+				format_failed = true;
 				break;
 			}
 
+			if (sbuf_length(&request) > cpumon_request_size_max && piece_count > 1) {
+				debug(
+					"main: request with %zu samples has %zu bytes, splitting\n",
+					piece_count, sbuf_length(&request)
+				);
+
+				piece_limit = (piece_count + 1) / 2;
+				put_back_samples(&samples, &piece);
+				continue;
+			}
+
 			debug(request_string);
 
+			uint64_t spool_id = 0;
+			if (spool != NULL && !spool_append(spool, sbuf_string(&request), sbuf_length(&request), &spool_id)) {
+				warn("failed to spool FIVIS request\n");
+			}
+
 			//
 
+			bool request_sent = false;
+			bool request_split = false;
 			bool request_done = false;
 			while (!request_done) {
 				debug("main: performing FIVIS request\n");
+				struct timespec request_start;
+				clock_gettime(CLOCK_MONOTONIC, &request_start);
+
 				fivis_result_t fivis_result = fivis_signals_perform_request(
 					fivis, sbuf_string(&request), sbuf_length(&request)
 				);
 
+				batching_update(
+					&batching, piece_count, elapsed_secs(&request_start),
+					fivis_result == FIVIS_OK
+				);
+
+				fivis_record_request_records(fivis, piece_count);
+
 				if (fivis_result == FIVIS_OK) {
-					debug("main: FIVIS request succeeded\n");
-					schema = NULL;
+					const struct fivis_request_stats * stats = fivis_last_request_stats(fivis);
+					debug(
+						"main: FIVIS request succeeded, sent %zu of %zu bytes, compressed in %.3f ms\n",
+						stats->sent_size, stats->body_size, stats->compress_ns / 1e6
+					);
+
+					const struct fivis_connection_stats * connections = fivis_connection_stats(fivis);
+					debug(
+						"main: %zu requests, %zu reused connections, %zu new connections, "
+						"%zu pre-warmed connections\n",
+						connections->requests, connections->reused_connections,
+						connections->new_connections, connections->prewarm_connections
+					);
+
+					const struct fivis_request_histograms * histograms = fivis_request_histograms(fivis);
+					debug(
+						"main: median/99th percentile times: total %.1f/%.1f ms, first byte %.1f/%.1f ms, "
+						"TLS %.1f/%.1f ms\n",
+						histogram_quantile(&histograms->total_us, 0.5) / 1e3,
+						histogram_quantile(&histograms->total_us, 0.99) / 1e3,
+						histogram_quantile(&histograms->first_byte_us, 0.5) / 1e3,
+						histogram_quantile(&histograms->first_byte_us, 0.99) / 1e3,
+						histogram_quantile(&histograms->tls_us, 0.5) / 1e3,
+						histogram_quantile(&histograms->tls_us, 0.99) / 1e3
+					);
+					with_schema = false;
+					request_sent = true;
 					break;
 				}
 
-				warn("FIVIS request failed, retry in %d seconds\n", cpumon_dump_retry_secs);
+				// Send the halves of a request the server found too large.
+				if (fivis_result == FIVIS_ERR_TOO_LARGE && piece_count > 1) {
+					warn("FIVIS request too large, splitting %zu samples\n", piece_count);
+					request_split = true;
+					break;
+				}
+
+				// Retrying a request the server will never accept is pointless.
+				if (!fivis_result_is_transient(fivis_result)) {
+					warn("FIVIS request failed permanently, request dropped: %s\n", fivis_last_error());
+					break;
+				}
+
+				// Wait as long as the server asked, if it asked for more.
 				int retry_delay = cpumon_dump_retry_secs;
+				long retry_after = fivis_last_response(fivis)->retry_after_secs;
+				if (fivis_result == FIVIS_ERR_RETRY_LATER && retry_after > retry_delay) {
+					retry_delay = (int) retry_after;
+				}
+
+				warn("FIVIS request failed, retry in %d seconds: %s\n", retry_delay, fivis_last_error());
 				while (retry_delay > 0) {
 					retry_delay -= nanosleep_secs(cpumon_dump_check_secs);
 
-					// Check the empty list size.
-					checked_mutex_lock(&cpumon_args.samples_mutex);
-					int empty_count = list_size(&cpumon_args.empty_samples);
-					checked_mutex_unlock(&cpumon_args.samples_mutex);
-
-					debug("main: empty samples available: %d\n", empty_count);
-					if (empty_count <= cpumon_dump_empty_min) {
-						warn("number of empty samples too low, request dropped\n");
+					//
+					// Leave the request in the spool when the history fills up,
+					// so that the following samples can be spooled too. Without
+					// a spool, keep retrying, the history makes room for new
+					// samples by downsampling the older ones.
+					//
+					if (spool_id != 0 && history_is_nearly_full(&cpumon_args)) {
+						warn("sample history nearly full, request left in spool\n");
 						request_done = true;
 						break;
 					}
 				}
-			}
 
+				//
+				// Before retrying, add the samples collected in the meantime
+				// to the last piece of the batch, up to the limits of a
+				// request, so that a recovering link carries fewer, but fuller
+				// requests.
+				//
+				size_t room_count = (piece_limit > piece_count) ? piece_limit - piece_count : 0;
+				if (room_count > request_sample_max - storage_used) {
+					room_count = request_sample_max - storage_used;
+				}
 
-			//
-			// Return the processed samples to the list of empty samples
-			// and signalize the availablility of new empty samples. This
-			// may wake up the 'cpumon' thread if it was sleeping.
-			//
-			checked_mutex_lock(&cpumon_args.samples_mutex);
+				if (!request_done && room_count > 0 && list_is_empty(&samples)) {
+					size_t added_count = coalesce_samples(
+						&cpumon_args, room_count, sample_storage, &storage_used,
+						sample_size, cpu_count, time_count, schema, with_schema,
+						&piece, &samples, &request
+					);
+
+					if (added_count > 0) {
+						piece_count += added_count;
+						debug(
+							"main: %zu new samples added to the request, %zu samples, %zu bytes\n",
+							added_count, piece_count, sbuf_length(&request)
+						);
+
+						// Replace the spooled request with the grown one.
+						if (spool_id != 0) {
+							uint64_t old_spool_id = spool_id;
+							spool_id = 0;
+
+							if (!spool_append(spool, sbuf_string(&request), sbuf_length(&request), &spool_id)) {
+								warn("failed to spool FIVIS request\n");
+							}
+
+							spool_ack(spool, old_spool_id);
+						}
+					}
+				}
+			}
+
+			// The request was sent, dropped, or split, unless it was left unsent.
+			if (spool_id != 0 && !request_done) {
+				spool_ack(spool, spool_id);
+			}
 
-			while (! list_is_empty(&next_value_state.samples)) {
-				struct list * item = list_remove_after(&next_value_state.samples);
-				list_add_last(&cpumon_args.empty_samples, item);
+			// The link works again, send what was left in the spool.
+			if (spool != NULL && request_sent) {
+				send_spooled_requests(fivis, spool);
 			}
 
-			checked_cond_signal(&cpumon_args.empty_samples_cond);
+			if (request_split) {
+				piece_limit = (piece_count + 1) / 2;
+				put_back_samples(&samples, &piece);
+				continue;
+			}
 		}
 
-		// Unlock the mutex for the 'cpumon' thread.
-		checked_mutex_unlock(&cpumon_args.samples_mutex);
+		if (format_failed) {
+			break;
+		}
 	}
 
 
-	//
-	// Request the 'cpumon' thread to stop. Signal the empty samples
-	// condition variable in case it was waiting for empty samples.
-	//
+	// Request the 'cpumon' thread and the backfill workers to stop.
 	cpumon_args.cpumon_stop = true;
-	checked_cond_signal(&cpumon_args.empty_samples_cond);
 	checked_thread_join(cpumon_thread);
 
+	if (backfill.backlog != NULL) {
+		backfill.stop = true;
+		finish_backfill(&backfill);
+	}
+
+	free(backfill.workers);
+	if (backfill_pool != NULL) {
+		fivis_pool_cleanup(backfill_pool);
+	}
+
 	sbuf_destroy(&request);
+	free(sample_storage);
+	series_destroy(cpumon_args.history);
+	schema_destroy(schema);
 	free_signals(&signals);
 	procfile_close(proc_stat);
+	if (spool != NULL) {
+		spool_close(spool);
+	}
 	fivis_cleanup(fivis);
 
 	//
@@ -0,0 +1,101 @@
+/**
+ * Functions for parsing the contents of the /proc/stat file.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <fivis/entry.h>
+
+#include "procstat.h"
+
+//
+
+ssize_t
+proc_stat_get_cpu_count(const char * restrict buffer) {
+	ssize_t result = 0;
+
+	const char * current = buffer;
+	while (true) {
+		// Check prefix.
+		if (strspn(current, "cpu") != strlen("cpu")) {
+			return result;
+		}
+
+		// Find end of line.
+		current = strchr(current, '\n');
+		if (current == NULL) {
+			return result;
+		}
+
+		current++;
+		result++;
+	}
+}
+
+
+ssize_t
+proc_stat_get_time_count(const char * restrict buffer) {
+	ssize_t result = 0;
+
+	static const char * prefix = "cpu ";
+	int length = strlen(prefix);
+
+	const char * current = strstr(buffer, prefix);
+	if (current != NULL)  {
+		current += length;
+
+		uint64_t dummy;
+		while (sscanf(current, "%" SCNu64 "%n", &dummy, &length) == 1) {
+			current += length;
+			result++;
+		}
+	}
+
+	return result;
+}
+
+
+ssize_t
+proc_stat_parse_times(
+	const char * restrict buffer, size_t count, union entry_value * values
+) {
+	static const char * prefix = "cpu";
+	ssize_t result = 0;
+
+	const char * current = buffer;
+	while (true) {
+		// Validate 'cpu ' or 'cpu* ' line prefix.
+		if (strstr(current, prefix) == NULL) {
+			// Neither prefix found, stop parsing.
+			return result;
+		}
+
+		// Make sure the next character is space.
+		current = strchr(current, ' ');
+		if (current == NULL) {
+			return result;
+		}
+
+		// Parse the columns
+		uint64_t value;
+		int length;
+		while (sscanf(current, "%" SCNu64 "%n", &value, &length) == 1) {
+			current += length;
+
+			if ((size_t) result >= count) {
+				// Value count reached, stop parsing.
+				return result;
+			}
+
+			values->as_unsigned = value;
+			values++;
+
+			result++;
+		}
+
+		sscanf(current, "\n%n", &length);
+		current += length;
+	}
+}
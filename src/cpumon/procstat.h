@@ -0,0 +1,34 @@
+/**
+ * Functions for parsing the contents of the /proc/stat file.
+ */
+
+#ifndef _PROCSTAT_H_
+#define _PROCSTAT_H_
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include <fivis/entry.h>
+
+//
+
+/**
+ * Returns the number of 'cpu' lines at the start of the given /proc/stat
+ * contents, including the line with summary times across all CPUs.
+ */
+ssize_t proc_stat_get_cpu_count(const char * restrict buffer);
+
+/** Returns the number of time values on the summary 'cpu' line. */
+ssize_t proc_stat_get_time_count(const char * restrict buffer);
+
+/**
+ * Parses up to the given number of time values from the 'cpu' lines of the
+ * given /proc/stat contents into the given array of values (as unsigned
+ * integers). Returns the number of values parsed.
+ */
+ssize_t proc_stat_parse_times(
+	const char * restrict buffer, size_t count, union entry_value * values
+);
+
+
+#endif /* _PROCSTAT_H_ */
@@ -0,0 +1,150 @@
+/**
+ * Adaptive batching controller.
+ */
+
+#include <assert.h>
+
+#include <fivis/batching.h>
+
+//
+
+/** Weight of a new latency sample in the smoothed latency. */
+static const double latency_weight = 0.25;
+
+/** Weight of a new outcome in the smoothed error rate. */
+static const double error_weight = 0.1;
+
+/**
+ * Smoothed error rate above which the batch size does not grow. A single
+ * failure keeps the batch from growing for several successful requests.
+ */
+static const double error_rate_max = 0.05;
+
+/**
+ * Weight of a higher latency sample in the baseline, which lets the
+ * baseline follow a lasting increase of the link latency.
+ */
+static const double baseline_drift = 0.01;
+
+//
+
+static inline size_t
+__clamp_rows(const struct batching_config * config, size_t rows) {
+	if (rows < config->rows_min) {
+		return config->rows_min;
+	} else if (rows > config->rows_max) {
+		return config->rows_max;
+	} else {
+		return rows;
+	}
+}
+
+
+void
+batching_init(struct batching * batching, const struct batching_config * config) {
+	assert(batching != NULL && config != NULL);
+
+	batching->config = *config;
+
+	struct batching_config * own = &batching->config;
+	if (own->rows_min < 1) {
+		own->rows_min = 1;
+	}
+	if (own->rows_max < own->rows_min) {
+		own->rows_max = own->rows_min;
+	}
+	if (own->rows_increase < 1) {
+		own->rows_increase = 1;
+	}
+	if (!(own->rows_decrease > 0 && own->rows_decrease < 1)) {
+		own->rows_decrease = 0.5;
+	}
+	if (own->interval_min_secs < 0) {
+		own->interval_min_secs = 0;
+	}
+	if (own->interval_max_secs < own->interval_min_secs) {
+		own->interval_max_secs = own->interval_min_secs;
+	}
+
+	batching->rows = __clamp_rows(own, own->rows_initial);
+	batching->baseline_secs = 0;
+	batching->latency_secs = 0;
+	batching->error_rate = 0;
+	batching->failures = 0;
+}
+
+
+size_t
+batching_rows(const struct batching * batching) {
+	assert(batching != NULL);
+	return batching->rows;
+}
+
+
+double
+batching_interval(const struct batching * batching, size_t backlog_rows) {
+	assert(batching != NULL);
+
+	const struct batching_config * config = &batching->config;
+	if (batching->failures > 0) {
+		// Back off exponentially, but do not wait longer than usual.
+		double interval = (config->interval_min_secs < 1) ? 1 : config->interval_min_secs;
+		for (size_t i = 1; i < batching->failures && interval < config->interval_max_secs; i++) {
+			interval *= 2;
+		}
+
+		return (interval < config->interval_max_secs) ? interval : config->interval_max_secs;
+	}
+
+	if (backlog_rows < batching->rows) {
+		return config->interval_max_secs;
+	}
+
+	//
+	// Send a backlog at the shortest interval, but slow down in proportion
+	// to the recent error rate, so that an unreliable link is not flooded
+	// with requests which are likely to fail.
+	//
+	double range_secs = config->interval_max_secs - config->interval_min_secs;
+	return config->interval_min_secs + range_secs * batching->error_rate;
+}
+
+
+void
+batching_update(
+	struct batching * batching, size_t rows, double latency_secs, bool success
+) {
+	assert(batching != NULL);
+
+	const struct batching_config * config = &batching->config;
+	batching->error_rate += ((success ? 0 : 1) - batching->error_rate) * error_weight;
+
+	if (!success) {
+		batching->failures++;
+		batching->rows = __clamp_rows(config, batching->rows * config->rows_decrease);
+		return;
+	}
+
+	batching->failures = 0;
+
+	if (batching->baseline_secs == 0 || latency_secs < batching->baseline_secs) {
+		batching->baseline_secs = latency_secs;
+		batching->latency_secs = latency_secs;
+	} else {
+		batching->baseline_secs += (latency_secs - batching->baseline_secs) * baseline_drift;
+		batching->latency_secs += (latency_secs - batching->latency_secs) * latency_weight;
+	}
+
+	//
+	// Shrink the batch as soon as the latency rises above the tolerance,
+	// but only grow it when the request was full, i.e., when there were
+	// enough rows to show whether a larger batch would still be fast, and
+	// when requests have not been failing recently.
+	//
+	double latency_max = batching->baseline_secs * (1 + config->latency_tolerance);
+	if (latency_secs > latency_max) {
+		batching->rows = __clamp_rows(config, batching->rows * config->rows_decrease);
+	} else if (rows >= batching->rows && batching->error_rate <= error_rate_max) {
+		batching->rows = __clamp_rows(config, batching->rows + config->rows_increase);
+	}
+}
@@ -0,0 +1,438 @@
+/**
+ * Conversion of double values to decimal strings.
+ *
+ * Implements the Grisu2 algorithm from "Printing Floating-Point Numbers
+ * Quickly and Accurately with Integers" by Florian Loitsch (PLDI 2010).
+ * The output always converts back to the original value, and is the
+ * shortest such representation in the vast majority of cases.
+ */
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <fivis/dtoa.h>
+
+//
+
+/** A "do-it-yourself" floating point number: f * 2^e. */
+struct diyfp {
+	uint64_t f;
+	int e;
+};
+
+
+#define DP_SIGNIFICAND_SIZE 52
+#define DP_EXPONENT_BIAS (0x3FF + DP_SIGNIFICAND_SIZE)
+#define DP_MIN_EXPONENT (-DP_EXPONENT_BIAS)
+#define DP_EXPONENT_MASK UINT64_C(0x7FF0000000000000)
+#define DP_SIGNIFICAND_MASK UINT64_C(0x000FFFFFFFFFFFFF)
+#define DP_HIDDEN_BIT UINT64_C(0x0010000000000000)
+
+#define DIYFP_SIZE 64
+
+
+static inline uint64_t
+__double_bits(double value) {
+	uint64_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+
+static inline struct diyfp
+__diyfp_from_double(double value) {
+	uint64_t bits = __double_bits(value);
+	int biased_exponent = (int) ((bits & DP_EXPONENT_MASK) >> DP_SIGNIFICAND_SIZE);
+	uint64_t significand = bits & DP_SIGNIFICAND_MASK;
+
+	if (biased_exponent != 0) {
+		return (struct diyfp) {
+			.f = significand + DP_HIDDEN_BIT,
+			.e = biased_exponent - DP_EXPONENT_BIAS
+		};
+	} else {
+		// Denormal number.
+		return (struct diyfp) {
+			.f = significand, .e = DP_MIN_EXPONENT + 1
+		};
+	}
+}
+
+
+static inline struct diyfp
+__diyfp_sub(struct diyfp x, struct diyfp y) {
+	assert(x.e == y.e && x.f >= y.f);
+	return (struct diyfp) { .f = x.f - y.f, .e = x.e };
+}
+
+
+/** Multiplies two numbers, rounding the 128-bit product to upper 64 bits. */
+static inline struct diyfp
+__diyfp_mul(struct diyfp x, struct diyfp y) {
+	const uint64_t mask32 = UINT64_C(0xFFFFFFFF);
+
+	uint64_t a = x.f >> 32, b = x.f & mask32;
+	uint64_t c = y.f >> 32, d = y.f & mask32;
+
+	uint64_t ac = a * c, bc = b * c;
+	uint64_t ad = a * d, bd = b * d;
+
+	uint64_t tmp = (bd >> 32) + (ad & mask32) + (bc & mask32);
+	tmp += UINT64_C(1) << 31; // Round.
+
+	return (struct diyfp) {
+		.f = ac + (ad >> 32) + (bc >> 32) + (tmp >> 32),
+		.e = x.e + y.e + DIYFP_SIZE
+	};
+}
+
+
+static inline struct diyfp
+__diyfp_normalize(struct diyfp x) {
+	assert(x.f != 0);
+
+	int shift = __builtin_clzll(x.f);
+	return (struct diyfp) { .f = x.f << shift, .e = x.e - shift };
+}
+
+
+/**
+ * Computes the normalized boundaries m- and m+ of the interval of real
+ * numbers which round to the given value. Both boundaries share the
+ * exponent of m+.
+ */
+static inline void
+__diyfp_normalized_boundaries(struct diyfp v, struct diyfp * minus, struct diyfp * plus) {
+	struct diyfp pl = __diyfp_normalize(
+		(struct diyfp) { .f = (v.f << 1) + 1, .e = v.e - 1 }
+	);
+
+	// The lower boundary is closer if the significand is a power of two.
+	struct diyfp mi = (v.f == DP_HIDDEN_BIT)
+		? (struct diyfp) { .f = (v.f << 2) - 1, .e = v.e - 2 }
+		: (struct diyfp) { .f = (v.f << 1) - 1, .e = v.e - 1 };
+
+	mi.f <<= mi.e - pl.e;
+	mi.e = pl.e;
+
+	*plus = pl;
+	*minus = mi;
+}
+
+//
+
+/**
+ * Normalized significands and binary exponents of cached powers of ten,
+ * 10^-348, 10^-340, ..., 10^340.
+ */
+static const uint64_t __cached_powers_f[] = {
+	0xfa8fd5a0081c0288, 0xbaaee17fa23ebf76, 0x8b16fb203055ac76,
+	0xcf42894a5dce35ea, 0x9a6bb0aa55653b2d, 0xe61acf033d1a45df,
+	0xab70fe17c79ac6ca, 0xff77b1fcbebcdc4f, 0xbe5691ef416bd60c,
+	0x8dd01fad907ffc3c, 0xd3515c2831559a83, 0x9d71ac8fada6c9b5,
+	0xea9c227723ee8bcb, 0xaecc49914078536d, 0x823c12795db6ce57,
+	0xc21094364dfb5637, 0x9096ea6f3848984f, 0xd77485cb25823ac7,
+	0xa086cfcd97bf97f4, 0xef340a98172aace5, 0xb23867fb2a35b28e,
+	0x84c8d4dfd2c63f3b, 0xc5dd44271ad3cdba, 0x936b9fcebb25c996,
+	0xdbac6c247d62a584, 0xa3ab66580d5fdaf6, 0xf3e2f893dec3f126,
+	0xb5b5ada8aaff80b8, 0x87625f056c7c4a8b, 0xc9bcff6034c13053,
+	0x964e858c91ba2655, 0xdff9772470297ebd, 0xa6dfbd9fb8e5b88f,
+	0xf8a95fcf88747d94, 0xb94470938fa89bcf, 0x8a08f0f8bf0f156b,
+	0xcdb02555653131b6, 0x993fe2c6d07b7fac, 0xe45c10c42a2b3b06,
+	0xaa242499697392d3, 0xfd87b5f28300ca0e, 0xbce5086492111aeb,
+	0x8cbccc096f5088cc, 0xd1b71758e219652c, 0x9c40000000000000,
+	0xe8d4a51000000000, 0xad78ebc5ac620000, 0x813f3978f8940984,
+	0xc097ce7bc90715b3, 0x8f7e32ce7bea5c70, 0xd5d238a4abe98068,
+	0x9f4f2726179a2245, 0xed63a231d4c4fb27, 0xb0de65388cc8ada8,
+	0x83c7088e1aab65db, 0xc45d1df942711d9a, 0x924d692ca61be758,
+	0xda01ee641a708dea, 0xa26da3999aef774a, 0xf209787bb47d6b85,
+	0xb454e4a179dd1877, 0x865b86925b9bc5c2, 0xc83553c5c8965d3d,
+	0x952ab45cfa97a0b3, 0xde469fbd99a05fe3, 0xa59bc234db398c25,
+	0xf6c69a72a3989f5c, 0xb7dcbf5354e9bece, 0x88fcf317f22241e2,
+	0xcc20ce9bd35c78a5, 0x98165af37b2153df, 0xe2a0b5dc971f303a,
+	0xa8d9d1535ce3b396, 0xfb9b7cd9a4a7443c, 0xbb764c4ca7a44410,
+	0x8bab8eefb6409c1a, 0xd01fef10a657842c, 0x9b10a4e5e9913129,
+	0xe7109bfba19c0c9d, 0xac2820d9623bf429, 0x80444b5e7aa7cf85,
+	0xbf21e44003acdd2d, 0x8e679c2f5e44ff8f, 0xd433179d9c8cb841,
+	0x9e19db92b4e31ba9, 0xeb96bf6ebadf77d9, 0xaf87023b9bf0ee6b,
+};
+
+static const int16_t __cached_powers_e[] = {
+	-1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+	-954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+	-688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+	-422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+	-157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+	109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+	375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+	641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+	907, 933, 960, 986, 1013, 1039, 1066,
+};
+
+
+/**
+ * Returns a cached power of ten c_k = 10^-k such that the binary exponent
+ * of the product of c_k and a number with the given binary exponent falls
+ * into the range expected by digit generation. Returns the decimal exponent
+ * -k through the k_ptr argument.
+ */
+static inline struct diyfp
+__get_cached_power(int e, int * k_ptr) {
+	// 1/log2(10) = 0.30102999566398114
+	double dk = (-61 - e) * 0.30102999566398114 + 347;
+	int k = (int) dk;
+	if (dk - k > 0.0) {
+		k++;
+	}
+
+	unsigned int index = (unsigned int) ((k >> 3) + 1);
+	*k_ptr = -(-348 + (int) (index << 3));
+
+	return (struct diyfp) {
+		.f = __cached_powers_f[index], .e = __cached_powers_e[index]
+	};
+}
+
+//
+
+static const uint32_t __pow10_u32[] = {
+	1, 10, 100, 1000, 10000, 100000,
+	1000000, 10000000, 100000000, 1000000000
+};
+
+
+/**
+ * Powers of ten used to scale the distance to the exact value when
+ * rounding the fractional digits, which may go beyond the 32-bit range.
+ */
+static const uint64_t __pow10_u64[] = {
+	UINT64_C(1), UINT64_C(10), UINT64_C(100), UINT64_C(1000),
+	UINT64_C(10000), UINT64_C(100000), UINT64_C(1000000),
+	UINT64_C(10000000), UINT64_C(100000000), UINT64_C(1000000000),
+	UINT64_C(10000000000), UINT64_C(100000000000), UINT64_C(1000000000000),
+	UINT64_C(10000000000000), UINT64_C(100000000000000),
+	UINT64_C(1000000000000000), UINT64_C(10000000000000000),
+	UINT64_C(100000000000000000), UINT64_C(1000000000000000000),
+	UINT64_C(10000000000000000000)
+};
+
+
+static inline int
+__count_decimal_digits(uint32_t n) {
+	int result = 1;
+	while (result < 10 && n >= __pow10_u32[result]) {
+		result++;
+	}
+
+	return result;
+}
+
+
+/**
+ * Adjusts the last generated digit to bring the result closer to the
+ * exact value, while staying within the rounding interval.
+ */
+static inline void
+__grisu_round(
+	char * buffer, int length, uint64_t delta, uint64_t rest,
+	uint64_t ten_kappa, uint64_t wp_w
+) {
+	while (
+		rest < wp_w && delta - rest >= ten_kappa &&
+		(rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)
+	) {
+		buffer[length - 1]--;
+		rest += ten_kappa;
+	}
+}
+
+
+/**
+ * Generates the digits of the upper boundary until the remainder falls
+ * into the rounding interval given by delta. Returns the number of digits
+ * and updates the decimal exponent through k_ptr.
+ */
+static int
+__grisu_digit_gen(
+	struct diyfp w, struct diyfp mp, uint64_t delta, char * buffer, int * k_ptr
+) {
+	const struct diyfp one = { .f = UINT64_C(1) << -mp.e, .e = mp.e };
+	const struct diyfp wp_w = __diyfp_sub(mp, w);
+
+	uint32_t p1 = (uint32_t) (mp.f >> -one.e);
+	uint64_t p2 = mp.f & (one.f - 1);
+
+	int kappa = __count_decimal_digits(p1);
+	int length = 0;
+
+	// Integral part.
+	while (kappa > 0) {
+		uint32_t divisor = __pow10_u32[kappa - 1];
+		uint32_t digit = p1 / divisor;
+		p1 %= divisor;
+
+		if (digit != 0 || length != 0) {
+			buffer[length++] = (char) ('0' + digit);
+		}
+
+		kappa--;
+
+		uint64_t rest = ((uint64_t) p1 << -one.e) + p2;
+		if (rest <= delta) {
+			*k_ptr += kappa;
+			__grisu_round(
+				buffer, length, delta, rest,
+				(uint64_t) __pow10_u32[kappa] << -one.e, wp_w.f
+			);
+			return length;
+		}
+	}
+
+	// Fractional part.
+	while (true) {
+		p2 *= 10;
+		delta *= 10;
+
+		uint32_t digit = (uint32_t) (p2 >> -one.e);
+		if (digit != 0 || length != 0) {
+			buffer[length++] = (char) ('0' + digit);
+		}
+
+		p2 &= one.f - 1;
+		kappa--;
+
+		if (p2 < delta) {
+			*k_ptr += kappa;
+			int index = -kappa;
+			__grisu_round(
+				buffer, length, delta, p2, one.f,
+				wp_w.f * (index < 20 ? __pow10_u64[index] : 0)
+			);
+			return length;
+		}
+	}
+}
+
+
+/**
+ * Generates the shortest digit string for a positive finite value.
+ * The value equals digits * 10^k. Returns the number of digits.
+ */
+static int
+__grisu2(double value, char * buffer, int * k_ptr) {
+	struct diyfp v = __diyfp_from_double(value);
+
+	struct diyfp w_m, w_p;
+	__diyfp_normalized_boundaries(v, &w_m, &w_p);
+
+	struct diyfp c_mk = __get_cached_power(w_p.e, k_ptr);
+	struct diyfp w = __diyfp_mul(__diyfp_normalize(v), c_mk);
+	struct diyfp wp = __diyfp_mul(w_p, c_mk);
+	struct diyfp wm = __diyfp_mul(w_m, c_mk);
+
+	// Shrink the interval to account for imprecision of the cached power.
+	wm.f++;
+	wp.f--;
+
+	return __grisu_digit_gen(w, wp, wp.f - wm.f, buffer, k_ptr);
+}
+
+//
+
+static inline char *
+__write_exponent(int k, char * buffer) {
+	if (k < 0) {
+		*buffer++ = '-';
+		k = -k;
+	}
+
+	if (k >= 100) {
+		*buffer++ = (char) ('0' + k / 100);
+		k %= 100;
+		*buffer++ = (char) ('0' + k / 10);
+		*buffer++ = (char) ('0' + k % 10);
+	} else if (k >= 10) {
+		*buffer++ = (char) ('0' + k / 10);
+		*buffer++ = (char) ('0' + k % 10);
+	} else {
+		*buffer++ = (char) ('0' + k);
+	}
+
+	return buffer;
+}
+
+
+/**
+ * Lays out the digits (value = digits * 10^k) in plain notation if the
+ * decimal point falls within a reasonable distance from the digits, and
+ * in exponential notation otherwise. Returns the end of the output.
+ */
+static char *
+__prettify(char * buffer, int length, int k) {
+	// Position of the decimal point relative to the start of digits.
+	const int kk = length + k;
+
+	if (0 <= k && kk <= 21) {
+		// Integer: 1234e7 -> 12340000000
+		memset(&buffer[length], '0', k);
+		return &buffer[kk];
+
+	} else if (0 < kk && kk <= 21) {
+		// Decimal point inside: 1234e-2 -> 12.34
+		memmove(&buffer[kk + 1], &buffer[kk], length - kk);
+		buffer[kk] = '.';
+		return &buffer[length + 1];
+
+	} else if (-6 < kk && kk <= 0) {
+		// Leading zeros: 1234e-6 -> 0.001234
+		const int offset = 2 - kk;
+		memmove(&buffer[offset], &buffer[0], length);
+		buffer[0] = '0';
+		buffer[1] = '.';
+		memset(&buffer[2], '0', offset - 2);
+		return &buffer[length + offset];
+
+	} else if (length == 1) {
+		// Single digit: 1e30
+		buffer[1] = 'e';
+		return __write_exponent(kk - 1, &buffer[2]);
+
+	} else {
+		// Exponential notation: 1234e30 -> 1.234e33
+		memmove(&buffer[2], &buffer[1], length - 1);
+		buffer[1] = '.';
+		buffer[length + 1] = 'e';
+		return __write_exponent(kk - 1, &buffer[length + 2]);
+	}
+}
+
+
+size_t
+dtoa_shortest(double value, char * buffer) {
+	assert(buffer != NULL);
+
+	uint64_t bits = __double_bits(value);
+	if ((bits & DP_EXPONENT_MASK) == DP_EXPONENT_MASK) {
+		// JSON has no representation for NaN or infinity.
+		memcpy(buffer, "null", 4);
+		return 4;
+	}
+
+	char * start = buffer;
+	if (value < 0) {
+		*buffer++ = '-';
+		value = -value;
+	}
+
+	if (value == 0) {
+		*buffer++ = '0';
+		return buffer - start;
+	}
+
+	int k;
+	int length = __grisu2(value, buffer, &k);
+	char * end = __prettify(buffer, length, k);
+	return end - start;
+}
@@ -2,6 +2,7 @@
 #include <stdlib.h>
 
 #include <fivis/entry.h>
+#include <fivis/json.h>
 #include <fivis/sbuf.h>
 
 //
@@ -10,9 +11,8 @@ const char *
 entry_format_boolean_value(
 	const char * restrict name, union entry_value * value, struct sbuf * buffer
 ) {
-	return sbuf_format(
-		buffer, "\"%s\": %s", name, value->as_boolean ? "true" : "false"
-	);
+	json_append_key(buffer, name);
+	return entry_format_typed_value(ENTRY_TYPE_BOOLEAN, 0, value, buffer);
 }
 
 
@@ -20,7 +20,8 @@ const char *
 entry_format_boolean_type(
 	const char * restrict name, struct sbuf * buffer
 ) {
-	return sbuf_format(buffer, "\"%s\": \"boolean\"", name);
+	json_append_key(buffer, name);
+	return sbuf_append_literal(buffer, "\"boolean\"");
 }
 
 //
@@ -29,13 +30,15 @@ const char *
 entry_format_signed_value(
 	const char * restrict name, union entry_value * value, struct sbuf * buffer
 ) {
-	return sbuf_format(buffer, "\"%s\": %" PRId64 "", name, value->as_signed);
+	json_append_key(buffer, name);
+	return entry_format_typed_value(ENTRY_TYPE_SIGNED, 0, value, buffer);
 }
 
 
 const char *
 entry_format_signed_type(const char * restrict name, struct sbuf * buffer) {
-	return sbuf_format(buffer, "\"%s\": \"integer\"", name);
+	json_append_key(buffer, name);
+	return sbuf_append_literal(buffer, "\"integer\"");
 }
 
 //
@@ -44,13 +47,15 @@ const char *
 entry_format_double_value(
 	const char * restrict name, union entry_value * value, struct sbuf * buffer
 ) {
-	return sbuf_format(buffer, "\"%s\": %f", name, value->as_double);
+	json_append_key(buffer, name);
+	return entry_format_typed_value(ENTRY_TYPE_DOUBLE, ENTRY_PRECISION_SHORTEST, value, buffer);
 }
 
 
 const char *
 entry_format_double_type(const char * restrict name, struct sbuf * buffer) {
-	return sbuf_format(buffer, "\"%s\": \"double\"", name);
+	json_append_key(buffer, name);
+	return sbuf_append_literal(buffer, "\"double\"");
 }
 
 //
@@ -59,36 +64,147 @@ const char *
 entry_format_string_value(
 	const char * restrict name, union entry_value * value, struct sbuf * buffer
 ) {
-	return sbuf_format(buffer, "\"%s\": \"%s\"", name, value->as_string);
+	json_append_key(buffer, name);
+	return entry_format_typed_value(ENTRY_TYPE_STRING, 0, value, buffer);
 }
 
 
 const char *
 entry_format_string_type(const char * restrict name, struct sbuf * buffer) {
-	return sbuf_format(buffer, "\"%s\": \"string\"", name);
+	json_append_key(buffer, name);
+	return sbuf_append_literal(buffer, "\"string\"");
 }
 
 //
 
+/** Length of a quoted datetime string "YYYY-MM-DDTHH:MM:SS.mmmZ". */
+#define DATETIME_TEXT_LENGTH 26
+
+#define SECONDS_PER_DAY (24 * 60 * 60)
+
+
+/**
+ * Caches the text of the most recently formatted datetime value. The date
+ * part is only recomputed when the day changes, the time part when the
+ * second changes, and the milliseconds are patched for every value.
+ */
+struct datetime_cache {
+	bool valid;
+	time_t day;
+	time_t second;
+	char text[DATETIME_TEXT_LENGTH];
+};
+
+
+/**
+ * The cache is thread-local, so that formatting requests in multiple
+ * threads does not require synchronization.
+ */
+static __thread struct datetime_cache datetime_cache;
+
+
+static inline void
+__put_digits2(char * dest, unsigned int value) {
+	dest[0] = (char) ('0' + value / 10);
+	dest[1] = (char) ('0' + value % 10);
+}
+
+
+/**
+ * Updates the cached text to represent the given second. Returns false
+ * if the date cannot be represented with a four-digit year.
+ */
+static bool
+__datetime_cache_update(struct datetime_cache * cache, time_t second) {
+	// Split the time into days and seconds of day, rounding towards -inf.
+	time_t day = second / SECONDS_PER_DAY;
+	time_t day_second = second % SECONDS_PER_DAY;
+	if (day_second < 0) {
+		day_second += SECONDS_PER_DAY;
+		day--;
+	}
+
+	char * text = &cache->text[0];
+	if (!cache->valid || cache->day != day) {
+		struct tm datetime;
+		if (gmtime_r(&second, &datetime) == NULL) {
+			return false;
+		}
+
+		int year = 1900 + datetime.tm_year;
+		if (year < 0 || year > 9999) {
+			return false;
+		}
+
+		text[0] = '"';
+		__put_digits2(&text[1], year / 100);
+		__put_digits2(&text[3], year % 100);
+		text[5] = '-';
+		__put_digits2(&text[6], datetime.tm_mon + 1);
+		text[8] = '-';
+		__put_digits2(&text[9], datetime.tm_mday);
+		text[11] = 'T';
+		text[14] = ':';
+		text[17] = ':';
+		text[20] = '.';
+		text[24] = 'Z';
+		text[25] = '"';
+
+		cache->day = day;
+	}
+
+	__put_digits2(&text[12], day_second / 3600);
+	__put_digits2(&text[15], (day_second / 60) % 60);
+	__put_digits2(&text[18], day_second % 60);
+
+	cache->second = second;
+	cache->valid = true;
+	return true;
+}
+
+
+const char *
+entry_format_datetime(const struct timespec * restrict ts, struct sbuf * buffer) {
+	struct datetime_cache * cache = &datetime_cache;
+	if (!cache->valid || cache->second != ts->tv_sec) {
+		if (!__datetime_cache_update(cache, ts->tv_sec)) {
+			// Uncacheable date, fall back to the general formatter.
+			cache->valid = false;
+
+			struct tm datetime;
+			gmtime_r(&ts->tv_sec, &datetime);
+			return sbuf_format(
+				buffer, "\"%04d-%02d-%02dT%02d:%02d:%02d.%03ldZ\"",
+				1900 + datetime.tm_year, datetime.tm_mon + 1, datetime.tm_mday,
+				datetime.tm_hour, datetime.tm_min, datetime.tm_sec,
+				ts->tv_nsec / 1000000
+			);
+		}
+	}
+
+	// Patch the milliseconds, the rest of the text is cached.
+	unsigned int msec = (unsigned int) (ts->tv_nsec / 1000000) % 1000;
+	char * text = &cache->text[0];
+	text[21] = (char) ('0' + msec / 100);
+	__put_digits2(&text[22], msec % 100);
+
+	return sbuf_append_bytes(buffer, text, DATETIME_TEXT_LENGTH);
+}
+
+
 const char *
 entry_format_datetime_value(
 	const char * restrict name, union entry_value * value, struct sbuf * buffer
 ) {
-	struct tm datetime;
-	gmtime_r(&value->as_timespec.tv_sec, &datetime);
-	int msec = value->as_timespec.tv_nsec / 1000000;
-
-	return sbuf_format(
-		buffer, "\"%s\": \"%04d-%02d-%02dT%02d:%02d:%02d.%03dZ\"",
-		name, 1900 + datetime.tm_year, datetime.tm_mon + 1, datetime.tm_mday,
-		datetime.tm_hour, datetime.tm_min, datetime.tm_sec, msec
-	);
+	json_append_key(buffer, name);
+	return entry_format_typed_value(ENTRY_TYPE_DATETIME, 0, value, buffer);
 }
 
 
 const char *
 entry_format_datetime_type(const char * restrict name, struct sbuf * buffer) {
-	return sbuf_format(buffer, "\"%s\": \"datetime\"", name);
+	json_append_key(buffer, name);
+	return sbuf_append_literal(buffer, "\"datetime\"");
 }
 
 //
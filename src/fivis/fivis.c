@@ -1,3 +1,4 @@
+#include <assert.h>
 #include <errno.h>
 #include <stdarg.h>
 #include <stdbool.h>
@@ -5,20 +6,36 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <pthread.h>
+
 #include <curl/curl.h>
 
 #include <fivis/debug.h>
 #include <fivis/entry.h>
 #include <fivis/fivis.h>
+#include <fivis/gzip.h>
+#include <fivis/json.h>
+#include <fivis/schema.h>
+#include <fivis/sbchain.h>
 #include <fivis/sbuf.h>
+#include <fivis/util.h>
 
 //
 
 static const char * fivis_api_path = "/api/signals";
 
+// Host used in requests sent over a Unix socket.
+
 static const long curl_verify_peer = 0;
 static const long curl_verbose = 1;
 
+// Probe idle connections, so that they are not dropped between requests.
+static const long curl_keepalive_idle_secs = 30;
+static const long curl_keepalive_interval_secs = 15;
+
+// Reuse idle connections for longer than the CURL default (118 s).
+static const long curl_connection_max_age_secs = 300;
+
 static __thread struct sbuf last_error = SBUF_INIT();
 
 //
@@ -37,7 +54,7 @@ format_schema(struct list * signals, struct sbuf * output) {
 
 		struct entry * other = first;
 		while (other->link.next != signals) {
-			sbuf_append(output, ", ");
+			sbuf_append_literal(output, ", ");
 
 			other = list_item_var(other->link.next, other, link);
 			const char * other_result = entry_format_type(other, output);
@@ -47,7 +64,12 @@ format_schema(struct list * signals, struct sbuf * output) {
 }
 
 
-static void
+/**
+ * Formats the data records by walking the signal list directly. Used by
+ * the list-based request formatter, which would otherwise have to compile
+ * a schema for every request.
+ */
+static const char *
 format_data(
 	struct entry * id_signal, struct list * signals,
 	union entry_value * (* next_value) (void *), void * next_value_state,
@@ -55,29 +77,50 @@ format_data(
 ) {
 	union entry_value * value = next_value(next_value_state);
 	while (value != NULL) {
-		sbuf_append(output, "\n{ ");
+		sbuf_append_literal(output, "\n{ ");
 
-		entry_format_value(id_signal, value, output);
+		if (entry_format_value(id_signal, value, output) == NULL) {
+			return NULL;
+		}
 
 		if (signals != NULL) {
 			struct entry * signal;
 			list_for_each_item(signal, signals, link) {
 				value = next_value(next_value_state);
 				if (value != NULL) {
-					sbuf_append(output, ", ");
+					sbuf_append_literal(output, ", ");
 
-					entry_format_value(signal, value, output);
+					if (entry_format_value(signal, value, output) == NULL) {
+						return NULL;
+					}
 				}
 			}
 		}
 
 		value = next_value(next_value_state);
 		if (value != NULL) {
-			sbuf_append(output, " },");
+			sbuf_append_literal(output, " },");
 		} else {
-			sbuf_append(output, " }\n");
+			sbuf_append_literal(output, " }\n");
 		}
 	}
+
+	return sbuf_string(output);
+}
+
+
+static void
+format_request_header(
+	const char * partner_id, const char * signal_set_id, struct sbuf * output
+) {
+	sbuf_append_literal(output, "{\n");
+
+	sbuf_append_key(output, "partnerId");
+	json_append_cstring(output, partner_id);
+
+	sbuf_append_literal(output, ",\n");
+	sbuf_append_key(output, "signalSetId");
+	json_append_cstring(output, signal_set_id);
 }
 
 
@@ -88,28 +131,194 @@ fivis_signals_format_request(
 	union entry_value * (* next_value) (void *), void * next_value_state,
 	struct sbuf * output
 ) {
-	sbuf_append(output, "{\n");
-
-	sbuf_format(output, "\"partnerId\": \"%s\"", partner_id);
-	sbuf_format(output, ",\n\"signalSetId\": \"%s\"", signal_set_id);
+	format_request_header(partner_id, signal_set_id, output);
 
 	if (schema != NULL) {
-		sbuf_append(output, ",\n\"schema\": {\n");
+		sbuf_append_literal(output, ",\n\"schema\": {\n");
 		format_schema(schema, output);
-		sbuf_append(output, "\n}");
+		sbuf_append_literal(output, "\n}");
 	}
 
-	sbuf_append(output, ",\n\"data\": [");
+	sbuf_append_literal(output, ",\n\"data\": [");
 	if (next_value != NULL) {
-		format_data(id_signal, signals, next_value, next_value_state, output);
+		if (format_data(id_signal, signals, next_value, next_value_state, output) == NULL) {
+			sbuf_set(&last_error, "failed to format request data");
+			return NULL;
+		}
+	}
+	sbuf_append_literal(output, "]");
+
+	sbuf_append_literal(output, "\n}\n");
+	return sbuf_string(output);
+}
+
+
+/**
+ * Formats the part of a request preceding the data records, i.e., the
+ * request header, the optional schema, and the start of the data array.
+ */
+static void
+__format_compiled_request_head(
+	const char * partner_id, const char * signal_set_id, bool with_schema,
+	struct schema * schema, struct sbuf * output
+) {
+	format_request_header(partner_id, signal_set_id, output);
+
+	if (with_schema) {
+		sbuf_append_literal(output, ",\n\"schema\": {\n");
+		schema_format_types(schema, output);
+		sbuf_append_literal(output, "\n}");
+	}
+
+	sbuf_append_literal(output, ",\n\"data\": [");
+}
+
+
+/** The part of a request following the data records. */
+#define REQUEST_TAIL "]\n}\n"
+
+
+const char *
+fivis_signals_format_compiled_request(
+	const char * partner_id, const char * signal_set_id, bool with_schema,
+	struct schema * schema,
+	union entry_value * (* next_value) (void *), void * next_value_state,
+	struct sbuf * output
+) {
+	assert(schema != NULL);
+
+	__format_compiled_request_head(partner_id, signal_set_id, with_schema, schema, output);
+	if (next_value != NULL && schema_format_data(schema, next_value, next_value_state, output) == NULL) {
+		sbuf_set(&last_error, "failed to format request data");
+		return NULL;
+	}
+
+	sbuf_append_literal(output, REQUEST_TAIL);
+	return sbuf_string(output);
+}
+
+
+const char *
+fivis_signals_format_batch_request(
+	const char * partner_id, const char * signal_set_id, bool with_schema,
+	struct schema * schema,
+	const struct schema_batch * batches, size_t batch_count,
+	struct sbuf * output
+) {
+	assert(schema != NULL);
+
+	__format_compiled_request_head(partner_id, signal_set_id, with_schema, schema, output);
+	if (schema_format_batches(schema, batches, batch_count, output) == NULL) {
+		sbuf_set(&last_error, "failed to format request data");
+		return NULL;
+	}
+
+	sbuf_append_literal(output, REQUEST_TAIL);
+	return sbuf_string(output);
+}
+
+
+const char *
+fivis_signals_format_batch_request_parallel(
+	const char * partner_id, const char * signal_set_id, bool with_schema,
+	struct schema * schema,
+	const struct schema_batch * batches, size_t batch_count,
+	struct workers * workers, struct sbuf * output
+) {
+	assert(schema != NULL);
+
+	__format_compiled_request_head(partner_id, signal_set_id, with_schema, schema, output);
+	if (schema_format_batches_parallel(schema, batches, batch_count, workers, output) == NULL) {
+		sbuf_set(&last_error, "failed to format request data");
+		return NULL;
 	}
-	sbuf_append(output, "]");
 
-	sbuf_append(output, "\n}\n");
+	sbuf_append_literal(output, REQUEST_TAIL);
 	return sbuf_string(output);
 }
 
 
+bool
+fivis_signals_format_compiled_request_chain(
+	const char * partner_id, const char * signal_set_id, bool with_schema,
+	struct schema * schema,
+	union entry_value * (* next_value) (void *), void * next_value_state,
+	struct sbchain * output
+) {
+	assert(schema != NULL && output != NULL);
+
+	// The head of the request is small, format it separately.
+	sbuf_t head = SBUF_INIT();
+	__format_compiled_request_head(partner_id, signal_set_id, with_schema, schema, &head);
+
+	bool head_result = sbchain_append_sbuf(output, &head);
+	sbuf_destroy(&head);
+
+	if (!head_result) {
+		sbuf_set(&last_error, "failed to format request header");
+		return false;
+	}
+
+	if (next_value != NULL) {
+		if (!schema_format_data_chain(schema, next_value, next_value_state, output)) {
+			sbuf_set(&last_error, "failed to format request data");
+			return false;
+		}
+	}
+
+	if (!sbchain_append_literal(output, REQUEST_TAIL)) {
+		sbuf_set(&last_error, "failed to format request");
+		return false;
+	}
+
+	return true;
+}
+
+
+size_t
+fivis_signals_estimate_request_size(
+	const char * partner_id, const char * signal_set_id, bool with_schema,
+	struct schema * schema, size_t record_count
+) {
+	assert(partner_id != NULL && signal_set_id != NULL && schema != NULL);
+
+	// Fixed parts of the request plus identifiers escaped in the worst case.
+	static const size_t request_fixed_size = 128;
+	static const size_t escape_factor = 6;
+
+	size_t result = request_fixed_size;
+	result += escape_factor * (strlen(partner_id) + strlen(signal_set_id));
+
+	if (with_schema) {
+		result += sbuf_length(&schema->types);
+	}
+
+	return result + schema_estimate_data_size(schema, record_count);
+}
+
+
+size_t
+fivis_signals_estimate_request_records(
+	const char * partner_id, const char * signal_set_id, bool with_schema,
+	struct schema * schema, size_t size_max
+) {
+	// The estimate grows linearly with the number of records.
+	size_t empty_size = fivis_signals_estimate_request_size(
+		partner_id, signal_set_id, with_schema, schema, 0
+	);
+
+	size_t record_size = fivis_signals_estimate_request_size(
+		partner_id, signal_set_id, with_schema, schema, 1
+	) - empty_size;
+
+	if (size_max <= empty_size || record_size == 0) {
+		return 0;
+	}
+
+	return (size_max - empty_size) / record_size;
+}
+
+
 /**
  * Checks the given CURLcode for error. Returns false if there was no error,
  * otherwise returns true and sets the last cause to the CURL error and the
@@ -176,11 +385,12 @@ __slist_append(struct curl_slist ** list_ptr, const char * str) {
 
 
 /**
- * Prepares a list of HTTP headers. Returns a pointer to the list of
- * headers or success, NULL in case of failure.
+ * Prepares a list of HTTP headers, optionally announcing gzip-compressed
+ * content. Returns a pointer to the list of headers or success, NULL in
+ * case of failure.
  */
 static struct curl_slist *
-__prepare_http_headers(const char * restrict api_token) {
+__prepare_http_headers(const char * restrict api_token, bool compressed) {
 	struct curl_slist * result = NULL;
 
 	// Send data without having to know the size.
@@ -192,6 +402,15 @@ __prepare_http_headers(const char * restrict api_token) {
 		goto fail_slist;
 	}
 
+	// Avoid the extra round trip of 'Expect: 100-continue' with large bodies.
+	if (!__slist_append(&result, "Expect:")) {
+		goto fail_slist;
+	}
+
+	if (compressed && !__slist_append(&result, "Content-Encoding: gzip")) {
+		goto fail_slist;
+	}
+
 	// Add access token. The string is copied, so we release it afterwards.
 	char * token_header = format_string("access-token: %s", api_token);
 	if (token_header == NULL) {
@@ -253,8 +472,50 @@ fail_url:
 }
 
 
+/**
+ * Captures the response body into the response buffer. Keeps at most
+ * FIVIS_RESPONSE_SIZE_MAX bytes, the rest is dropped.
+ */
+static size_t
+__response_write_callback(char * data, size_t size, size_t count, void * arg) {
+	struct fivis_response * response = (struct fivis_response * ) arg;
+
+	size_t length = size * count;
+	size_t avail = FIVIS_RESPONSE_SIZE_MAX - sbuf_length(&response->body);
+	if (avail > 0) {
+		sbuf_append_bytes(&response->body, data, (length < avail) ? length : avail);
+	}
+
+	// Report all data as consumed, otherwise the transfer fails.
+	return length;
+}
+
+
+/** Clears the response before a new request. */
+static void
+__response_reset(struct fivis_response * response) {
+	sbuf_clear(&response->body);
+	response->code = 0;
+	response->retry_after_secs = 0;
+}
+
+
+/** Records the response code and the Retry-After delay of a transfer. */
+static void
+__response_complete(struct fivis_response * response, CURL * curl) {
+	curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response->code);
+
+	curl_off_t retry_after = 0;
+	curl_easy_getinfo(curl, CURLINFO_RETRY_AFTER, &retry_after);
+	response->retry_after_secs = (long) retry_after;
+}
+
+
 bool
-__curl_init(CURL * curl, CURL * url, struct curl_slist * headers, char * curl_error) {
+__curl_init(
+	CURL * curl, CURL * url, struct curl_slist * headers,
+	struct fivis_response * response, char * curl_error
+) {
 	CURLcode curl_result = curl_easy_setopt(curl, CURLOPT_CURLU, url);
 	if (__is_curl_error(curl_result, "", "failed to set host URL")) {
 		return false;
@@ -276,6 +537,30 @@ __curl_init(CURL * curl, CURL * url, struct curl_slist * headers, char * curl_er
 		return false;
 	}
 
+	//
+	// Keep the connection alive between requests. TLS sessions are cached
+	// by the easy handle by default; a pool shares them between contexts.
+	//
+	curl_result = curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+	if (__is_curl_error(curl_result, curl_error, "failed to enable TCP keep-alive")) {
+		return false;
+	}
+
+	curl_result = curl_easy_setopt(curl, CURLOPT_TCP_KEEPIDLE, curl_keepalive_idle_secs);
+	if (__is_curl_error(curl_result, curl_error, "failed to set TCP keep-alive idle time")) {
+		return false;
+	}
+
+	curl_result = curl_easy_setopt(curl, CURLOPT_TCP_KEEPINTVL, curl_keepalive_interval_secs);
+	if (__is_curl_error(curl_result, curl_error, "failed to set TCP keep-alive interval")) {
+		return false;
+	}
+
+	curl_result = curl_easy_setopt(curl, CURLOPT_MAXAGE_CONN, curl_connection_max_age_secs);
+	if (__is_curl_error(curl_result, curl_error, "failed to set connection maximum age")) {
+		return false;
+	}
+
 	curl_result = curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, curl_verify_peer);
 	if (__is_curl_error(curl_result, curl_error, "failed to disable SSL peer verification")) {
 		return false;
@@ -286,9 +571,23 @@ __curl_init(CURL * curl, CURL * url, struct curl_slist * headers, char * curl_er
 		return false;
 	}
 
-	// Return failure for HTTP 4xx response codes.
-	curl_result = curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
-	if (__is_curl_error(curl_result, curl_error, "failed to enable fail on error")) {
+	//
+	// Capture the response body instead of letting CURL print it. HTTP
+	// error responses are received normally (without fail-on-error), so
+	// that their body and headers are available for the error handling.
+	//
+	curl_result = curl_easy_setopt(curl, CURLOPT_FAILONERROR, 0L);
+	if (__is_curl_error(curl_result, curl_error, "failed to disable fail on error")) {
+		return false;
+	}
+
+	curl_result = curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, __response_write_callback);
+	if (__is_curl_error(curl_result, curl_error, "failed to set write callback")) {
+		return false;
+	}
+
+	curl_result = curl_easy_setopt(curl, CURLOPT_WRITEDATA, response);
+	if (__is_curl_error(curl_result, curl_error, "failed to set write callback data")) {
 		return false;
 	}
 
@@ -301,137 +600,1801 @@ __curl_init(CURL * curl, CURL * url, struct curl_slist * headers, char * curl_er
 }
 
 
-fivis_result_t
-fivis_signals_perform_request(
-	struct fivis * fivis, const char * data, size_t size
+/**
+ * Translates the result of a completed CURL transfer (and the HTTP
+ * response) to a FIVIS result.
+ */
+static fivis_result_t
+__request_result(
+	CURLcode curl_result, const struct fivis_response * response,
+	const char * curl_error
 ) {
-	assert (fivis != NULL && data != NULL);
-
-	const char * curl_error = &fivis->curl_error[0];
-
-	CURLcode curl_result = curl_easy_setopt(fivis->curl, CURLOPT_POSTFIELDS, data);
-	if (__is_curl_error(curl_result, curl_error, "failed to set POST data")) {
-		return FIVIS_ERR_REQUEST;
-	}
-
-	if (size > 0) {
-		curl_result = curl_easy_setopt(fivis->curl, CURLOPT_POSTFIELDSIZE, size);
-		if (__is_curl_error(curl_result, curl_error, "failed to set POST size")) {
-			return FIVIS_ERR_REQUEST;
-		}
-	}
-
-	curl_result = curl_easy_perform(fivis->curl);
-
-	long response_code;
-	curl_easy_getinfo(fivis->curl, CURLINFO_RESPONSE_CODE, &response_code);
-
-	printf("\ncurl_easy_perform: %d, response: %ld, err: %s, code: %s\n", curl_result, response_code, fivis->curl_error, curl_easy_strerror(curl_result));
 	if (__is_curl_error(curl_result, curl_error, "CURL request failed")) {
 		switch (curl_result) {
 		case CURLE_COULDNT_RESOLVE_PROXY:
 		case CURLE_COULDNT_RESOLVE_HOST:
 		case CURLE_COULDNT_CONNECT:
+		case CURLE_SEND_ERROR:
+		case CURLE_RECV_ERROR:
+		case CURLE_GOT_NOTHING:
 			return FIVIS_ERR_NETWORK;
 
+		case CURLE_OPERATION_TIMEDOUT:
+			return FIVIS_ERR_TIMEOUT;
+
 		case CURLE_HTTP_RETURNED_ERROR:
 			return FIVIS_ERR_SERVER;
 
 		default:
 			return FIVIS_ERR_GENERAL;
 		}
-	} else if (response_code >= 300 && response_code < 400) {
-		sbuf_set_format(&last_error, "invalid endpoint URL (received HTTP redirect %d)", response_code);
+	}
+
+	long code = response->code;
+	if (code >= 300 && code < 400) {
+		sbuf_set_format(&last_error, "invalid endpoint URL (received HTTP redirect %ld)", code);
 		return FIVIS_ERR_LOCATION;
+
+	} else if (code == 429 || code == 503) {
+		sbuf_set_format(
+			&last_error, "server asked to retry later (HTTP %ld, retry after %ld s)",
+			code, response->retry_after_secs
+		);
+		return FIVIS_ERR_RETRY_LATER;
+
+	} else if (code == 413) {
+		sbuf_set(&last_error, "request too large (HTTP 413)");
+		return FIVIS_ERR_TOO_LARGE;
+
+	} else if (code >= 400 && code < 500) {
+		sbuf_set_format(&last_error, "server rejected request (HTTP %ld)", code);
+		return FIVIS_ERR_CLIENT;
+
+	} else if (code >= 500) {
+		sbuf_set_format(&last_error, "server failed to process request (HTTP %ld)", code);
+		return FIVIS_ERR_SERVER;
 	}
 
 	return FIVIS_OK;
 }
 
 
+/** Returns the number of connections established by the last transfer. */
+static inline long
+__curl_num_connects(CURL * curl) {
+	long result = 0;
+	curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &result);
+	return (result > 0) ? result : 0;
+}
+
+
 /**
- * Initializes a fivis structure using the given attribute values.
- * Returns the structure as a value.
+ * Updates the connection statistics of the given context after a request.
+ * A request which established no connection reused one only if it
+ * succeeded, because a failed request may not have connected at all.
  */
-static inline struct fivis *
-__fivis_init(
-	struct fivis * fivis, CURL * curl, CURLU * api_url,
-	struct curl_slist * http_headers
-) {
-	*fivis = (struct fivis) {
-		.curl = curl,
-		.api_url = api_url,
-		.http_headers = http_headers,
-	};
+static void
+__update_connection_stats(struct fivis * fivis, CURLcode curl_result) {
+	struct fivis_connection_stats * stats = &fivis->connection_stats;
+	stats->requests++;
+
+	long connects = __curl_num_connects(fivis->curl);
+	if (connects > 0) {
+		stats->new_connections += connects;
+	} else if (curl_result == CURLE_OK) {
+		stats->reused_connections++;
+	}
+}
 
-	return fivis;
+
+/** Returns the given CURL transfer time (in microseconds), zero if not available. */
+static inline uint64_t
+__curl_time_us(CURL * curl, CURLINFO info) {
+	curl_off_t result = 0;
+	curl_easy_getinfo(curl, info, &result);
+	return (result > 0) ? (uint64_t) result : 0;
 }
 
 
-struct fivis *
-fivis_init(const char * restrict api_host, const char * restrict api_token) {
-	assert(api_host != NULL && api_token != NULL);
+/**
+ * Records the times of the phases of the last transfer in the request
+ * histograms of the given context. The times reported by CURL are the
+ * times elapsed since the start of the transfer until the end of each
+ * phase, which are converted to the durations of the phases.
+ */
+static void
+__record_transfer_times(struct fivis * fivis) {
+	struct fivis_request_histograms * histograms = &fivis->histograms;
 
-	CURL * curl = curl_easy_init();
-	if (curl == NULL) {
-		sbuf_set(&last_error, "failed to create CURL session");
-		goto fail_curl;
-	}
+	uint64_t namelookup_us = __curl_time_us(fivis->curl, CURLINFO_NAMELOOKUP_TIME_T);
+	uint64_t connect_us = __curl_time_us(fivis->curl, CURLINFO_CONNECT_TIME_T);
+	uint64_t appconnect_us = __curl_time_us(fivis->curl, CURLINFO_APPCONNECT_TIME_T);
+	uint64_t pretransfer_us = __curl_time_us(fivis->curl, CURLINFO_PRETRANSFER_TIME_T);
+	uint64_t starttransfer_us = __curl_time_us(fivis->curl, CURLINFO_STARTTRANSFER_TIME_T);
+	uint64_t total_us = __curl_time_us(fivis->curl, CURLINFO_TOTAL_TIME_T);
 
-	struct fivis * fivis = (struct fivis *) malloc(sizeof(struct fivis));
-	if (fivis == NULL) {
-		sbuf_set(&last_error, "failed to allocate FIVIS context");
-		goto fail_fivis;
-	}
+	if (__curl_num_connects(fivis->curl) > 0) {
+		histogram_record(&histograms->namelookup_us, namelookup_us);
 
-	CURLU * api_url = __curl_init_url(api_host, fivis_api_path);
-	if (api_url == NULL) {
-		sbuf_set(&last_error, "failed to initialize URL");
-		goto fail_api_url;
-	}
+		if (connect_us >= namelookup_us) {
+			histogram_record(&histograms->connect_us, connect_us - namelookup_us);
+		}
 
-	struct curl_slist * http_headers = __prepare_http_headers(api_token);
-	if (http_headers == NULL) {
-		sbuf_set(&last_error, "failed to prepare HTTP headers");
-		goto fail_http_headers;
+		if (appconnect_us >= connect_us && appconnect_us > 0) {
+			histogram_record(&histograms->tls_us, appconnect_us - connect_us);
+		}
 	}
 
-	if (!__curl_init(curl, api_url, http_headers, &fivis->curl_error[0])) {
-		sbuf_set(&last_error, "failed to configure CURL session");
-		goto fail_curl_init;
+	if (starttransfer_us >= pretransfer_us && starttransfer_us > 0) {
+		histogram_record(&histograms->first_byte_us, starttransfer_us - pretransfer_us);
 	}
 
-	//
+	histogram_record(&histograms->total_us, total_us);
 
-	return __fivis_init(fivis, curl, api_url, http_headers);
+	curl_off_t upload_speed = 0;
+	curl_easy_getinfo(fivis->curl, CURLINFO_SPEED_UPLOAD_T, &upload_speed);
+	histogram_record(&histograms->upload_speed, (upload_speed > 0) ? (uint64_t) upload_speed : 0);
+}
 
-	//
 
-fail_curl_init:
-	curl_slist_free_all(http_headers);
-fail_http_headers:
-	curl_url_cleanup(api_url);
-fail_api_url:
-	free(fivis);
-fail_fivis:
-	curl_easy_cleanup(curl);
-fail_curl:
-	return NULL;
+/** Records the sizes of the last request in the request histograms. */
+static void
+__record_request_sizes(struct fivis * fivis) {
+	histogram_record(&fivis->histograms.body_bytes, fivis->last_stats.body_size);
+	histogram_record(&fivis->histograms.sent_bytes, fivis->last_stats.sent_size);
 }
 
 
-void
-fivis_cleanup(struct fivis * fivis) {
-	assert(fivis != NULL);
+/**
+ * Performs the request prepared in the CURL session of the given context
+ * and translates the result.
+ */
+static fivis_result_t
+__perform_request(struct fivis * fivis) {
+	CURLcode curl_result = curl_easy_perform(fivis->curl);
+	__update_connection_stats(fivis, curl_result);
+	__record_transfer_times(fivis);
+	__response_complete(&fivis->response, fivis->curl);
+
+	return __request_result(curl_result, &fivis->response, &fivis->curl_error[0]);
+}
 
-	curl_slist_free_all(fivis->http_headers);
-	fivis->http_headers = NULL;
 
-	curl_url_cleanup(fivis->api_url);
-	fivis->api_url = NULL;
+/** Represents the source of a request body pulled by a transport. */
+struct request_body {
+	/** Function providing the body data. */
+	gzip_source_t read;
+	void * read_arg;
 
-	curl_easy_cleanup(fivis->curl);
-	fivis->curl = NULL;
+	/**
+	 * Function restarting the source from the beginning, or NULL if the
+	 * source cannot be restarted. Returns false on failure.
+	 */
+	bool (* rewind) (void * arg);
 
-	free(fivis);
+	/** Size of the body, or -1 if not known in advance. */
+	curl_off_t size;
+
+	/** Number of bytes read from the source. */
+	size_t read_bytes;
+
+	/** Compression stream wrapping the source, or NULL. */
+	struct gzip_stream * gzip;
+
+	/** Set when the source or the compression failed. */
+	bool failed;
+};
+
+
+/** Reads the body data from the source, counting the bytes read. */
+static size_t
+__body_source_read(char * buffer, size_t size, void * arg) {
+	struct request_body * body = (struct request_body *) arg;
+
+	size_t result = body->read(buffer, size, body->read_arg);
+	if (result != GZIP_READ_ERROR) {
+		body->read_bytes += result;
+	}
+
+	return result;
+}
+
+
+/**
+ * Restarts the request body from the beginning, including the compression
+ * stream. Returns false if the body cannot be restarted.
+ */
+static bool
+__body_rewind(struct request_body * body) {
+	if (body->rewind == NULL || !body->rewind(body->read_arg)) {
+		return false;
+	}
+
+	if (body->gzip != NULL && !gzip_stream_reset(body->gzip, __body_source_read, body)) {
+		return false;
+	}
+
+	body->read_bytes = 0;
+	body->failed = false;
+	return true;
+}
+
+
+/**
+ * Reads the request body, compressed if requested. Returns the number of
+ * bytes read, zero at the end of the body, or GZIP_READ_ERROR on failure.
+ */
+static size_t
+__body_read(struct request_body * body, char * buffer, size_t size) {
+	size_t result = (body->gzip != NULL)
+		? gzip_stream_read(body->gzip, buffer, size)
+		: __body_source_read(buffer, size, body);
+
+	if (result == GZIP_READ_ERROR) {
+		body->failed = true;
+	}
+
+	return result;
+}
+
+//
+
+/**
+ * Represents a transport delivering requests. Transports which cannot send
+ * compressed bodies are always given uncompressed bodies.
+ */
+struct fivis_transport {
+	const char * name;
+
+	/** Set if the transport sends requests over a connection. */
+	bool connects;
+
+	/** Set if the transport can send compressed request bodies. */
+	bool compresses;
+
+	/**
+	 * Sends a request with an uncompressed body stored in a contiguous
+	 * buffer. Optional, the buffer is read as a request body if missing.
+	 */
+	fivis_result_t (* send_buffer) (struct fivis * fivis, const char * data, size_t size);
+
+	/** Sends a request with the body read using __body_read(). */
+	fivis_result_t (* send_body) (
+		struct fivis * fivis, struct request_body * body, bool compressed
+	);
+};
+
+
+/** Provides request body data to CURL. */
+static size_t
+__http_read_callback(char * buffer, size_t size, size_t count, void * arg) {
+	struct request_body * body = (struct request_body *) arg;
+
+	size_t result = __body_read(body, buffer, size * count);
+	return (result != GZIP_READ_ERROR) ? result : CURL_READFUNC_ABORT;
+}
+
+
+/**
+ * Restarts the request body when CURL needs to send it again, e.g., when
+ * a reused connection was closed by the server. CURL only ever seeks to
+ * the start of the body.
+ */
+static int
+__http_seek_callback(void * arg, curl_off_t offset, int origin) {
+	struct request_body * body = (struct request_body *) arg;
+
+	if (offset != 0 || origin != SEEK_SET || body->rewind == NULL) {
+		return CURL_SEEKFUNC_CANTSEEK;
+	}
+
+	return __body_rewind(body) ? CURL_SEEKFUNC_OK : CURL_SEEKFUNC_FAIL;
+}
+
+
+/**
+ * Sends a request with the body pulled by CURL. Compressed bodies are sent
+ * in chunks, because the compressed size is not known in advance.
+ */
+static fivis_result_t
+__http_send_body(struct fivis * fivis, struct request_body * body, bool compressed) {
+	const char * curl_error = &fivis->curl_error[0];
+
+	//
+	// Let CURL pull the data using a read callback. The POST data pointer
+	// must be cleared, otherwise it takes precedence over the callback.
+	//
+	CURLcode curl_result = curl_easy_setopt(fivis->curl, CURLOPT_POSTFIELDS, NULL);
+	if (__is_curl_error(curl_result, curl_error, "failed to clear POST data")) {
+		return FIVIS_ERR_REQUEST;
+	}
+
+	curl_result = curl_easy_setopt(fivis->curl, CURLOPT_READFUNCTION, __http_read_callback);
+	if (__is_curl_error(curl_result, curl_error, "failed to set read callback")) {
+		return FIVIS_ERR_REQUEST;
+	}
+
+	curl_result = curl_easy_setopt(fivis->curl, CURLOPT_READDATA, body);
+	if (__is_curl_error(curl_result, curl_error, "failed to set read callback data")) {
+		return FIVIS_ERR_REQUEST;
+	}
+
+	curl_result = curl_easy_setopt(fivis->curl, CURLOPT_SEEKFUNCTION, __http_seek_callback);
+	if (__is_curl_error(curl_result, curl_error, "failed to set seek callback")) {
+		return FIVIS_ERR_REQUEST;
+	}
+
+	curl_result = curl_easy_setopt(fivis->curl, CURLOPT_SEEKDATA, body);
+	if (__is_curl_error(curl_result, curl_error, "failed to set seek callback data")) {
+		return FIVIS_ERR_REQUEST;
+	}
+
+	curl_result = curl_easy_setopt(
+		fivis->curl, CURLOPT_HTTPHEADER,
+		compressed ? fivis->http_headers_gzip : fivis->http_headers
+	);
+
+	if (__is_curl_error(curl_result, curl_error, "failed to set custom HTTP header")) {
+		return FIVIS_ERR_REQUEST;
+	}
+
+	curl_result = curl_easy_setopt(
+		fivis->curl, CURLOPT_POSTFIELDSIZE_LARGE,
+		compressed ? (curl_off_t) -1 : body->size
+	);
+
+	if (__is_curl_error(curl_result, curl_error, "failed to set POST size")) {
+		return FIVIS_ERR_REQUEST;
+	}
+
+	return __perform_request(fivis);
+}
+
+
+/** Sends a request with the body passed to CURL directly. */
+static fivis_result_t
+__http_send_buffer(struct fivis * fivis, const char * data, size_t size) {
+	const char * curl_error = &fivis->curl_error[0];
+
+	CURLcode curl_result = curl_easy_setopt(fivis->curl, CURLOPT_HTTPHEADER, fivis->http_headers);
+	if (__is_curl_error(curl_result, curl_error, "failed to set custom HTTP header")) {
+		return FIVIS_ERR_REQUEST;
+	}
+
+	curl_result = curl_easy_setopt(fivis->curl, CURLOPT_POSTFIELDS, data);
+	if (__is_curl_error(curl_result, curl_error, "failed to set POST data")) {
+		return FIVIS_ERR_REQUEST;
+	}
+
+	curl_result = curl_easy_setopt(fivis->curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t) size);
+	if (__is_curl_error(curl_result, curl_error, "failed to set POST size")) {
+		return FIVIS_ERR_REQUEST;
+	}
+
+	return __perform_request(fivis);
+}
+
+
+static const struct fivis_transport http_transport = {
+	.name = "http",
+	.connects = true,
+	.compresses = true,
+	.send_buffer = __http_send_buffer,
+	.send_body = __http_send_body,
+};
+
+
+/** Reads and discards the request body. */
+static fivis_result_t
+__null_send_body(struct fivis * fivis, struct request_body * body, bool compressed) {
+	(void) fivis;
+	(void) compressed;
+
+	char buffer[GZIP_INPUT_SIZE];
+
+	size_t length;
+	do {
+		length = __body_read(body, buffer, sizeof(buffer));
+	} while (length != 0 && length != GZIP_READ_ERROR);
+
+	return FIVIS_OK;
+}
+
+
+static fivis_result_t
+__null_send_buffer(struct fivis * fivis, const char * data, size_t size) {
+	(void) fivis;
+	(void) data;
+	(void) size;
+
+	return FIVIS_OK;
+}
+
+
+static const struct fivis_transport null_transport = {
+	.name = "null",
+	.connects = false,
+	.compresses = true,
+	.send_buffer = __null_send_buffer,
+	.send_body = __null_send_body,
+};
+
+
+/**
+ * Writes the request body to the output file as a single line. The line
+ * breaks in a request are only whitespace between JSON tokens, so they are
+ * dropped, which turns the output into newline-delimited JSON. The line is
+ * assembled in a buffer and written at once, so that a request which fails
+ * to produce its body leaves no record in the output, which may be a pipe.
+ */
+static fivis_result_t
+__file_send_body(struct fivis * fivis, struct request_body * body, bool compressed) {
+	(void) compressed;
+
+	char buffer[GZIP_INPUT_SIZE];
+
+	struct sbuf * line = &fivis->output_line;
+	sbuf_clear(line);
+
+	while (true) {
+		size_t length = __body_read(body, buffer, sizeof(buffer));
+		if (length == 0) {
+			break;
+		} else if (length == GZIP_READ_ERROR) {
+			// The error message is set by the caller.
+			return FIVIS_ERR_REQUEST;
+		}
+
+		const char * begin = buffer;
+		const char * end = buffer + length;
+		while (begin < end) {
+			const char * newline = memchr(begin, '\n', end - begin);
+			const char * stop = (newline != NULL) ? newline : end;
+
+			if (sbuf_append_bytes(line, begin, stop - begin) == NULL) {
+				goto fail_line;
+			}
+
+			begin = (newline != NULL) ? newline + 1 : end;
+		}
+	}
+
+	if (sbuf_append_char(line, '\n') == NULL) {
+		goto fail_line;
+	}
+
+	size_t length = sbuf_length(line);
+	if (fwrite(sbuf_string(line), 1, length, fivis->output) != length || fflush(fivis->output) != 0) {
+		sbuf_set_format(&last_error, "failed to write request to file: %s", strerror(errno));
+		return FIVIS_ERR_GENERAL;
+	}
+
+	return FIVIS_OK;
+
+	//
+
+fail_line:
+	sbuf_set(&last_error, "failed to allocate request line");
+	return FIVIS_ERR_GENERAL;
+}
+
+
+static const struct fivis_transport file_transport = {
+	.name = "file",
+	.connects = false,
+	.compresses = false,
+	.send_buffer = NULL,
+	.send_body = __file_send_body,
+};
+
+//
+
+/**
+ * Prepares the compression stream of the given context to compress the
+ * given request body. The stream is created on first use and only reset
+ * for subsequent requests. Returns false on failure.
+ */
+static bool
+__gzip_stream_prepare(struct fivis * fivis, struct request_body * body) {
+	if (fivis->gzip != NULL) {
+		if (!gzip_stream_reset(fivis->gzip, __body_source_read, body)) {
+			sbuf_set(&last_error, "failed to reset compression stream");
+			return false;
+		}
+
+		return true;
+	}
+
+	struct gzip_stream * gzip = (struct gzip_stream *) malloc(sizeof(struct gzip_stream));
+	if (gzip == NULL) {
+		sbuf_set(&last_error, "failed to allocate compression stream");
+		return false;
+	}
+
+	if (!gzip_stream_init(gzip, fivis->compression_level, __body_source_read, body)) {
+		sbuf_set(&last_error, "failed to initialize compression stream");
+		free(gzip);
+		return false;
+	}
+
+	fivis->gzip = gzip;
+	return true;
+}
+
+
+/** Releases the compression stream of the given context, if any. */
+static void
+__gzip_stream_release(struct fivis * fivis) {
+	if (fivis->gzip != NULL) {
+		gzip_stream_destroy(fivis->gzip);
+		free(fivis->gzip);
+		fivis->gzip = NULL;
+	}
+}
+
+
+/**
+ * Performs a request with the body pulled from the given source using the
+ * transport of the given context. The body is compressed while being sent
+ * if compression is enabled and supported by the transport.
+ */
+static fivis_result_t
+__perform_body_request(struct fivis * fivis, struct request_body * body) {
+	__response_reset(&fivis->response);
+
+	bool compress = fivis->compression_level > 0 && fivis->transport->compresses;
+	if (compress) {
+		if (!__gzip_stream_prepare(fivis, body)) {
+			return FIVIS_ERR_REQUEST;
+		}
+
+		body->gzip = fivis->gzip;
+	}
+
+	fivis_result_t result = fivis->transport->send_body(fivis, body, compress);
+	if (body->failed) {
+		sbuf_set(&last_error, "failed to produce request data");
+		result = FIVIS_ERR_REQUEST;
+	}
+
+	fivis->last_stats = (struct fivis_request_stats) {
+		.body_size = body->read_bytes,
+		.sent_size = compress ? body->gzip->output_bytes : body->read_bytes,
+		.compress_ns = compress ? body->gzip->compress_ns : 0,
+	};
+
+	__record_request_sizes(fivis);
+	return result;
+}
+
+
+/** Represents a position in a request stored in a contiguous buffer. */
+struct buffer_reader {
+	const char * data;
+	size_t size;
+	size_t offset;
+};
+
+
+/** Provides request data from a contiguous buffer. */
+static size_t
+__buffer_read(char * buffer, size_t size, void * arg) {
+	struct buffer_reader * reader = (struct buffer_reader *) arg;
+
+	size_t avail = reader->size - reader->offset;
+	size_t result = (size < avail) ? size : avail;
+	memcpy(buffer, reader->data + reader->offset, result);
+
+	reader->offset += result;
+	return result;
+}
+
+
+/** Restarts reading a contiguous buffer from the beginning. */
+static bool
+__buffer_rewind(void * arg) {
+	struct buffer_reader * reader = (struct buffer_reader *) arg;
+	reader->offset = 0;
+	return true;
+}
+
+
+fivis_result_t
+fivis_signals_perform_request(
+	struct fivis * fivis, const char * data, size_t size
+) {
+	assert (fivis != NULL && data != NULL);
+
+	const struct fivis_transport * transport = fivis->transport;
+	size_t length = (size > 0) ? size : strlen(data);
+
+	__response_reset(&fivis->response);
+
+	//
+	// Pass the buffer to the transport directly if possible, otherwise
+	// let the transport pull the data from the buffer, e.g., through the
+	// compressor.
+	//
+	bool compress = fivis->compression_level > 0 && transport->compresses;
+	if (compress || transport->send_buffer == NULL) {
+		struct buffer_reader reader = {
+			.data = data,
+			.size = length,
+			.offset = 0,
+		};
+
+		struct request_body body = {
+			.read = __buffer_read,
+			.rewind = __buffer_rewind,
+			.read_arg = &reader,
+			.size = length,
+		};
+
+		return __perform_body_request(fivis, &body);
+	}
+
+	fivis->last_stats = (struct fivis_request_stats) {
+		.body_size = length,
+		.sent_size = length,
+		.compress_ns = 0,
+	};
+
+	__record_request_sizes(fivis);
+	return transport->send_buffer(fivis, data, length);
+}
+
+
+/** Represents a position in a request stored in a segmented buffer. */
+struct chain_reader {
+	const struct sbchain * chain;
+	struct sbchain_reader position;
+};
+
+
+/** Provides request data from a segmented buffer. */
+static size_t
+__chain_read(char * buffer, size_t size, void * arg) {
+	struct chain_reader * reader = (struct chain_reader *) arg;
+	return sbchain_read(&reader->position, buffer, size);
+}
+
+
+/** Restarts reading a segmented buffer from the beginning. */
+static bool
+__chain_rewind(void * arg) {
+	struct chain_reader * reader = (struct chain_reader *) arg;
+	sbchain_reader_init(&reader->position, reader->chain);
+	return true;
+}
+
+
+fivis_result_t
+fivis_signals_perform_chain_request(
+	struct fivis * fivis, const struct sbchain * data
+) {
+	assert (fivis != NULL && data != NULL);
+
+	// Let CURL pull the data from the segments one after another.
+	struct chain_reader reader = { .chain = data };
+	sbchain_reader_init(&reader.position, data);
+
+	struct request_body body = {
+		.read = __chain_read,
+		.rewind = __chain_rewind,
+		.read_arg = &reader,
+		.size = (curl_off_t) sbchain_length(data),
+	};
+
+	return __perform_body_request(fivis, &body);
+}
+
+
+/** State of a request body generated while sending the request. */
+struct request_stream {
+	struct schema * schema;
+	union entry_value * (* next_value) (void *);
+	void * next_value_state;
+
+	/** Formatted data not yet passed to CURL. */
+	struct sbuf staging;
+
+	/** Offset of the first byte in the staging buffer not passed to CURL. */
+	size_t staging_offset;
+
+	/** Number of records formatted so far. */
+	size_t record_count;
+
+	/** Set when the whole request has been formatted. */
+	bool done;
+};
+
+
+/**
+ * Formats more of the request into the (empty) staging buffer. Formats
+ * records until the staging buffer holds at least the given number of
+ * bytes or until there are no more records, in which case the request
+ * is completed. Returns false on failure.
+ */
+static bool
+__request_stream_refill(struct request_stream * stream, size_t size) {
+	struct sbuf * staging = &stream->staging;
+
+	while (sbuf_length(staging) < size) {
+		union entry_value * value = stream->next_value(stream->next_value_state);
+		if (value == NULL) {
+			stream->done = true;
+			return schema_format_records_end(stream->record_count, staging) != NULL
+				&& sbuf_append_literal(staging, REQUEST_TAIL) != NULL;
+		}
+
+		const char * result = schema_format_record(
+			stream->schema, value, stream->next_value, stream->next_value_state,
+			stream->record_count == 0, staging
+		);
+
+		if (result == NULL) {
+			return false;
+		}
+
+		stream->record_count++;
+	}
+
+	return true;
+}
+
+
+/**
+ * Provides request data formatted on demand. Copies the formatted data
+ * which was not passed on yet, and formats more data when needed.
+ */
+static size_t
+__stream_read(char * buffer, size_t size, void * arg) {
+	struct request_stream * stream = (struct request_stream *) arg;
+	struct sbuf * staging = &stream->staging;
+
+	size_t result = 0;
+	while (result < size) {
+		size_t avail = sbuf_length(staging) - stream->staging_offset;
+		if (avail > 0) {
+			size_t length = (avail < size - result) ? avail : size - result;
+			memcpy(buffer + result, sbuf_string(staging) + stream->staging_offset, length);
+
+			stream->staging_offset += length;
+			result += length;
+			continue;
+		}
+
+		if (stream->done) {
+			break;
+		}
+
+		// Format at least as much as fits into the rest of the buffer.
+		sbuf_clear(staging);
+		stream->staging_offset = 0;
+
+		if (!__request_stream_refill(stream, size - result)) {
+			return GZIP_READ_ERROR;
+		}
+	}
+
+	return result;
+}
+
+
+fivis_result_t
+fivis_signals_perform_streaming_request(
+	struct fivis * fivis,
+	const char * partner_id, const char * signal_set_id, bool with_schema,
+	struct schema * schema,
+	union entry_value * (* next_value) (void *), void * next_value_state
+) {
+	assert(fivis != NULL && schema != NULL && next_value != NULL);
+
+	struct request_stream stream = {
+		.schema = schema,
+		.next_value = next_value,
+		.next_value_state = next_value_state,
+		.staging = SBUF_INIT(),
+		.staging_offset = 0,
+		.record_count = 0,
+		.done = false,
+	};
+
+	// The head of the request is formatted up front.
+	__format_compiled_request_head(partner_id, signal_set_id, with_schema, schema, &stream.staging);
+
+	//
+	// The size of the request is unknown, so it is sent in chunks. The
+	// formatted data are not kept, so the body cannot be sent again.
+	//
+	struct request_body body = {
+		.read = __stream_read,
+		.rewind = NULL,
+		.read_arg = &stream,
+		.size = -1,
+	};
+
+	fivis_result_t result = __perform_body_request(fivis, &body);
+	fivis_record_request_records(fivis, stream.record_count);
+
+	sbuf_destroy(&stream.staging);
+	return result;
+}
+
+
+/**
+ * Initializes a fivis structure using the given attribute values.
+ * Returns the structure as a value.
+ */
+static inline struct fivis *
+__fivis_init(
+	struct fivis * fivis, CURL * curl, CURLU * api_url,
+	struct curl_slist * http_headers, struct curl_slist * http_headers_gzip
+) {
+	*fivis = (struct fivis) {
+		.curl = curl,
+		.api_url = api_url,
+		.http_headers = http_headers,
+		.http_headers_gzip = http_headers_gzip,
+		.compression_level = 0,
+		.gzip = NULL,
+		.connection_stats = { 0 },
+		.transport = &http_transport,
+		.output = NULL,
+		.output_line = SBUF_INIT(),
+		.response = { .body = SBUF_INIT(), .code = 0, .retry_after_secs = 0 },
+	};
+
+	return fivis;
+}
+
+
+/**
+ * Allocates and initializes a FIVIS context without a CURL session, for
+ * transports which do not connect to a server. Returns a pointer to the
+ * context on success, NULL on failure.
+ */
+static struct fivis *
+__fivis_create_local(void) {
+	struct fivis * fivis = (struct fivis *) malloc(sizeof(struct fivis));
+	if (fivis == NULL) {
+		sbuf_set(&last_error, "failed to allocate FIVIS context");
+		return NULL;
+	}
+
+	return __fivis_init(fivis, NULL, NULL, NULL, NULL);
+}
+
+
+/**
+ * Allocates and initializes a FIVIS context. If the share handle is not
+ * NULL, the CURL session uses the caches of the share handle. Returns a
+ * pointer to the context on success, NULL on failure.
+ */
+static struct fivis *
+__fivis_create(
+	const char * restrict api_host, const char * restrict api_token, CURLSH * share
+) {
+	CURL * curl = curl_easy_init();
+	if (curl == NULL) {
+		sbuf_set(&last_error, "failed to create CURL session");
+		goto fail_curl;
+	}
+
+	struct fivis * fivis = (struct fivis *) malloc(sizeof(struct fivis));
+	if (fivis == NULL) {
+		sbuf_set(&last_error, "failed to allocate FIVIS context");
+		goto fail_fivis;
+	}
+
+	CURLU * api_url = __curl_init_url(api_host, fivis_api_path);
+	if (api_url == NULL) {
+		sbuf_set(&last_error, "failed to initialize URL");
+		goto fail_api_url;
+	}
+
+	struct curl_slist * http_headers = __prepare_http_headers(api_token, false);
+	if (http_headers == NULL) {
+		sbuf_set(&last_error, "failed to prepare HTTP headers");
+		goto fail_http_headers;
+	}
+
+	struct curl_slist * http_headers_gzip = __prepare_http_headers(api_token, true);
+	if (http_headers_gzip == NULL) {
+		sbuf_set(&last_error, "failed to prepare HTTP headers");
+		goto fail_http_headers_gzip;
+	}
+
+	if (!__curl_init(curl, api_url, http_headers, &fivis->response, &fivis->curl_error[0])) {
+		sbuf_set(&last_error, "failed to configure CURL session");
+		goto fail_curl_init;
+	}
+
+	if (share != NULL) {
+		CURLcode curl_result = curl_easy_setopt(curl, CURLOPT_SHARE, share);
+		if (__is_curl_error(curl_result, &fivis->curl_error[0], "failed to set share handle")) {
+			goto fail_curl_init;
+		}
+	}
+
+	//
+
+	return __fivis_init(fivis, curl, api_url, http_headers, http_headers_gzip);
+
+	//
+
+fail_curl_init:
+	curl_slist_free_all(http_headers_gzip);
+fail_http_headers_gzip:
+	curl_slist_free_all(http_headers);
+fail_http_headers:
+	curl_url_cleanup(api_url);
+fail_api_url:
+	free(fivis);
+fail_fivis:
+	curl_easy_cleanup(curl);
+fail_curl:
+	return NULL;
+}
+
+
+struct fivis *
+fivis_init(const char * restrict api_host, const char * restrict api_token) {
+	assert(api_host != NULL && api_token != NULL);
+	return __fivis_create(api_host, api_token, NULL);
+}
+
+
+struct fivis *
+fivis_init_transport(
+	fivis_transport_type_t type, const char * restrict target,
+	const char * restrict api_token
+) {
+	assert(api_token != NULL);
+
+	if (type == FIVIS_TRANSPORT_HTTP) {
+		assert(target != NULL);
+		return __fivis_create(target, api_token, NULL);
+	}
+
+	//
+	// Only the Unix socket transport needs a CURL session. The host name
+	// is only used in the request headers.
+	//
+	struct fivis * fivis = (type == FIVIS_TRANSPORT_UNIX)
+		? __fivis_create("http://localhost", api_token, NULL)
+		: __fivis_create_local();
+
+	if (fivis == NULL) {
+		return NULL;
+	}
+
+	switch (type) {
+	case FIVIS_TRANSPORT_UNIX: {
+		assert(target != NULL);
+
+		CURLcode curl_result = curl_easy_setopt(fivis->curl, CURLOPT_UNIX_SOCKET_PATH, target);
+		if (__is_curl_error(curl_result, &fivis->curl_error[0], "failed to set Unix socket path")) {
+			goto fail_transport;
+		}
+		break;
+	}
+
+	case FIVIS_TRANSPORT_NULL:
+		fivis->transport = &null_transport;
+		break;
+
+	case FIVIS_TRANSPORT_FILE:
+		assert(target != NULL);
+
+		fivis->output = fopen(target, "a");
+		if (fivis->output == NULL) {
+			sbuf_set_format(&last_error, "failed to open %s: %s", target, strerror(errno));
+			goto fail_transport;
+		}
+
+		fivis->transport = &file_transport;
+		break;
+
+	default:
+		sbuf_set_format(&last_error, "invalid transport type %d", type);
+		goto fail_transport;
+	}
+
+	return fivis;
+
+	//
+
+fail_transport:
+	fivis_cleanup(fivis);
+	return NULL;
+}
+
+
+const char *
+fivis_transport_name(const struct fivis * fivis) {
+	assert(fivis != NULL);
+	return fivis->transport->name;
+}
+
+
+void
+fivis_cleanup(struct fivis * fivis) {
+	assert(fivis != NULL);
+
+	if (fivis->output != NULL) {
+		fclose(fivis->output);
+		fivis->output = NULL;
+	}
+
+	curl_slist_free_all(fivis->http_headers_gzip);
+	fivis->http_headers_gzip = NULL;
+
+	curl_slist_free_all(fivis->http_headers);
+	fivis->http_headers = NULL;
+
+	curl_url_cleanup(fivis->api_url);
+	fivis->api_url = NULL;
+
+	curl_easy_cleanup(fivis->curl);
+	fivis->curl = NULL;
+
+	__gzip_stream_release(fivis);
+
+	sbuf_destroy(&fivis->output_line);
+	sbuf_destroy(&fivis->response.body);
+	free(fivis);
+}
+
+
+bool
+fivis_set_compression(struct fivis * fivis, int level) {
+	assert(fivis != NULL);
+
+	if (level < 0 || level > Z_BEST_COMPRESSION) {
+		sbuf_set_format(&last_error, "invalid compression level %d", level);
+		return false;
+	}
+
+	// The stream is created again with the new level when needed.
+	if (level != fivis->compression_level) {
+		__gzip_stream_release(fivis);
+	}
+
+	fivis->compression_level = level;
+	return true;
+}
+
+
+const struct fivis_request_stats *
+fivis_last_request_stats(const struct fivis * fivis) {
+	assert(fivis != NULL);
+	return &fivis->last_stats;
+}
+
+
+bool
+fivis_set_http2(struct fivis * fivis, bool enable) {
+	assert(fivis != NULL);
+
+	// Nothing to do for transports without connections.
+	if (!fivis->transport->connects) {
+		return true;
+	}
+
+	// Use HTTP/2 only over TLS, where it is negotiated using ALPN.
+	long version = enable ? CURL_HTTP_VERSION_2TLS : CURL_HTTP_VERSION_1_1;
+
+	CURLcode curl_result = curl_easy_setopt(fivis->curl, CURLOPT_HTTP_VERSION, version);
+	return !__is_curl_error(curl_result, &fivis->curl_error[0], "failed to set HTTP version");
+}
+
+
+bool
+fivis_prewarm(struct fivis * fivis) {
+	assert(fivis != NULL);
+
+	// Nothing to do for transports without connections.
+	if (!fivis->transport->connects) {
+		return true;
+	}
+
+	const char * curl_error = &fivis->curl_error[0];
+
+	//
+	// Send a HEAD request to the API endpoint, which establishes (or
+	// refreshes) a connection to the server without sending any data.
+	// The response code does not matter.
+	//
+	CURLcode curl_result = curl_easy_setopt(fivis->curl, CURLOPT_NOBODY, 1L);
+	if (__is_curl_error(curl_result, curl_error, "failed to enable HEAD request")) {
+		return false;
+	}
+
+	__response_reset(&fivis->response);
+	CURLcode perform_result = curl_easy_perform(fivis->curl);
+
+	// Probes are kept out of the request statistics.
+	fivis->connection_stats.prewarm_connections += __curl_num_connects(fivis->curl);
+
+	bool result = !__is_curl_error(perform_result, curl_error, "failed to pre-warm connection");
+
+	// Restore the POST request settings, even if the probe failed.
+	curl_result = curl_easy_setopt(fivis->curl, CURLOPT_NOBODY, 0L);
+	if (__is_curl_error(curl_result, curl_error, "failed to disable HEAD request")) {
+		return false;
+	}
+
+	curl_result = curl_easy_setopt(fivis->curl, CURLOPT_POST, 1L);
+	if (__is_curl_error(curl_result, curl_error, "failed to enable POST request")) {
+		return false;
+	}
+
+	return result;
+}
+
+
+const struct fivis_connection_stats *
+fivis_connection_stats(const struct fivis * fivis) {
+	assert(fivis != NULL);
+	return &fivis->connection_stats;
+}
+
+
+const struct fivis_request_histograms *
+fivis_request_histograms(const struct fivis * fivis) {
+	assert(fivis != NULL);
+	return &fivis->histograms;
+}
+
+
+void
+fivis_reset_request_histograms(struct fivis * fivis) {
+	assert(fivis != NULL);
+
+	struct fivis_request_histograms * histograms = &fivis->histograms;
+	histogram_reset(&histograms->namelookup_us);
+	histogram_reset(&histograms->connect_us);
+	histogram_reset(&histograms->tls_us);
+	histogram_reset(&histograms->first_byte_us);
+	histogram_reset(&histograms->total_us);
+	histogram_reset(&histograms->upload_speed);
+	histogram_reset(&histograms->body_bytes);
+	histogram_reset(&histograms->sent_bytes);
+	histogram_reset(&histograms->records);
+}
+
+
+void
+fivis_record_request_records(struct fivis * fivis, size_t record_count) {
+	assert(fivis != NULL);
+	histogram_record(&fivis->histograms.records, record_count);
+}
+
+
+const struct fivis_response *
+fivis_last_response(const struct fivis * fivis) {
+	assert(fivis != NULL);
+	return &fivis->response;
+}
+
+
+bool
+fivis_result_is_transient(fivis_result_t result) {
+	switch (result) {
+	case FIVIS_ERR_NETWORK:
+	case FIVIS_ERR_SERVER:
+	case FIVIS_ERR_RETRY_LATER:
+	case FIVIS_ERR_TIMEOUT:
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+//
+
+/** Represents a request submitted to a sender. */
+struct fivis_sender_slot {
+	CURL * curl;
+	char curl_error[CURL_ERROR_SIZE];
+
+	/** Client tag associated with the request. */
+	void * tag;
+
+	/** Set when the request completes. */
+	bool done;
+
+	/** Result of a completed request. */
+	fivis_result_t result;
+
+	/** Response to the request. */
+	struct fivis_response response;
+};
+
+
+struct fivis_sender {
+	CURLM * multi;
+	CURLU * api_url;
+	struct curl_slist * http_headers;
+
+	/** Maximum number of pending requests. */
+	size_t window;
+
+	/** Ring of pending requests, in submission order. */
+	struct fivis_sender_slot * slots;
+
+	/** Index of the oldest pending request. */
+	size_t head;
+
+	/** Number of pending requests. */
+	size_t count;
+
+	/** Retry-After delay of the last reported request (in seconds). */
+	long retry_after_secs;
+};
+
+
+/** Checks the given CURLMcode for error, see __is_curl_error(). */
+static bool
+__is_curlm_error(CURLMcode curlm_code, const char * message) {
+	if (curlm_code == CURLM_OK) {
+		return false;
+	}
+
+	const char * error = curl_multi_strerror(curlm_code);
+	debug("curl: %s\n", error);
+
+	sbuf_set_format(&last_error, "%s: %s", message, error);
+	return true;
+}
+
+
+/** Releases the CURL sessions of the first given number of slots. */
+static void
+__sender_slots_cleanup(struct fivis_sender_slot * slots, size_t count) {
+	for (size_t index = 0; index < count; index++) {
+		curl_easy_cleanup(slots[index].curl);
+		sbuf_destroy(&slots[index].response.body);
+	}
+
+	free(slots);
+}
+
+
+/**
+ * Allocates the given number of slots, each with a CURL session set up
+ * for the given URL and HTTP headers. Returns a pointer to the slots on
+ * success, NULL on failure.
+ */
+static struct fivis_sender_slot *
+__sender_slots_init(size_t count, CURLU * api_url, struct curl_slist * http_headers) {
+	struct fivis_sender_slot * slots = calloc(count, sizeof(struct fivis_sender_slot));
+	if (slots == NULL) {
+		ldebug("failed to allocate %zu sender slots\n", count);
+		return NULL;
+	}
+
+	for (size_t index = 0; index < count; index++) {
+		struct fivis_sender_slot * slot = &slots[index];
+
+		slot->curl = curl_easy_init();
+		if (slot->curl == NULL) {
+			__sender_slots_cleanup(slots, index);
+			return NULL;
+		}
+
+		if (!__curl_init(slot->curl, api_url, http_headers, &slot->response, &slot->curl_error[0])) {
+			__sender_slots_cleanup(slots, index + 1);
+			return NULL;
+		}
+
+		// Allows finding the slot of a completed transfer.
+		curl_easy_setopt(slot->curl, CURLOPT_PRIVATE, slot);
+	}
+
+	return slots;
+}
+
+
+struct fivis_sender *
+fivis_sender_init(const char * api_host, const char * api_token, size_t window) {
+	assert(api_host != NULL && api_token != NULL && window > 0);
+
+	struct fivis_sender * sender = (struct fivis_sender *) malloc(sizeof(struct fivis_sender));
+	if (sender == NULL) {
+		sbuf_set(&last_error, "failed to allocate FIVIS sender");
+		goto fail_sender;
+	}
+
+	CURLM * multi = curl_multi_init();
+	if (multi == NULL) {
+		sbuf_set(&last_error, "failed to create CURL multi session");
+		goto fail_multi;
+	}
+
+	CURLU * api_url = __curl_init_url(api_host, fivis_api_path);
+	if (api_url == NULL) {
+		sbuf_set(&last_error, "failed to initialize URL");
+		goto fail_api_url;
+	}
+
+	struct curl_slist * http_headers = __prepare_http_headers(api_token, false);
+	if (http_headers == NULL) {
+		sbuf_set(&last_error, "failed to prepare HTTP headers");
+		goto fail_http_headers;
+	}
+
+	struct fivis_sender_slot * slots = __sender_slots_init(window, api_url, http_headers);
+	if (slots == NULL) {
+		sbuf_set(&last_error, "failed to configure CURL sessions");
+		goto fail_slots;
+	}
+
+	//
+
+	*sender = (struct fivis_sender) {
+		.multi = multi,
+		.api_url = api_url,
+		.http_headers = http_headers,
+		.window = window,
+		.slots = slots,
+		.head = 0,
+		.count = 0,
+		.retry_after_secs = 0,
+	};
+
+	return sender;
+
+	//
+
+fail_slots:
+	curl_slist_free_all(http_headers);
+fail_http_headers:
+	curl_url_cleanup(api_url);
+fail_api_url:
+	curl_multi_cleanup(multi);
+fail_multi:
+	free(sender);
+fail_sender:
+	return NULL;
+}
+
+
+void
+fivis_sender_cleanup(struct fivis_sender * sender) {
+	assert(sender != NULL);
+
+	// Abort pending transfers.
+	for (size_t index = 0; index < sender->window; index++) {
+		curl_multi_remove_handle(sender->multi, sender->slots[index].curl);
+	}
+
+	__sender_slots_cleanup(sender->slots, sender->window);
+	sender->slots = NULL;
+
+	curl_multi_cleanup(sender->multi);
+	sender->multi = NULL;
+
+	curl_slist_free_all(sender->http_headers);
+	sender->http_headers = NULL;
+
+	curl_url_cleanup(sender->api_url);
+	sender->api_url = NULL;
+
+	free(sender);
+}
+
+
+size_t
+fivis_sender_pending_count(const struct fivis_sender * sender) {
+	assert(sender != NULL);
+	return sender->count;
+}
+
+
+bool
+fivis_sender_is_full(const struct fivis_sender * sender) {
+	assert(sender != NULL);
+	return sender->count == sender->window;
+}
+
+
+bool
+fivis_sender_submit(
+	struct fivis_sender * sender, const char * data, size_t size, void * tag
+) {
+	assert(sender != NULL && data != NULL);
+
+	if (fivis_sender_is_full(sender)) {
+		sbuf_set(&last_error, "too many pending requests");
+		return false;
+	}
+
+	struct fivis_sender_slot * slot = &sender->slots[(sender->head + sender->count) % sender->window];
+	const char * curl_error = &slot->curl_error[0];
+	slot->curl_error[0] = '\0';
+	__response_reset(&slot->response);
+
+	CURLcode curl_result = curl_easy_setopt(slot->curl, CURLOPT_POSTFIELDS, data);
+	if (__is_curl_error(curl_result, curl_error, "failed to set POST data")) {
+		return false;
+	}
+
+	curl_result = curl_easy_setopt(slot->curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t) size);
+	if (__is_curl_error(curl_result, curl_error, "failed to set POST size")) {
+		return false;
+	}
+
+	CURLMcode curlm_result = curl_multi_add_handle(sender->multi, slot->curl);
+	if (__is_curlm_error(curlm_result, "failed to start request")) {
+		return false;
+	}
+
+	slot->tag = tag;
+	slot->done = false;
+	sender->count++;
+	return true;
+}
+
+
+/** Collects the results of completed transfers. */
+static void
+__sender_collect(struct fivis_sender * sender) {
+	int queued;
+	CURLMsg * message;
+	while ((message = curl_multi_info_read(sender->multi, &queued)) != NULL) {
+		if (message->msg != CURLMSG_DONE) {
+			continue;
+		}
+
+		struct fivis_sender_slot * slot;
+		curl_easy_getinfo(message->easy_handle, CURLINFO_PRIVATE, (char **) &slot);
+
+		__response_complete(&slot->response, slot->curl);
+		slot->result = __request_result(message->data.result, &slot->response, &slot->curl_error[0]);
+		slot->done = true;
+
+		// The message is invalid after removing the handle.
+		curl_multi_remove_handle(sender->multi, slot->curl);
+	}
+}
+
+
+bool
+fivis_sender_poll(struct fivis_sender * sender, int timeout_ms) {
+	assert(sender != NULL);
+
+	int running;
+	CURLMcode curlm_result = curl_multi_perform(sender->multi, &running);
+	if (__is_curlm_error(curlm_result, "failed to perform requests")) {
+		return false;
+	}
+
+	__sender_collect(sender);
+
+	//
+	// If the oldest request is still in progress, wait for activity (or
+	// timeout) and let the transfers progress once more.
+	//
+	if (sender->count > 0 && !sender->slots[sender->head].done && timeout_ms > 0) {
+		curlm_result = curl_multi_poll(sender->multi, NULL, 0, timeout_ms, NULL);
+		if (__is_curlm_error(curlm_result, "failed to wait for requests")) {
+			return false;
+		}
+
+		curlm_result = curl_multi_perform(sender->multi, &running);
+		if (__is_curlm_error(curlm_result, "failed to perform requests")) {
+			return false;
+		}
+
+		__sender_collect(sender);
+	}
+
+	return true;
+}
+
+
+long
+fivis_sender_retry_after(const struct fivis_sender * sender) {
+	assert(sender != NULL);
+	return sender->retry_after_secs;
+}
+
+
+bool
+fivis_sender_next_completed(
+	struct fivis_sender * sender, fivis_result_t * result, void ** tag
+) {
+	assert(sender != NULL && result != NULL);
+
+	if (sender->count == 0 || !sender->slots[sender->head].done) {
+		return false;
+	}
+
+	struct fivis_sender_slot * slot = &sender->slots[sender->head];
+	*result = slot->result;
+	if (tag != NULL) {
+		*tag = slot->tag;
+	}
+
+	sender->retry_after_secs = slot->response.retry_after_secs;
+
+	slot->done = false;
+	slot->tag = NULL;
+
+	sender->head = (sender->head + 1) % sender->window;
+	sender->count--;
+	return true;
+}
+
+//
+
+struct fivis_pool {
+	/** Share handle with the caches shared by all contexts. */
+	CURLSH * share;
+
+	/** Locks protecting the shared data, one for each kind of data. */
+	pthread_mutex_t share_locks[CURL_LOCK_DATA_LAST];
+
+	/** All contexts in the pool. */
+	struct fivis ** contexts;
+	size_t size;
+
+	/** Stack of contexts which are not checked out. */
+	struct fivis ** free;
+	size_t free_count;
+
+	/** Flags of the contexts (at the same index) which are checked out. */
+	bool * checked_out;
+
+	pthread_mutex_t mutex;
+
+	/** Signaled when a context is returned to the pool. */
+	pthread_cond_t free_cond;
+};
+
+
+static void
+__share_lock(CURL * curl, curl_lock_data data, curl_lock_access access, void * arg) {
+	(void) curl;
+	(void) access;
+
+	struct fivis_pool * pool = (struct fivis_pool *) arg;
+	pthread_mutex_lock(&pool->share_locks[data]);
+}
+
+
+static void
+__share_unlock(CURL * curl, curl_lock_data data, void * arg) {
+	(void) curl;
+
+	struct fivis_pool * pool = (struct fivis_pool *) arg;
+	pthread_mutex_unlock(&pool->share_locks[data]);
+}
+
+
+static bool
+__is_curlsh_error(CURLSHcode curlsh_code, const char * message) {
+	if (curlsh_code != CURLSHE_OK) {
+		sbuf_set_format(&last_error, "%s: %s", message, curl_share_strerror(curlsh_code));
+		return true;
+	}
+
+	return false;
+}
+
+
+/**
+ * Creates a share handle sharing DNS, TLS session, and connection caches
+ * between the contexts of the given pool, with locking provided by the
+ * pool. Returns a pointer to the share handle on success, NULL on failure.
+ */
+static CURLSH *
+__share_init(struct fivis_pool * pool) {
+	CURLSH * share = curl_share_init();
+	if (share == NULL) {
+		sbuf_set(&last_error, "failed to create CURL share handle");
+		return NULL;
+	}
+
+	CURLSHcode curlsh_result = curl_share_setopt(share, CURLSHOPT_LOCKFUNC, __share_lock);
+	if (__is_curlsh_error(curlsh_result, "failed to set share lock function")) {
+		goto fail_setopt;
+	}
+
+	curlsh_result = curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, __share_unlock);
+	if (__is_curlsh_error(curlsh_result, "failed to set share unlock function")) {
+		goto fail_setopt;
+	}
+
+	curlsh_result = curl_share_setopt(share, CURLSHOPT_USERDATA, pool);
+	if (__is_curlsh_error(curlsh_result, "failed to set share lock data")) {
+		goto fail_setopt;
+	}
+
+	static const curl_lock_data shared_data[] = {
+		CURL_LOCK_DATA_DNS, CURL_LOCK_DATA_SSL_SESSION, CURL_LOCK_DATA_CONNECT,
+	};
+
+	for (size_t i = 0; i < sizeof_array(shared_data); i++) {
+		curlsh_result = curl_share_setopt(share, CURLSHOPT_SHARE, shared_data[i]);
+		if (__is_curlsh_error(curlsh_result, "failed to enable sharing")) {
+			goto fail_setopt;
+		}
+	}
+
+	return share;
+
+	//
+
+fail_setopt:
+	curl_share_cleanup(share);
+	return NULL;
+}
+
+
+/** Releases the given number of contexts and the pool resources. */
+static void
+__pool_destroy(struct fivis_pool * pool, size_t context_count) {
+	// The contexts must be released before the share handle.
+	for (size_t i = 0; i < context_count; i++) {
+		fivis_cleanup(pool->contexts[i]);
+	}
+
+	curl_share_cleanup(pool->share);
+
+	pthread_cond_destroy(&pool->free_cond);
+	pthread_mutex_destroy(&pool->mutex);
+	for (size_t i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+		pthread_mutex_destroy(&pool->share_locks[i]);
+	}
+
+	free(pool->checked_out);
+	free(pool->free);
+	free(pool->contexts);
+	free(pool);
+}
+
+
+/** Returns the index of the given context in the pool, or -1 if not found. */
+static ssize_t
+__pool_context_index(const struct fivis_pool * pool, const struct fivis * fivis) {
+	for (size_t i = 0; i < pool->size; i++) {
+		if (pool->contexts[i] == fivis) {
+			return (ssize_t) i;
+		}
+	}
+
+	return -1;
+}
+
+
+struct fivis_pool *
+fivis_pool_init(const char * api_host, const char * api_token, size_t size) {
+	assert(api_host != NULL && api_token != NULL && size > 0);
+
+	struct fivis_pool * pool = (struct fivis_pool *) malloc(sizeof(struct fivis_pool));
+	if (pool == NULL) {
+		sbuf_set(&last_error, "failed to allocate FIVIS context pool");
+		goto fail_pool;
+	}
+
+	struct fivis ** contexts = (struct fivis **) calloc(size, sizeof(struct fivis *));
+	struct fivis ** free_contexts = (struct fivis **) calloc(size, sizeof(struct fivis *));
+	bool * checked_out = (bool *) calloc(size, sizeof(bool));
+	if (contexts == NULL || free_contexts == NULL || checked_out == NULL) {
+		sbuf_set(&last_error, "failed to allocate FIVIS context pool");
+		goto fail_contexts;
+	}
+
+	*pool = (struct fivis_pool) {
+		.contexts = contexts,
+		.size = size,
+		.free = free_contexts,
+		.free_count = 0,
+		.checked_out = checked_out,
+		.mutex = PTHREAD_MUTEX_INITIALIZER,
+		.free_cond = PTHREAD_COND_INITIALIZER,
+	};
+
+	for (size_t i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+		pthread_mutex_init(&pool->share_locks[i], NULL);
+	}
+
+	pool->share = __share_init(pool);
+	if (pool->share == NULL) {
+		goto fail_share;
+	}
+
+	for (size_t i = 0; i < size; i++) {
+		struct fivis * fivis = __fivis_create(api_host, api_token, pool->share);
+		if (fivis == NULL) {
+			__pool_destroy(pool, i);
+			return NULL;
+		}
+
+		contexts[i] = fivis;
+		free_contexts[pool->free_count++] = fivis;
+	}
+
+	return pool;
+
+	//
+
+fail_share:
+	for (size_t i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+		pthread_mutex_destroy(&pool->share_locks[i]);
+	}
+fail_contexts:
+	free(checked_out);
+	free(free_contexts);
+	free(contexts);
+	free(pool);
+fail_pool:
+	return NULL;
+}
+
+
+void
+fivis_pool_cleanup(struct fivis_pool * pool) {
+	assert(pool != NULL);
+	assert(pool->free_count == pool->size);
+
+	__pool_destroy(pool, pool->size);
+}
+
+
+size_t
+fivis_pool_size(const struct fivis_pool * pool) {
+	assert(pool != NULL);
+	return pool->size;
+}
+
+
+struct fivis *
+fivis_pool_acquire(struct fivis_pool * pool) {
+	assert(pool != NULL);
+
+	pthread_mutex_lock(&pool->mutex);
+
+	while (pool->free_count == 0) {
+		pthread_cond_wait(&pool->free_cond, &pool->mutex);
+	}
+
+	struct fivis * result = pool->free[--pool->free_count];
+	pool->checked_out[__pool_context_index(pool, result)] = true;
+
+	pthread_mutex_unlock(&pool->mutex);
+	return result;
+}
+
+
+bool
+fivis_pool_release(struct fivis_pool * pool, struct fivis * fivis) {
+	assert(pool != NULL && fivis != NULL);
+
+	pthread_mutex_lock(&pool->mutex);
+
+	//
+	// Reject contexts which are not checked out from this pool. Putting a
+	// context on the free stack twice would let two threads acquire it.
+	//
+	ssize_t index = __pool_context_index(pool, fivis);
+	if (index < 0 || !pool->checked_out[index]) {
+		pthread_mutex_unlock(&pool->mutex);
+		sbuf_set(&last_error, (index < 0)
+			? "context does not belong to the pool"
+			: "context is not checked out from the pool"
+		);
+		return false;
+	}
+
+	pool->checked_out[index] = false;
+	pool->free[pool->free_count++] = fivis;
+	pthread_cond_signal(&pool->free_cond);
+
+	pthread_mutex_unlock(&pool->mutex);
+	return true;
 }
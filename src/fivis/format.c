@@ -0,0 +1,50 @@
+/**
+ * Formatting of numbers into character arrays.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <fivis/format.h>
+
+//
+
+const char format_digit_pairs[200] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+
+const uint64_t format_pow10[FORMAT_DECIMALS_MAX + 1] = {
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+	10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+	100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+	100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+	100000000000000000ULL, 1000000000000000000ULL,
+};
+
+
+char *
+format_double_fixed_exact(char * dest, double value, unsigned int decimals) {
+	assert(decimals <= FORMAT_DECIMALS_MAX);
+
+	char buffer[DTOA_BUFFER_SIZE];
+	double magnitude = (value < 0) ? -value : value;
+	int length = snprintf(buffer, sizeof(buffer), "%.*f", (int) decimals, magnitude);
+	assert(length > 0 && (size_t) length < sizeof(buffer));
+
+	// Keep the sign only if some digit is not zero.
+	if (value < 0 && strspn(buffer, "0.") < (size_t) length) {
+		*dest++ = '-';
+	}
+
+	memcpy(dest, buffer, length);
+	return dest + length;
+}
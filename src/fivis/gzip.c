@@ -0,0 +1,141 @@
+/**
+ * Streaming gzip compression.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <string.h>
+#include <time.h>
+
+#include <fivis/debug.h>
+#include <fivis/gzip.h>
+
+//
+
+/** Adds 16 to the window bits to produce a gzip (not zlib) header. */
+#define GZIP_WINDOW_BITS (15 + 16)
+
+/** Default memory level used by zlib. */
+#define GZIP_MEMORY_LEVEL 8
+
+//
+
+static inline uint64_t
+__thread_cpu_ns(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+	return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+
+bool
+gzip_stream_init(
+	struct gzip_stream * stream, int level,
+	gzip_source_t source, void * source_arg
+) {
+	assert(stream != NULL && source != NULL);
+	assert(level >= Z_BEST_SPEED && level <= Z_BEST_COMPRESSION);
+
+	memset(&stream->zstream, 0, sizeof(stream->zstream));
+
+	int result = deflateInit2(
+		&stream->zstream, level, Z_DEFLATED,
+		GZIP_WINDOW_BITS, GZIP_MEMORY_LEVEL, Z_DEFAULT_STRATEGY
+	);
+
+	if (result != Z_OK) {
+		debug("gzip: failed to initialize deflate stream (%d)\n", result);
+		return false;
+	}
+
+	stream->source = source;
+	stream->source_arg = source_arg;
+	stream->input_done = false;
+	stream->finished = false;
+	stream->input_bytes = 0;
+	stream->output_bytes = 0;
+	stream->compress_ns = 0;
+	return true;
+}
+
+
+bool
+gzip_stream_reset(
+	struct gzip_stream * stream, gzip_source_t source, void * source_arg
+) {
+	assert(stream != NULL && source != NULL);
+
+	int result = deflateReset(&stream->zstream);
+	if (result != Z_OK) {
+		debug("gzip: failed to reset deflate stream (%d)\n", result);
+		return false;
+	}
+
+	// Drop any input read from the previous source.
+	stream->zstream.next_in = NULL;
+	stream->zstream.avail_in = 0;
+
+	stream->source = source;
+	stream->source_arg = source_arg;
+	stream->input_done = false;
+	stream->finished = false;
+	stream->input_bytes = 0;
+	stream->output_bytes = 0;
+	stream->compress_ns = 0;
+	return true;
+}
+
+
+void
+gzip_stream_destroy(struct gzip_stream * stream) {
+	assert(stream != NULL);
+	deflateEnd(&stream->zstream);
+}
+
+
+size_t
+gzip_stream_read(struct gzip_stream * stream, char * dest, size_t size) {
+	assert(stream != NULL && (dest != NULL || size == 0));
+
+	z_stream * zstream = &stream->zstream;
+	zstream->next_out = (Bytef *) dest;
+	zstream->avail_out = size;
+
+	//
+	// Keep compressing until the destination is full or the stream is
+	// finished. The deflate function may consume all input without
+	// producing any output, so returning early could signal a premature
+	// end of the stream.
+	//
+	while (zstream->avail_out > 0 && !stream->finished) {
+		if (zstream->avail_in == 0 && !stream->input_done) {
+			size_t length = stream->source(stream->input, GZIP_INPUT_SIZE, stream->source_arg);
+			if (length == GZIP_READ_ERROR) {
+				debug("gzip: failed to read uncompressed data\n");
+				return GZIP_READ_ERROR;
+			}
+
+			stream->input_done = (length == 0);
+			stream->input_bytes += length;
+
+			zstream->next_in = (Bytef *) stream->input;
+			zstream->avail_in = length;
+		}
+
+		uint64_t start_ns = __thread_cpu_ns();
+		int result = deflate(zstream, stream->input_done ? Z_FINISH : Z_NO_FLUSH);
+		stream->compress_ns += __thread_cpu_ns() - start_ns;
+
+		if (result == Z_STREAM_END) {
+			stream->finished = true;
+		} else if (result != Z_OK && result != Z_BUF_ERROR) {
+			debug("gzip: failed to compress data (%d)\n", result);
+			return GZIP_READ_ERROR;
+		}
+	}
+
+	size_t produced = size - zstream->avail_out;
+	stream->output_bytes += produced;
+	return produced;
+}
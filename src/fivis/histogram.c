@@ -0,0 +1,117 @@
+/**
+ * Histogram of unsigned integer values with fixed buckets.
+ */
+
+#include <assert.h>
+#include <string.h>
+
+#include <fivis/histogram.h>
+
+//
+
+void
+histogram_reset(struct histogram * histogram) {
+	assert(histogram != NULL);
+	memset(histogram, 0, sizeof(struct histogram));
+}
+
+
+size_t
+histogram_bucket(uint64_t value) {
+	// Small values have a bucket each.
+	if (value < HISTOGRAM_SUB_BUCKETS) {
+		return (size_t) value;
+	}
+
+	//
+	// Larger values are grouped by the position of the most significant
+	// bit, and then by the bits following it.
+	//
+	unsigned int msb = 63 - __builtin_clzll(value);
+	unsigned int shift = msb - HISTOGRAM_SUB_BITS;
+	size_t sub_bucket = (value >> shift) & (HISTOGRAM_SUB_BUCKETS - 1);
+	return ((size_t) (shift + 1) << HISTOGRAM_SUB_BITS) + sub_bucket;
+}
+
+
+uint64_t
+histogram_bucket_min(size_t bucket) {
+	assert(bucket < HISTOGRAM_BUCKET_COUNT);
+
+	if (bucket < HISTOGRAM_SUB_BUCKETS) {
+		return bucket;
+	}
+
+	unsigned int shift = (bucket >> HISTOGRAM_SUB_BITS) - 1;
+	uint64_t sub_bucket = bucket & (HISTOGRAM_SUB_BUCKETS - 1);
+	return (HISTOGRAM_SUB_BUCKETS + sub_bucket) << shift;
+}
+
+
+uint64_t
+histogram_bucket_max(size_t bucket) {
+	assert(bucket < HISTOGRAM_BUCKET_COUNT);
+
+	if (bucket < HISTOGRAM_SUB_BUCKETS) {
+		return bucket;
+	}
+
+	unsigned int shift = (bucket >> HISTOGRAM_SUB_BITS) - 1;
+	return histogram_bucket_min(bucket) + ((uint64_t) 1 << shift) - 1;
+}
+
+
+void
+histogram_record(struct histogram * histogram, uint64_t value) {
+	assert(histogram != NULL);
+
+	if (histogram->count == 0 || value < histogram->min) {
+		histogram->min = value;
+	}
+
+	if (histogram->count == 0 || value > histogram->max) {
+		histogram->max = value;
+	}
+
+	histogram->count++;
+	histogram->sum += value;
+	histogram->buckets[histogram_bucket(value)]++;
+}
+
+
+double
+histogram_mean(const struct histogram * histogram) {
+	assert(histogram != NULL);
+	return (histogram->count > 0) ? (double) histogram->sum / histogram->count : 0;
+}
+
+
+uint64_t
+histogram_quantile(const struct histogram * histogram, double fraction) {
+	assert(histogram != NULL);
+
+	if (histogram->count == 0) {
+		return 0;
+	}
+
+	// The rank of the value, counting from one.
+	uint64_t rank = (uint64_t) (fraction * histogram->count + 0.5);
+	if (rank < 1) {
+		rank = 1;
+	} else if (rank > histogram->count) {
+		rank = histogram->count;
+	}
+
+	uint64_t seen = 0;
+	size_t bucket = histogram_bucket(histogram->min);
+	size_t last = histogram_bucket(histogram->max);
+	for (; bucket < last; bucket++) {
+		seen += histogram->buckets[bucket];
+		if (seen >= rank) {
+			break;
+		}
+	}
+
+	uint64_t result = histogram_bucket_max(bucket);
+	return (result < histogram->max) ? result : histogram->max;
+}
@@ -0,0 +1,290 @@
+/**
+ * JSON string escaping.
+ *
+ * Most strings need no escaping at all, so the escaping routine first
+ * looks for the next byte which needs attention (a quote, a backslash,
+ * a control character, or a non-ASCII byte) and copies the clean run
+ * preceding it in one go. On x86 processors, the search examines 16 (SSE2)
+ * or 32 (AVX2) bytes at a time without branching on individual characters.
+ */
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#  define JSON_SIMD_X86 1
+#  include <immintrin.h>
+#endif
+
+#include <fivis/json.h>
+#include <fivis/sbuf.h>
+
+//
+
+/**
+ * Maximum expansion of a single input byte, which is an escaped control
+ * character or an invalid byte replaced by an escaped U+FFFD.
+ */
+#define JSON_ESCAPE_LENGTH_MAX 6
+
+
+static inline bool
+__is_special(uint8_t c) {
+	return c < 0x20 || c == '"' || c == '\\' || c >= 0x80;
+}
+
+
+static size_t
+__find_special_scalar(const uint8_t * str, size_t length) {
+	for (size_t index = 0; index < length; index++) {
+		if (__is_special(str[index])) {
+			return index;
+		}
+	}
+
+	return length;
+}
+
+
+#ifdef JSON_SIMD_X86
+
+__attribute__((target("sse2")))
+static size_t
+__find_special_sse2(const uint8_t * str, size_t length) {
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+	const __m128i control_max = _mm_set1_epi8(0x1F);
+
+	size_t index = 0;
+	for (; index + sizeof(__m128i) <= length; index += sizeof(__m128i)) {
+		__m128i chars = _mm_loadu_si128((const __m128i *) &str[index]);
+
+		// Control characters satisfy max(c, 0x1F) == 0x1F.
+		__m128i special = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(chars, quote), _mm_cmpeq_epi8(chars, backslash)),
+			_mm_cmpeq_epi8(_mm_max_epu8(chars, control_max), control_max)
+		);
+
+		// Non-ASCII bytes have the most significant bit set.
+		unsigned int mask = _mm_movemask_epi8(special) | _mm_movemask_epi8(chars);
+		if (mask != 0) {
+			return index + __builtin_ctz(mask);
+		}
+	}
+
+	return index + __find_special_scalar(&str[index], length - index);
+}
+
+
+/**
+ * Searches whole 32-byte blocks only. Returns the index of the first
+ * special byte, or the index of the first byte past the last whole block.
+ */
+__attribute__((target("avx2")))
+static size_t
+__find_special_avx2(const uint8_t * str, size_t length) {
+	const __m256i quote = _mm256_set1_epi8('"');
+	const __m256i backslash = _mm256_set1_epi8('\\');
+	const __m256i control_max = _mm256_set1_epi8(0x1F);
+
+	size_t index = 0;
+	for (; index + sizeof(__m256i) <= length; index += sizeof(__m256i)) {
+		__m256i chars = _mm256_loadu_si256((const __m256i *) &str[index]);
+
+		__m256i special = _mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(chars, quote), _mm256_cmpeq_epi8(chars, backslash)),
+			_mm256_cmpeq_epi8(_mm256_max_epu8(chars, control_max), control_max)
+		);
+
+		unsigned int mask = (unsigned int) _mm256_movemask_epi8(special)
+			| (unsigned int) _mm256_movemask_epi8(chars);
+		if (mask != 0) {
+			index += __builtin_ctz(mask);
+			break;
+		}
+	}
+
+	//
+	// Clear the upper halves of the YMM registers before returning to
+	// non-VEX code to avoid SSE/AVX transition penalties. The compiler
+	// does not always do this on its own (e.g., when optimizing for size).
+	// For the same reason, the tail is left to the caller.
+	//
+	_mm256_zeroupper();
+	return index;
+}
+
+#endif /* JSON_SIMD_X86 */
+
+
+/**
+ * Returns the index of the first byte in the given string which needs
+ * escaping or validation, or the length of the string if there is none.
+ */
+static inline size_t
+__find_special(const uint8_t * str, size_t length) {
+#ifdef JSON_SIMD_X86
+	if (__builtin_cpu_supports("avx2")) {
+		// Only examines whole 32-byte blocks.
+		size_t index = __find_special_avx2(str, length);
+		if (index < (length & ~(sizeof(__m256i) - 1))) {
+			return index;
+		}
+
+		return index + __find_special_sse2(&str[index], length - index);
+
+	} else if (__builtin_cpu_supports("sse2")) {
+		return __find_special_sse2(str, length);
+	}
+#endif
+
+	return __find_special_scalar(str, length);
+}
+
+//
+
+static inline bool
+__is_continuation(uint8_t c) {
+	return (c & 0xC0) == 0x80;
+}
+
+
+/**
+ * Returns the length of a valid UTF-8 sequence starting with a non-ASCII
+ * byte at the start of the given string, or zero if the sequence is not
+ * valid, i.e., truncated, overlong, encoding a surrogate, or out of range.
+ */
+static size_t
+__utf8_sequence_length(const uint8_t * str, size_t length) {
+	uint8_t lead = str[0];
+
+	if (lead >= 0xC2 && lead <= 0xDF) {
+		return (length >= 2 && __is_continuation(str[1])) ? 2 : 0;
+
+	} else if (lead >= 0xE0 && lead <= 0xEF) {
+		if (length < 3 || !__is_continuation(str[2])) {
+			return 0;
+		}
+
+		// Exclude overlong encodings and surrogates.
+		uint8_t min = (lead == 0xE0) ? 0xA0 : 0x80;
+		uint8_t max = (lead == 0xED) ? 0x9F : 0xBF;
+		return (str[1] >= min && str[1] <= max) ? 3 : 0;
+
+	} else if (lead >= 0xF0 && lead <= 0xF4) {
+		if (length < 4 || !__is_continuation(str[2]) || !__is_continuation(str[3])) {
+			return 0;
+		}
+
+		// Exclude overlong encodings and code points above U+10FFFF.
+		uint8_t min = (lead == 0xF0) ? 0x90 : 0x80;
+		uint8_t max = (lead == 0xF4) ? 0x8F : 0xBF;
+		return (str[1] >= min && str[1] <= max) ? 4 : 0;
+
+	} else {
+		// Continuation byte, overlong lead byte, or out of range.
+		return 0;
+	}
+}
+
+
+static const char __hex_digits[] = "0123456789abcdef";
+
+
+/**
+ * Writes the escape sequence for an ASCII character which must be escaped.
+ * Returns a pointer past the last byte written.
+ */
+static inline char *
+__write_escape(char * dest, uint8_t c) {
+	dest[0] = '\\';
+
+	switch (c) {
+	case '"': dest[1] = '"'; return dest + 2;
+	case '\\': dest[1] = '\\'; return dest + 2;
+	case '\b': dest[1] = 'b'; return dest + 2;
+	case '\f': dest[1] = 'f'; return dest + 2;
+	case '\n': dest[1] = 'n'; return dest + 2;
+	case '\r': dest[1] = 'r'; return dest + 2;
+	case '\t': dest[1] = 't'; return dest + 2;
+
+	default:
+		memcpy(&dest[1], "u00", 3);
+		dest[4] = __hex_digits[c >> 4];
+		dest[5] = __hex_digits[c & 0xF];
+		return dest + 6;
+	}
+}
+
+
+char *
+json_append_string(sbuf_t * sb, const char * restrict str, size_t length) {
+	assert(sb != NULL && (str != NULL || length == 0));
+
+	//
+	// Reserve space for the worst case, in which every byte expands to
+	// an escape sequence, plus the quotes. Then alternate between copying
+	// clean runs and handling the byte that ended the run.
+	//
+	char * dest = sbuf_extend(sb, length * JSON_ESCAPE_LENGTH_MAX + 2);
+	if (dest == NULL) {
+		return NULL;
+	}
+
+	const uint8_t * input = (const uint8_t *) str;
+	const uint8_t * end = input + length;
+
+	*dest++ = '"';
+	while (input < end) {
+		size_t clean = __find_special(input, end - input);
+		memcpy(dest, input, clean);
+		dest += clean;
+		input += clean;
+
+		if (input == end) {
+			break;
+		}
+
+		if (*input < 0x80) {
+			dest = __write_escape(dest, *input);
+			input++;
+			continue;
+		}
+
+		size_t sequence = __utf8_sequence_length(input, end - input);
+		if (sequence > 0) {
+			memcpy(dest, input, sequence);
+			dest += sequence;
+			input += sequence;
+
+		} else {
+			memcpy(dest, "\\ufffd", 6);
+			dest += 6;
+			input++;
+		}
+	}
+
+	*dest++ = '"';
+	return sbuf_commit(sb, dest);
+}
+
+
+char *
+json_append_cstring(sbuf_t * sb, const char * restrict str) {
+	assert(str != NULL);
+	return json_append_string(sb, str, strlen(str));
+}
+
+
+char *
+json_append_key(sbuf_t * sb, const char * restrict key) {
+	assert(key != NULL);
+
+	if (json_append_cstring(sb, key) == NULL) {
+		return NULL;
+	}
+
+	return sbuf_append_literal(sb, ": ");
+}
@@ -0,0 +1,401 @@
+/**
+ * Segmented string buffer.
+ *
+ * Allows appending strings into a chain of fixed-size segments.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fivis/debug.h>
+#include <fivis/format.h>
+#include <fivis/sbchain.h>
+#include <fivis/sbuf.h>
+
+//
+
+/**
+ * Takes a segment from the pool or allocates a new one. Returns a pointer
+ * to the segment, or NULL on failure.
+ */
+static struct sbchain_segment *
+__segment_get(struct sbchain_pool * pool) {
+	if (pool != NULL && pool->free != NULL) {
+		struct sbchain_segment * result = pool->free;
+		pool->free = result->next;
+		pool->free_count--;
+		return result;
+	}
+
+	struct sbchain_segment * result = malloc(SBCHAIN_SEGMENT_SIZE);
+	if (result == NULL) {
+		debug("sbchain: failed to allocate segment\n");
+	}
+
+	return result;
+}
+
+
+/**
+ * Returns a list of segments to the pool, or releases them if the pool
+ * is full (or missing).
+ */
+static void
+__segments_put(struct sbchain_pool * pool, struct sbchain_segment * segment) {
+	while (segment != NULL) {
+		struct sbchain_segment * next = segment->next;
+
+		if (pool != NULL && pool->free_count < pool->free_max) {
+			segment->next = pool->free;
+			pool->free = segment;
+			pool->free_count++;
+		} else {
+			free(segment);
+		}
+
+		segment = next;
+	}
+}
+
+
+void
+sbchain_pool_destroy(struct sbchain_pool * pool) {
+	assert(pool != NULL);
+
+	size_t free_max = pool->free_max;
+	pool->free_max = 0;
+
+	struct sbchain_segment * segments = pool->free;
+	pool->free = NULL;
+	pool->free_count = 0;
+
+	__segments_put(pool, segments);
+
+	// Keep the limit, the structure may be reused.
+	pool->free_max = free_max;
+}
+
+//
+
+void
+sbchain_init(struct sbchain * chain, struct sbchain_pool * pool) {
+	assert(chain != NULL);
+	*chain = SBCHAIN_INIT(pool);
+}
+
+
+void
+sbchain_destroy(struct sbchain * chain) {
+	assert(chain != NULL);
+
+	__segments_put(chain->pool, chain->head);
+	*chain = SBCHAIN_INIT(chain->pool);
+}
+
+
+void
+sbchain_clear(struct sbchain * chain) {
+	assert(chain != NULL);
+
+	struct sbchain_segment * head = chain->head;
+	if (head != NULL) {
+		__segments_put(chain->pool, head->next);
+
+		head->next = NULL;
+		head->length = 0;
+	}
+
+	chain->tail = head;
+	chain->length = 0;
+}
+
+
+struct sbchain_segment *
+sbchain_add_segment(struct sbchain * chain) {
+	assert(chain != NULL);
+
+	struct sbchain_segment * segment = __segment_get(chain->pool);
+	if (segment == NULL) {
+		return NULL;
+	}
+
+	segment->next = NULL;
+	segment->length = 0;
+
+	if (chain->tail != NULL) {
+		chain->tail->next = segment;
+	} else {
+		chain->head = segment;
+	}
+
+	chain->tail = segment;
+	return segment;
+}
+
+
+bool
+sbchain_append_bytes(struct sbchain * chain, const char * restrict data, size_t length) {
+	assert(chain != NULL && (data != NULL || length == 0));
+
+	struct sbchain_segment * tail = chain->tail;
+	while (length > 0) {
+		if (tail == NULL || tail->length == SBCHAIN_SEGMENT_CAPACITY) {
+			tail = sbchain_add_segment(chain);
+			if (tail == NULL) {
+				return false;
+			}
+		}
+
+		// Fill the remainder of the last segment.
+		size_t avail = SBCHAIN_SEGMENT_CAPACITY - tail->length;
+		size_t count = (length < avail) ? length : avail;
+		memcpy(tail->data + tail->length, data, count);
+
+		tail->length += count;
+		chain->length += count;
+
+		data += count;
+		length -= count;
+	}
+
+	return true;
+}
+
+
+bool
+sbchain_append(struct sbchain * chain, const char * restrict str) {
+	assert(chain != NULL && str != NULL);
+	return sbchain_append_bytes(chain, str, strlen(str));
+}
+
+
+bool
+sbchain_append_sbuf(struct sbchain * chain, sbuf_t * sb) {
+	assert(chain != NULL && sb != NULL);
+	return sbchain_append_bytes(chain, sbuf_string(sb), sbuf_length(sb));
+}
+
+
+bool
+sbchain_append_char(struct sbchain * chain, char c) {
+	assert(chain != NULL);
+
+	char * dest = sbchain_extend(chain, 1);
+	if (dest == NULL) {
+		return false;
+	}
+
+	*dest = c;
+	sbchain_commit(chain, dest + 1);
+	return true;
+}
+
+//
+
+/*
+ * The numeric appenders reserve the maximum length of the formatted value
+ * so that the value never spans two segments.
+ */
+
+bool
+sbchain_append_uint64(struct sbchain * chain, uint64_t value) {
+	assert(chain != NULL);
+
+	char * dest = sbchain_extend(chain, FORMAT_UINT64_LENGTH_MAX);
+	if (dest == NULL) {
+		return false;
+	}
+
+	sbchain_commit(chain, format_uint64(dest, value));
+	return true;
+}
+
+
+bool
+sbchain_append_uint64_padded(struct sbchain * chain, uint64_t value, unsigned int width) {
+	assert(chain != NULL && width <= FORMAT_UINT64_LENGTH_MAX);
+
+	char * dest = sbchain_extend(chain, FORMAT_UINT64_LENGTH_MAX);
+	if (dest == NULL) {
+		return false;
+	}
+
+	sbchain_commit(chain, format_uint64_padded(dest, value, width));
+	return true;
+}
+
+
+bool
+sbchain_append_int64(struct sbchain * chain, int64_t value) {
+	assert(chain != NULL);
+
+	char * dest = sbchain_extend(chain, FORMAT_INT64_LENGTH_MAX);
+	if (dest == NULL) {
+		return false;
+	}
+
+	sbchain_commit(chain, format_int64(dest, value));
+	return true;
+}
+
+
+bool
+sbchain_append_fixed(struct sbchain * chain, int64_t value, unsigned int decimals) {
+	assert(chain != NULL && decimals <= FORMAT_DECIMALS_MAX);
+
+	char * dest = sbchain_extend(chain, FORMAT_FIXED_LENGTH_MAX);
+	if (dest == NULL) {
+		return false;
+	}
+
+	sbchain_commit(chain, format_fixed(dest, value, decimals));
+	return true;
+}
+
+
+bool
+sbchain_append_double(struct sbchain * chain, double value) {
+	assert(chain != NULL);
+
+	char * dest = sbchain_extend(chain, FORMAT_DOUBLE_LENGTH_MAX);
+	if (dest == NULL) {
+		return false;
+	}
+
+	sbchain_commit(chain, format_double(dest, value));
+	return true;
+}
+
+
+bool
+sbchain_append_double_fixed(struct sbchain * chain, double value, unsigned int decimals) {
+	assert(chain != NULL && decimals <= FORMAT_DECIMALS_MAX);
+
+	char * dest = sbchain_extend(chain, FORMAT_DOUBLE_LENGTH_MAX);
+	if (dest == NULL) {
+		return false;
+	}
+
+	sbchain_commit(chain, format_double_fixed(dest, value, decimals));
+	return true;
+}
+
+
+bool
+sbchain_append_key(struct sbchain * chain, const char * restrict key) {
+	assert(chain != NULL && key != NULL);
+
+	return sbchain_append_char(chain, '"')
+		&& sbchain_append(chain, key)
+		&& sbchain_append_literal(chain, "\": ");
+}
+
+
+bool
+sbchain_vformat(struct sbchain * chain, const char * restrict format, va_list args) {
+	assert(chain != NULL);
+
+	//
+	// Try formatting the string into the last segment first. If it does
+	// not fit, but fits into an empty segment, format it into a new one.
+	// Longer strings are formatted into a temporary buffer and copied.
+	//
+	struct sbchain_segment * tail = chain->tail;
+	char * dest = (tail != NULL) ? tail->data + tail->length : NULL;
+	size_t avail = (tail != NULL) ? SBCHAIN_SEGMENT_CAPACITY - tail->length : 0;
+
+	va_list args_copy;
+	va_copy(args_copy, args);
+	int result = vsnprintf(dest, avail, format, args_copy);
+	va_end(args_copy);
+
+	if (result < 0) {
+		debug("sbchain: failed to format string into segment");
+		return false;
+	}
+
+	// The formatted string must fit including the terminating zero byte.
+	size_t length = (size_t) result;
+	if (length < avail) {
+		sbchain_commit(chain, dest + length);
+		return true;
+	}
+
+	if (length < SBCHAIN_SEGMENT_CAPACITY) {
+		dest = sbchain_extend(chain, length + 1);
+		if (dest == NULL) {
+			return false;
+		}
+
+		vsnprintf(dest, length + 1, format, args);
+		sbchain_commit(chain, dest + length);
+		return true;
+	}
+
+	sbuf_t temp = SBUF_INIT();
+	bool success = sbuf_vformat(&temp, format, args) != NULL
+		&& sbchain_append_sbuf(chain, &temp);
+
+	sbuf_destroy(&temp);
+	return success;
+}
+
+
+bool
+sbchain_format(struct sbchain * chain, const char * restrict format, ...) {
+	assert(chain != NULL);
+
+	va_list args;
+	va_start(args, format);
+	bool result = sbchain_vformat(chain, format, args);
+	va_end(args);
+
+	return result;
+}
+
+
+char *
+sbchain_copy_to_sbuf(const struct sbchain * chain, sbuf_t * sb) {
+	assert(chain != NULL && sb != NULL);
+
+	if (sbuf_reserve(sb, sbuf_length(sb) + chain->length + 1) == NULL) {
+		return NULL;
+	}
+
+	for (struct sbchain_segment * segment = chain->head; segment != NULL; segment = segment->next) {
+		if (sbuf_append_bytes(sb, segment->data, segment->length) == NULL) {
+			return NULL;
+		}
+	}
+
+	return sb->data;
+}
+
+//
+
+size_t
+sbchain_read(struct sbchain_reader * reader, char * dest, size_t size) {
+	assert(reader != NULL && (dest != NULL || size == 0));
+
+	size_t result = 0;
+	while (result < size && reader->segment != NULL) {
+		const struct sbchain_segment * segment = reader->segment;
+
+		size_t avail = segment->length - reader->offset;
+		size_t count = (size - result < avail) ? size - result : avail;
+		memcpy(dest + result, segment->data + reader->offset, count);
+
+		result += count;
+		reader->offset += count;
+
+		// Move to the next segment when done with the current one.
+		if (reader->offset == segment->length) {
+			reader->segment = segment->next;
+			reader->offset = 0;
+		}
+	}
+
+	return result;
+}
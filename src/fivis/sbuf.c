@@ -8,8 +8,10 @@
 
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <fivis/debug.h>
+#include <fivis/format.h>
 #include <fivis/util.h>
 #include <fivis/sbuf.h>
 
@@ -37,27 +39,46 @@ __sbuf_has_buffer(sbuf_t * sb) {
 }
 
 
+/**
+ * Reallocates the buffer to the given size. Returns the new data pointer
+ * on success, or NULL on failure, in which case the buffer is unchanged.
+ */
 static char *
-__sbuf_ensure_capacity(sbuf_t * sb, size_t capacity) {
+__sbuf_resize(sbuf_t * sb, size_t size) {
+	char * data = realloc(sb->data, size);
+
+	if (data != NULL) {
+		// Update on success.
+		sb->data = data;
+		sb->size = size;
+
+	} else {
+		debug(
+			"sbuf: failed to realloc %p from %zu to %zu bytes",
+			sb->data, sb->size, size
+		);
+	}
+
+	// Reallocation result, may be NULL.
+	return data;
+}
+
+
+char *
+sbuf_ensure_capacity(sbuf_t * sb, size_t capacity) {
 	if (__sbuf_remaining(sb) < capacity) {
-		// Align size to 2^6 = 64 bytes.
-		size_t size = align_pow2(sb->next + capacity, 6);
-		char * data = realloc(sb->data, size);
-
-		if (data != NULL) {
-			// Update on success.
-			sb->data = data;
-			sb->size = size;
-
-		} else {
-			debug(
-				"sbuf: failed to realloc %p from %zu to %zu bytes",
-				sb->data, sb->size, size
-			);
-		}
+		//
+		// Grow the buffer geometrically (double its size), but by no more
+		// than the maximum growth step, and at least to the required size.
+		//
+		size_t growth_max = (sb->growth_max > 0) ? sb->growth_max : SBUF_GROWTH_MAX_DEFAULT;
+		size_t growth = (sb->size < growth_max) ? sb->size : growth_max;
 
-		// Reallocation result, may be NULL.
-		return data;
+		size_t required = sb->next + capacity;
+		size_t size = (sb->size + growth > required) ? sb->size + growth : required;
+
+		// Align size to 2^6 = 64 bytes.
+		return __sbuf_resize(sb, align_pow2(size, 6));
 
 	} else {
 		// No reallocation -> current data.
@@ -81,7 +102,23 @@ sbuf_destroy(sbuf_t * sb) {
 		free(sb->data);
 	}
 
+	// Keep the growth setting, the structure may be reused.
+	size_t growth_max = sb->growth_max;
 	*sb = SBUF_INIT();
+	sb->growth_max = growth_max;
+}
+
+
+char *
+sbuf_reserve(sbuf_t * sb, size_t size) {
+	assert(sb != NULL);
+
+	if (sb->size < size) {
+		// Align size to 2^6 = 64 bytes.
+		return __sbuf_resize(sb, align_pow2(size, 6));
+	} else {
+		return sb->data;
+	}
 }
 
 
@@ -141,7 +178,9 @@ sbuf_vformat(sbuf_t * sb, const char * restrict format, va_list args) {
 		}
 
 		// Otherwise try again with larger buffer.
-		__sbuf_ensure_capacity(sb, length + 1);
+		if (sbuf_ensure_capacity(sb, length + 1) == NULL) {
+			return NULL;
+		}
 	}
 }
 
@@ -161,8 +200,118 @@ sbuf_format(sbuf_t * sb, const char * restrict format, ...) {
 
 char *
 sbuf_append(sbuf_t * sb, const char * restrict str) {
+	assert(sb != NULL && str != NULL);
+	return sbuf_append_bytes(sb, str, strlen(str));
+}
+
+
+char *
+sbuf_append_bytes(sbuf_t * sb, const char * restrict data, size_t length) {
+	assert(sb != NULL && (data != NULL || length == 0));
+
+	// Make room for the data and the terminating zero byte.
+	if (sbuf_ensure_capacity(sb, length + 1) == NULL) {
+		return NULL;
+	}
+
+	char * dest = __sbuf_next_ptr(sb);
+	memcpy(dest, data, length);
+	dest[length] = '\0';
+
+	sb->next += length;
+	return sb->data;
+}
+
+
+char *
+sbuf_append_char(sbuf_t * sb, char c) {
 	assert(sb != NULL);
-	return sbuf_format(sb, "%s", str);
+
+	if (sbuf_ensure_capacity(sb, 2) == NULL) {
+		return NULL;
+	}
+
+	char * dest = __sbuf_next_ptr(sb);
+	dest[0] = c;
+	dest[1] = '\0';
+
+	sb->next += 1;
+	return sb->data;
+}
+
+//
+
+char *
+sbuf_append_uint64(sbuf_t * sb, uint64_t value) {
+	assert(sb != NULL);
+
+	char * dest = sbuf_extend(sb, FORMAT_UINT64_LENGTH_MAX);
+	return (dest != NULL) ? sbuf_commit(sb, format_uint64(dest, value)) : NULL;
+}
+
+
+char *
+sbuf_append_uint64_padded(sbuf_t * sb, uint64_t value, unsigned int width) {
+	assert(sb != NULL && width <= FORMAT_UINT64_LENGTH_MAX);
+
+	char * dest = sbuf_extend(sb, FORMAT_UINT64_LENGTH_MAX);
+	return (dest != NULL) ? sbuf_commit(sb, format_uint64_padded(dest, value, width)) : NULL;
+}
+
+
+char *
+sbuf_append_int64(sbuf_t * sb, int64_t value) {
+	assert(sb != NULL);
+
+	char * dest = sbuf_extend(sb, FORMAT_INT64_LENGTH_MAX);
+	return (dest != NULL) ? sbuf_commit(sb, format_int64(dest, value)) : NULL;
+}
+
+
+char *
+sbuf_append_fixed(sbuf_t * sb, int64_t value, unsigned int decimals) {
+	assert(sb != NULL && decimals <= FORMAT_DECIMALS_MAX);
+
+	char * dest = sbuf_extend(sb, FORMAT_FIXED_LENGTH_MAX);
+	return (dest != NULL) ? sbuf_commit(sb, format_fixed(dest, value, decimals)) : NULL;
+}
+
+
+char *
+sbuf_append_double(sbuf_t * sb, double value) {
+	assert(sb != NULL);
+
+	char * dest = sbuf_extend(sb, FORMAT_DOUBLE_LENGTH_MAX);
+	return (dest != NULL) ? sbuf_commit(sb, format_double(dest, value)) : NULL;
+}
+
+
+char *
+sbuf_append_double_fixed(sbuf_t * sb, double value, unsigned int decimals) {
+	assert(sb != NULL && decimals <= FORMAT_DECIMALS_MAX);
+
+	char * dest = sbuf_extend(sb, FORMAT_DOUBLE_LENGTH_MAX);
+	return (dest != NULL) ? sbuf_commit(sb, format_double_fixed(dest, value, decimals)) : NULL;
+}
+
+
+char *
+sbuf_append_key(sbuf_t * sb, const char * restrict key) {
+	assert(sb != NULL && key != NULL);
+
+	// Opening quote, key, closing quote, colon, space, and zero byte.
+	size_t length = strlen(key);
+	if (sbuf_ensure_capacity(sb, length + 5) == NULL) {
+		return NULL;
+	}
+
+	char * dest = __sbuf_next_ptr(sb);
+	dest[0] = '"';
+	memcpy(&dest[1], key, length);
+	memcpy(&dest[1 + length], "\": ", 4);
+
+	sb->next += length + 4;
+	return sb->data;
 }
 
 
@@ -191,7 +340,9 @@ sbuf_set_format(sbuf_t * sb, const char * restrict format, ...) {
 char *
 sbuf_set(sbuf_t * sb, const char * restrict str) {
 	assert(sb != NULL);
-	return sbuf_set_format(sb, "%s", str);
+
+	sbuf_clear(sb);
+	return sbuf_append(sb, str);
 }
 
 
@@ -0,0 +1,855 @@
+/**
+ * Compiled schema of a signal set.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fivis/debug.h>
+#include <fivis/entry.h>
+#include <fivis/format.h>
+#include <fivis/json.h>
+#include <fivis/schema.h>
+#include <fivis/sbchain.h>
+#include <fivis/sbuf.h>
+#include <fivis/workers.h>
+
+//
+
+/*
+ * Record delimiters. All of them must have the same length, because the
+ * delimiter following a record is only known after the record is formatted.
+ */
+#define RECORD_START "\n{ "
+#define RECORD_NEXT " },"
+#define RECORD_LAST " }\n"
+
+#define RECORD_END RECORD_NEXT
+
+/*
+ * Delimiters of records formatted one at a time, with the separator
+ * preceding a record. RECORD_CLOSE followed by RECORD_SEPARATOR makes
+ * RECORD_NEXT.
+ */
+#define RECORD_CLOSE " }"
+#define RECORD_SEPARATOR ','
+
+//
+
+/**
+ * Renders the prefix of the given signal into the prefix buffer. Entries
+ * of built-in types get the delimiter and their escaped name, custom entries
+ * only get the delimiter. Returns true on success, false on failure.
+ */
+static bool
+__render_prefix(
+	struct schema_signal * signal, const char * delimiter,
+	struct sbuf * prefixes
+) {
+	size_t start = sbuf_length(prefixes);
+
+	if (sbuf_append(prefixes, delimiter) == NULL) {
+		return false;
+	}
+
+	if (signal->type != ENTRY_TYPE_CUSTOM) {
+		if (json_append_key(prefixes, signal->entry->name) == NULL) {
+			return false;
+		}
+	}
+
+	signal->prefix_length = sbuf_length(prefixes) - start;
+	return true;
+}
+
+
+/**
+ * Returns the maximum length of a formatted value of the given type, or
+ * zero if the length is not bounded.
+ */
+static size_t
+__value_length_max(enum entry_type type) {
+	switch (type) {
+	case ENTRY_TYPE_BOOLEAN:
+		return strlen("false");
+
+	case ENTRY_TYPE_SIGNED:
+		return FORMAT_INT64_LENGTH_MAX;
+
+	case ENTRY_TYPE_DOUBLE:
+		return FORMAT_DOUBLE_LENGTH_MAX;
+
+	default:
+		return 0;
+	}
+}
+
+
+/**
+ * Returns the assumed typical length of a formatted value of the given
+ * type, which is used when estimating the size of formatted data. For
+ * types with bounded value length, this is the maximum length.
+ */
+static size_t
+__value_length_estimate(enum entry_type type) {
+	switch (type) {
+	case ENTRY_TYPE_DATETIME:
+		// Quoted "YYYY-MM-DDTHH:MM:SS.mmmZ".
+		return 26;
+
+	case ENTRY_TYPE_STRING:
+	case ENTRY_TYPE_CUSTOM:
+		return 32;
+
+	default:
+		return __value_length_max(type);
+	}
+}
+
+
+static inline struct schema_signal
+__schema_signal(struct entry * entry) {
+	return (struct schema_signal) {
+		.prefix = NULL,
+		.prefix_length = 0,
+		.type = entry->type,
+		.precision = entry->precision,
+		.value_length_max = __value_length_max(entry->type),
+		.run_length = 1,
+		.entry = entry,
+	};
+}
+
+
+struct schema *
+schema_compile(struct entry * id_signal, struct list * signals) {
+	assert(id_signal != NULL);
+
+	size_t signal_count = 1 + ((signals != NULL) ? list_size(signals) : 0);
+
+	struct schema * schema = (struct schema *) malloc(sizeof(struct schema));
+	if (schema == NULL) {
+		debug("schema: failed to allocate compiled schema\n");
+		goto fail_schema;
+	}
+
+	struct schema_signal * array = calloc(signal_count, sizeof(struct schema_signal));
+	if (array == NULL) {
+		debug("schema: failed to allocate %zu signals\n", signal_count);
+		goto fail_array;
+	}
+
+	//
+	// Render the prefixes of all signals into a single buffer. The 'id'
+	// signal starts a record, so it has no delimiter. Then render the
+	// types of the other signals, which are needed for the 'schema'
+	// attribute of a request.
+	//
+	struct sbuf prefixes = SBUF_INIT();
+	struct sbuf types = SBUF_INIT();
+
+	array[0] = __schema_signal(id_signal);
+	if (!__render_prefix(&array[0], "", &prefixes)) {
+		goto fail_render;
+	}
+
+	if (signals != NULL) {
+		size_t index = 1;
+
+		struct entry * signal;
+		list_for_each_item(signal, signals, link) {
+			array[index] = __schema_signal(signal);
+			if (!__render_prefix(&array[index], ", ", &prefixes)) {
+				goto fail_render;
+			}
+
+			if (index > 1 && sbuf_append_literal(&types, ", ") == NULL) {
+				goto fail_render;
+			}
+
+			if (entry_format_type(signal, &types) == NULL) {
+				goto fail_render;
+			}
+
+			index++;
+		}
+	}
+
+	//
+	// The prefixes are stored back to back, so the prefix pointers can
+	// be computed only now that the buffer will not be reallocated.
+	//
+	const char * prefix = sbuf_string(&prefixes);
+	size_t record_length_max = strlen(RECORD_START) + strlen(RECORD_END);
+	for (size_t index = 0; index < signal_count; index++) {
+		array[index].prefix = prefix;
+		prefix += array[index].prefix_length;
+
+		record_length_max += array[index].prefix_length + array[index].value_length_max;
+	}
+
+	// Find runs of signals with the same type, starting from the end.
+	for (size_t index = signal_count - 1; index > 0; index--) {
+		struct schema_signal * signal = &array[index - 1];
+		struct schema_signal * next = &array[index];
+		if (signal->type == next->type && signal->precision == next->precision) {
+			signal->run_length = next->run_length + 1;
+		}
+	}
+
+	*schema = (struct schema) {
+		.signal_count = signal_count,
+		.signals = array,
+		.prefixes = prefixes.data,
+		.record_length_max = record_length_max,
+		.types = types,
+	};
+
+	return schema;
+
+	//
+
+fail_render:
+	debug("schema: failed to render signal prefixes and types\n");
+	sbuf_destroy(&types);
+	sbuf_destroy(&prefixes);
+	free(array);
+fail_array:
+	free(schema);
+fail_schema:
+	return NULL;
+}
+
+
+void
+schema_destroy(struct schema * schema) {
+	assert(schema != NULL);
+
+	sbuf_destroy(&schema->types);
+
+	free(schema->prefixes);
+	schema->prefixes = NULL;
+
+	free(schema->signals);
+	schema->signals = NULL;
+
+	free(schema);
+}
+
+
+const char *
+schema_format_types(struct schema * schema, struct sbuf * output) {
+	assert(schema != NULL && output != NULL);
+
+	return sbuf_append_bytes(
+		output, sbuf_string(&schema->types), sbuf_length(&schema->types)
+	);
+}
+
+
+/**
+ * Appends the pre-rendered prefix of the given signal followed by the
+ * given value. Values of built-in types are formatted directly, only
+ * custom entries are formatted through their value formatter.
+ */
+static inline const char *
+__format_signal_value(
+	const struct schema_signal * signal, union entry_value * value,
+	struct sbuf * output
+) {
+	sbuf_append_bytes(output, signal->prefix, signal->prefix_length);
+
+	if (signal->type != ENTRY_TYPE_CUSTOM) {
+		return entry_format_typed_value(signal->type, signal->precision, value, output);
+	} else {
+		return entry_format_value(signal->entry, value, output);
+	}
+}
+
+
+size_t
+schema_estimate_data_size(struct schema * schema, size_t record_count) {
+	assert(schema != NULL);
+
+	size_t record_size = schema->record_length_max;
+	for (size_t index = 0; index < schema->signal_count; index++) {
+		const struct schema_signal * signal = &schema->signals[index];
+		if (signal->value_length_max == 0) {
+			record_size += __value_length_estimate(signal->type);
+		}
+	}
+
+	//
+	// Records are formatted into space reserved for a whole record, which
+	// may extend past the last record. Add one more record to account for
+	// that and for the terminating zero byte.
+	//
+	return (record_count + 1) * record_size;
+}
+
+
+/**
+ * Writes the pre-rendered prefix of the given signal followed by the given
+ * value directly to the destination, which must have enough room for the
+ * prefix and the maximum value length. Only for signals with bounded value
+ * length. Returns a pointer past the last byte written.
+ */
+static inline char *
+__write_signal_value(
+	const struct schema_signal * signal, union entry_value * value,
+	char * dest
+) {
+	memcpy(dest, signal->prefix, signal->prefix_length);
+	dest += signal->prefix_length;
+
+	switch (signal->type) {
+	case ENTRY_TYPE_BOOLEAN:
+		if (value->as_boolean) {
+			memcpy(dest, "true", 4);
+			return dest + 4;
+		} else {
+			memcpy(dest, "false", 5);
+			return dest + 5;
+		}
+
+	case ENTRY_TYPE_SIGNED:
+		return format_int64(dest, value->as_signed);
+
+	case ENTRY_TYPE_DOUBLE:
+		return (signal->precision == ENTRY_PRECISION_SHORTEST)
+			? format_double(dest, value->as_double)
+			: format_double_fixed(dest, value->as_double, signal->precision);
+
+	default:
+		assert(false && "signal value length is not bounded");
+		return dest;
+	}
+}
+
+
+/**
+ * Formats the values of a data record, starting with the given 'id' signal
+ * value, into space reserved for the whole record. Returns the pointer past
+ * the last byte written (within space reserved for the rest of the record),
+ * or NULL on failure.
+ */
+static inline char *
+__format_record_values(
+	struct schema * schema, union entry_value * value,
+	union entry_value * (* next_value) (void *), void * next_value_state,
+	char * dest, struct sbuf * output
+) {
+	const struct schema_signal * first = &schema->signals[0];
+	const struct schema_signal * end = &schema->signals[schema->signal_count];
+
+	for (const struct schema_signal * signal = first; signal < end; signal++) {
+		if (signal != first) {
+			value = next_value(next_value_state);
+			if (value == NULL) {
+				continue;
+			}
+		}
+
+		if (signal->value_length_max > 0) {
+			dest = __write_signal_value(signal, value, dest);
+
+		} else {
+			//
+			// Values of unbounded length are appended to the buffer the
+			// usual way, followed by a new reservation.
+			//
+			sbuf_commit(output, dest);
+			if (__format_signal_value(signal, value, output) == NULL) {
+				return NULL;
+			}
+
+			dest = sbuf_extend(output, schema->record_length_max);
+			if (dest == NULL) {
+				return NULL;
+			}
+		}
+	}
+
+	return dest;
+}
+
+
+const char *
+schema_format_data(
+	struct schema * schema,
+	union entry_value * (* next_value) (void *), void * next_value_state,
+	struct sbuf * output
+) {
+	assert(schema != NULL && next_value != NULL && output != NULL);
+
+	union entry_value * value = next_value(next_value_state);
+	while (value != NULL) {
+		//
+		// Reserve space for the whole record up front, so that values of
+		// bounded length can be written directly, without checking the
+		// buffer capacity.
+		//
+		char * dest = sbuf_extend(output, schema->record_length_max);
+		if (dest == NULL) {
+			return NULL;
+		}
+
+		memcpy(dest, RECORD_START, strlen(RECORD_START));
+		dest += strlen(RECORD_START);
+
+		dest = __format_record_values(schema, value, next_value, next_value_state, dest, output);
+		if (dest == NULL) {
+			return NULL;
+		}
+
+		value = next_value(next_value_state);
+		const char * record_end = (value != NULL) ? RECORD_NEXT : RECORD_LAST;
+		memcpy(dest, record_end, strlen(RECORD_END));
+		sbuf_commit(output, dest + strlen(RECORD_END));
+	}
+
+	return sbuf_string(output);
+}
+
+
+const char *
+schema_format_record(
+	struct schema * schema, union entry_value * id_value,
+	union entry_value * (* next_value) (void *), void * next_value_state,
+	bool first_record, struct sbuf * output
+) {
+	assert(schema != NULL && id_value != NULL && next_value != NULL && output != NULL);
+
+	//
+	// The separator precedes the record instead of following it, so that
+	// the next record does not need to be known. The separator and the
+	// record start are as long as the record start and end, so the output
+	// is identical to that of schema_format_data().
+	//
+	char * dest = sbuf_extend(output, schema->record_length_max);
+	if (dest == NULL) {
+		return NULL;
+	}
+
+	if (!first_record) {
+		*dest++ = RECORD_SEPARATOR;
+	}
+
+	memcpy(dest, RECORD_START, strlen(RECORD_START));
+	dest += strlen(RECORD_START);
+
+	dest = __format_record_values(schema, id_value, next_value, next_value_state, dest, output);
+	if (dest == NULL) {
+		return NULL;
+	}
+
+	memcpy(dest, RECORD_CLOSE, strlen(RECORD_CLOSE));
+	return sbuf_commit(output, dest + strlen(RECORD_CLOSE));
+}
+
+
+const char *
+schema_format_records_end(size_t record_count, struct sbuf * output) {
+	assert(output != NULL);
+
+	// Same as the end of the last record in RECORD_LAST.
+	return (record_count > 0) ? sbuf_append_char(output, '\n') : sbuf_string(output);
+}
+
+
+/** Returns a pointer to the value of the given column in the given row. */
+static inline const void *
+__column_value(const struct schema_column * column, size_t row) {
+	return (const char *) column->data + row * column->stride;
+}
+
+
+/**
+ * Loads the value of the given column in the given row into an entry
+ * value, depending on the type of the given signal.
+ */
+static inline union entry_value
+__load_column_value(
+	const struct schema_signal * signal, const struct schema_column * column,
+	size_t row
+) {
+	const void * value = __column_value(column, row);
+
+	switch (signal->type) {
+	case ENTRY_TYPE_BOOLEAN:
+		return (union entry_value) { .as_boolean = *(const bool *) value };
+
+	case ENTRY_TYPE_SIGNED:
+		return (union entry_value) { .as_signed = *(const int64_t *) value };
+
+	case ENTRY_TYPE_DOUBLE:
+		return (union entry_value) { .as_double = *(const double *) value };
+
+	case ENTRY_TYPE_STRING:
+		return (union entry_value) { .as_string = *(const char * const *) value };
+
+	case ENTRY_TYPE_DATETIME:
+		return (union entry_value) { .as_timespec = *(const struct timespec *) value };
+
+	default:
+		return *(const union entry_value *) value;
+	}
+}
+
+
+/** Copies the pre-rendered prefix of the given signal to the destination. */
+static inline char *
+__write_prefix(const struct schema_signal * signal, char * dest) {
+	memcpy(dest, signal->prefix, signal->prefix_length);
+	return dest + signal->prefix_length;
+}
+
+
+/**
+ * Formats a single data record from the given row of a batch. Runs of
+ * signals with the same type are formatted in type-specialized loops.
+ * Returns the pointer past the last byte written (within space reserved
+ * for the whole record), or NULL on failure.
+ */
+static inline char *
+__format_batch_record(
+	struct schema * schema, const struct schema_column * columns, size_t row,
+	char * dest, struct sbuf * output
+) {
+	const struct schema_signal * signals = schema->signals;
+
+	size_t index = 0;
+	while (index < schema->signal_count) {
+		const struct schema_signal * signal = &signals[index];
+		size_t run_end = index + signal->run_length;
+
+		switch (signal->type) {
+		case ENTRY_TYPE_DOUBLE:
+			if (signal->precision == ENTRY_PRECISION_SHORTEST) {
+				for (; index < run_end; index++) {
+					double value = *(const double *) __column_value(&columns[index], row);
+					dest = __write_prefix(&signals[index], dest);
+					dest = format_double(dest, value);
+				}
+
+			} else {
+				unsigned int decimals = signal->precision;
+				for (; index < run_end; index++) {
+					double value = *(const double *) __column_value(&columns[index], row);
+					dest = __write_prefix(&signals[index], dest);
+					dest = format_double_fixed(dest, value, decimals);
+				}
+			}
+			break;
+
+		case ENTRY_TYPE_SIGNED:
+			for (; index < run_end; index++) {
+				int64_t value = *(const int64_t *) __column_value(&columns[index], row);
+				dest = __write_prefix(&signals[index], dest);
+				dest = format_int64(dest, value);
+			}
+			break;
+
+		case ENTRY_TYPE_BOOLEAN:
+			for (; index < run_end; index++) {
+				union entry_value value = __load_column_value(&signals[index], &columns[index], row);
+				dest = __write_signal_value(&signals[index], &value, dest);
+			}
+			break;
+
+		default:
+			//
+			// Values of unbounded length are appended to the buffer the
+			// usual way, followed by a new reservation for the rest of
+			// the record.
+			//
+			for (; index < run_end; index++) {
+				union entry_value value = __load_column_value(&signals[index], &columns[index], row);
+
+				sbuf_commit(output, dest);
+				if (__format_signal_value(&signals[index], &value, output) == NULL) {
+					return NULL;
+				}
+
+				dest = sbuf_extend(output, schema->record_length_max);
+				if (dest == NULL) {
+					return NULL;
+				}
+			}
+		}
+	}
+
+	return dest;
+}
+
+
+/** Returns the total number of rows in the given batches. */
+static size_t
+__batches_row_count(const struct schema_batch * batches, size_t batch_count) {
+	size_t result = 0;
+	for (size_t index = 0; index < batch_count; index++) {
+		result += batches[index].row_count;
+	}
+
+	return result;
+}
+
+
+/**
+ * Formats data records from the given range of rows, where rows are
+ * numbered consecutively across all batches. Only the last of all rows
+ * is followed by the delimiter ending the data. Returns a pointer to the
+ * contents of the output buffer on success, NULL on failure.
+ */
+static const char *
+__format_batch_rows(
+	struct schema * schema,
+	const struct schema_batch * batches, size_t batch_count,
+	size_t row_begin, size_t row_end, size_t row_total,
+	struct sbuf * output
+) {
+	assert(row_begin <= row_end && (row_begin == row_end || batch_count > 0));
+
+	// Find the batch containing the first row.
+	const struct schema_batch * batch = batches;
+	const struct schema_batch * batch_end = batches + batch_count;
+	size_t row = row_begin;
+	while (row_begin < row_end && row >= batch->row_count) {
+		assert(batch + 1 < batch_end);
+		row -= batch->row_count;
+		batch++;
+	}
+
+	for (size_t index = row_begin; index < row_end; index++, row++) {
+		// Skip to the next non-empty batch.
+		while (row >= batch->row_count) {
+			assert(batch + 1 < batch_end);
+			row = 0;
+			batch++;
+		}
+
+		// Reserve space for the whole record, see schema_format_data().
+		char * dest = sbuf_extend(output, schema->record_length_max);
+		if (dest == NULL) {
+			return NULL;
+		}
+
+		memcpy(dest, RECORD_START, strlen(RECORD_START));
+		dest += strlen(RECORD_START);
+
+		dest = __format_batch_record(schema, batch->columns, row, dest, output);
+		if (dest == NULL) {
+			return NULL;
+		}
+
+		bool last = (index + 1 == row_total);
+		memcpy(dest, last ? RECORD_LAST : RECORD_NEXT, strlen(RECORD_END));
+		sbuf_commit(output, dest + strlen(RECORD_END));
+	}
+
+	return sbuf_string(output);
+}
+
+
+const char *
+schema_format_batches(
+	struct schema * schema,
+	const struct schema_batch * batches, size_t batch_count,
+	struct sbuf * output
+) {
+	assert(schema != NULL && (batches != NULL || batch_count == 0) && output != NULL);
+
+	size_t row_total = __batches_row_count(batches, batch_count);
+	return __format_batch_rows(
+		schema, batches, batch_count, 0, row_total, row_total, output
+	);
+}
+
+//
+
+/** Minimum number of rows formatted by a single parallel task. */
+static const size_t parallel_chunk_rows_min = 64;
+
+/** Number of chunks per thread, which helps balance the load. */
+static const size_t parallel_chunks_per_thread = 4;
+
+
+/** Describes the formatting of a batch split into chunks of rows. */
+struct parallel_format {
+	struct schema * schema;
+	const struct schema_batch * batches;
+	size_t batch_count;
+
+	size_t row_total;
+	size_t chunk_count;
+
+	/** Output buffers of the chunks. */
+	struct sbuf * outputs;
+
+	/** Set when formatting of any chunk fails. */
+	bool failed;
+};
+
+
+/** Returns the first row of the given chunk. */
+static inline size_t
+__chunk_row_begin(const struct parallel_format * format, size_t chunk) {
+	return (format->row_total * chunk) / format->chunk_count;
+}
+
+
+/** Formats a chunk of rows into the chunk output buffer. */
+static void
+__format_chunk(void * arg, size_t chunk) {
+	struct parallel_format * format = (struct parallel_format *) arg;
+
+	size_t row_begin = __chunk_row_begin(format, chunk);
+	size_t row_end = __chunk_row_begin(format, chunk + 1);
+
+	struct sbuf * output = &format->outputs[chunk];
+	sbuf_reserve(output, schema_estimate_data_size(format->schema, row_end - row_begin));
+
+	const char * result = __format_batch_rows(
+		format->schema, format->batches, format->batch_count,
+		row_begin, row_end, format->row_total, output
+	);
+
+	if (result == NULL) {
+		__atomic_store_n(&format->failed, true, __ATOMIC_RELAXED);
+	}
+}
+
+
+const char *
+schema_format_batches_parallel(
+	struct schema * schema,
+	const struct schema_batch * batches, size_t batch_count,
+	struct workers * workers, struct sbuf * output
+) {
+	assert(schema != NULL && (batches != NULL || batch_count == 0) && output != NULL);
+
+	//
+	// Split the rows into chunks, but only if there are enough rows to
+	// make it worthwhile. Otherwise format the rows in the calling thread.
+	//
+	size_t row_total = __batches_row_count(batches, batch_count);
+	size_t thread_count = (workers != NULL) ? workers_thread_count(workers) : 1;
+
+	size_t chunk_count = row_total / parallel_chunk_rows_min;
+	if (chunk_count > thread_count * parallel_chunks_per_thread) {
+		chunk_count = thread_count * parallel_chunks_per_thread;
+	}
+
+	if (thread_count < 2 || chunk_count < 2) {
+		return __format_batch_rows(
+			schema, batches, batch_count, 0, row_total, row_total, output
+		);
+	}
+
+	struct sbuf * outputs = (struct sbuf *) calloc(chunk_count, sizeof(struct sbuf));
+	if (outputs == NULL) {
+		debug("schema: failed to allocate %zu chunk buffers\n", chunk_count);
+		return NULL;
+	}
+
+	struct parallel_format format = {
+		.schema = schema,
+		.batches = batches,
+		.batch_count = batch_count,
+		.row_total = row_total,
+		.chunk_count = chunk_count,
+		.outputs = outputs,
+		.failed = false,
+	};
+
+	workers_run(workers, chunk_count, __format_chunk, &format);
+
+	//
+	// Stitch the chunks together in order. The chunks already contain
+	// the record delimiters, only the last record ends the data.
+	//
+	const char * result = format.failed ? NULL : sbuf_string(output);
+	for (size_t chunk = 0; chunk < chunk_count; chunk++) {
+		if (result != NULL) {
+			result = sbuf_append_bytes(
+				output, sbuf_string(&outputs[chunk]), sbuf_length(&outputs[chunk])
+			);
+		}
+
+		sbuf_destroy(&outputs[chunk]);
+	}
+
+	free(outputs);
+	return result;
+}
+
+bool
+schema_format_data_chain(
+	struct schema * schema,
+	union entry_value * (* next_value) (void *), void * next_value_state,
+	struct sbchain * output
+) {
+	assert(schema != NULL && next_value != NULL && output != NULL);
+
+	const struct schema_signal * first = &schema->signals[0];
+	const struct schema_signal * end = &schema->signals[schema->signal_count];
+
+	//
+	// Records may be larger than a segment, so the space is reserved for
+	// each value separately. Values of unbounded length (and values with
+	// extremely long prefixes) are formatted into a scratch buffer first.
+	//
+	sbuf_t scratch = SBUF_INIT();
+
+	union entry_value * value = next_value(next_value_state);
+	while (value != NULL) {
+		if (!sbchain_append_literal(output, RECORD_START)) {
+			goto fail_format;
+		}
+
+		for (const struct schema_signal * signal = first; signal < end; signal++) {
+			if (signal != first) {
+				value = next_value(next_value_state);
+				if (value == NULL) {
+					continue;
+				}
+			}
+
+			size_t length_max = signal->prefix_length + signal->value_length_max;
+			if (signal->value_length_max > 0 && length_max <= SBCHAIN_SEGMENT_CAPACITY) {
+				char * dest = sbchain_extend(output, length_max);
+				if (dest == NULL) {
+					goto fail_format;
+				}
+
+				sbchain_commit(output, __write_signal_value(signal, value, dest));
+
+			} else {
+				sbuf_clear(&scratch);
+				if (__format_signal_value(signal, value, &scratch) == NULL) {
+					goto fail_format;
+				}
+
+				if (!sbchain_append_sbuf(output, &scratch)) {
+					goto fail_format;
+				}
+			}
+		}
+
+		value = next_value(next_value_state);
+		const char * record_end = (value != NULL) ? RECORD_NEXT : RECORD_LAST;
+		if (!sbchain_append_bytes(output, record_end, strlen(RECORD_END))) {
+			goto fail_format;
+		}
+	}
+
+	sbuf_destroy(&scratch);
+	return true;
+
+	//
+
+fail_format:
+	sbuf_destroy(&scratch);
+	return false;
+}
@@ -0,0 +1,694 @@
+/**
+ * Compressed buffer of time series rows.
+ */
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fivis/debug.h>
+#include <fivis/series.h>
+
+//
+
+/** Worst-case number of bits of a compressed timestamp. */
+#define SERIES_TIMESTAMP_BITS_MAX (4 + 64)
+
+/** Worst-case number of bits of a compressed value (a 10-byte varint). */
+#define SERIES_VALUE_BITS_MAX 80
+
+/** Number of bits used to store the leading zeros of a double XOR. */
+#define SERIES_LEADING_BITS 5
+
+/** Marks the leading zeros of the previous double XOR as not set. */
+#define SERIES_LEADING_NONE UINT8_MAX
+
+
+/** Represents a block of compressed rows. */
+struct series_block {
+	struct series_block * next;
+
+	size_t row_count;
+	size_t bit_count;
+
+	uint8_t data[];
+};
+
+
+/** State of encoding or decoding the rows of a block. */
+struct series_state {
+	/** Position in the block (in bits) and the number of rows passed. */
+	size_t bit;
+	size_t row;
+
+	int64_t timestamp_ns;
+	int64_t delta_ns;
+
+	/** Previous values (as raw bits) in each column. */
+	uint64_t * values;
+
+	/** Leading and trailing zeros of the previous XOR in double columns. */
+	uint8_t * leading;
+	uint8_t * trailing;
+};
+
+
+struct series {
+	series_type_t * types;
+	size_t column_count;
+
+	size_t block_size;
+	size_t block_bits;
+	size_t block_count_max;
+
+	/** Worst-case number of bits of a compressed row. */
+	size_t row_bits_max;
+
+	/** Blocks in use, from the oldest, and a released block kept for reuse. */
+	struct series_block * head;
+	struct series_block * tail;
+	struct series_block * free_blocks;
+	size_t block_count;
+
+	size_t row_count;
+
+	/** Encoder state in the last block. */
+	struct series_state writer;
+
+	/** Decoder state in the first block, at the first row not removed. */
+	struct series_state reader;
+
+	/** Decoder state used when peeking at the rows. */
+	struct series_state peeker;
+
+	/** Decoded row passed to the row function. */
+	union entry_value * row;
+};
+
+//
+
+static inline void
+__write_bits(uint8_t * data, size_t * bit, uint64_t value, unsigned int count) {
+	while (count > 0) {
+		size_t byte = *bit >> 3;
+		unsigned int room = 8 - (*bit & 7);
+		unsigned int take = (count < room) ? count : room;
+
+		uint8_t chunk = (value >> (count - take)) & ((1u << take) - 1);
+		uint8_t kept = (room == 8) ? 0 : data[byte];
+		data[byte] = kept | (uint8_t) (chunk << (room - take));
+
+		*bit += take;
+		count -= take;
+	}
+}
+
+
+static inline uint64_t
+__read_bits(const uint8_t * data, size_t * bit, unsigned int count) {
+	uint64_t result = 0;
+	while (count > 0) {
+		size_t byte = *bit >> 3;
+		unsigned int room = 8 - (*bit & 7);
+		unsigned int take = (count < room) ? count : room;
+
+		uint64_t chunk = (data[byte] >> (room - take)) & ((1u << take) - 1);
+		result = (take < 64) ? (result << take) | chunk : chunk;
+
+		*bit += take;
+		count -= take;
+	}
+
+	return result;
+}
+
+
+static inline bool
+__fits_signed(int64_t value, unsigned int bits) {
+	int64_t limit = (int64_t) 1 << (bits - 1);
+	return value >= -limit && value < limit;
+}
+
+
+static inline int64_t
+__sign_extend(uint64_t value, unsigned int bits) {
+	uint64_t sign = (uint64_t) 1 << (bits - 1);
+	return (int64_t) ((value ^ sign) - sign);
+}
+
+
+static inline int64_t
+__timespec_ns(const struct timespec * timestamp) {
+	return (int64_t) timestamp->tv_sec * 1000000000 + timestamp->tv_nsec;
+}
+
+//
+
+/**
+ * Delta-of-delta buckets of timestamps: the number of prefix bits and
+ * the number of value bits. The last bucket holds any value.
+ */
+static const struct {
+	uint64_t prefix;
+	unsigned int prefix_bits;
+	unsigned int value_bits;
+} timestamp_buckets[] = {
+	{ .prefix = 0x2, .prefix_bits = 2, .value_bits = 14 },
+	{ .prefix = 0x6, .prefix_bits = 3, .value_bits = 24 },
+	{ .prefix = 0xe, .prefix_bits = 4, .value_bits = 34 },
+	{ .prefix = 0xf, .prefix_bits = 4, .value_bits = 64 },
+};
+
+static const size_t timestamp_bucket_count = sizeof(timestamp_buckets) / sizeof(timestamp_buckets[0]);
+
+
+static void
+__encode_timestamp(uint8_t * data, struct series_state * state, int64_t timestamp_ns) {
+	if (state->row == 0) {
+		__write_bits(data, &state->bit, (uint64_t) timestamp_ns, 64);
+		state->delta_ns = 0;
+
+	} else {
+		int64_t delta_ns = timestamp_ns - state->timestamp_ns;
+		int64_t dod_ns = delta_ns - state->delta_ns;
+
+		if (dod_ns == 0) {
+			__write_bits(data, &state->bit, 0, 1);
+
+		} else {
+			for (size_t index = 0; index < timestamp_bucket_count; index++) {
+				unsigned int value_bits = timestamp_buckets[index].value_bits;
+				if (value_bits == 64 || __fits_signed(dod_ns, value_bits)) {
+					__write_bits(data, &state->bit, timestamp_buckets[index].prefix, timestamp_buckets[index].prefix_bits);
+					__write_bits(data, &state->bit, (uint64_t) dod_ns, value_bits);
+					break;
+				}
+			}
+		}
+
+		state->delta_ns = delta_ns;
+	}
+
+	state->timestamp_ns = timestamp_ns;
+}
+
+
+static int64_t
+__decode_timestamp(const uint8_t * data, struct series_state * state) {
+	if (state->row == 0) {
+		state->timestamp_ns = (int64_t) __read_bits(data, &state->bit, 64);
+		state->delta_ns = 0;
+		return state->timestamp_ns;
+	}
+
+	int64_t dod_ns = 0;
+	if (__read_bits(data, &state->bit, 1) != 0) {
+		// Count the ones in the prefix to find the bucket.
+		size_t index = 0;
+		while (index + 1 < timestamp_bucket_count && __read_bits(data, &state->bit, 1) != 0) {
+			index++;
+		}
+
+		unsigned int value_bits = timestamp_buckets[index].value_bits;
+		dod_ns = __sign_extend(__read_bits(data, &state->bit, value_bits), value_bits);
+	}
+
+	state->delta_ns += dod_ns;
+	state->timestamp_ns += state->delta_ns;
+	return state->timestamp_ns;
+}
+
+//
+
+static void
+__encode_unsigned(uint8_t * data, struct series_state * state, size_t column, uint64_t value) {
+	if (state->row == 0) {
+		__write_bits(data, &state->bit, value, 64);
+
+	} else {
+		// Zigzag-encode the delta and write it in 7-bit groups.
+		int64_t delta = (int64_t) (value - state->values[column]);
+		uint64_t zigzag = ((uint64_t) delta << 1) ^ (uint64_t) (delta >> 63);
+
+		while (zigzag >= 0x80) {
+			__write_bits(data, &state->bit, 0x80 | (zigzag & 0x7f), 8);
+			zigzag >>= 7;
+		}
+
+		__write_bits(data, &state->bit, zigzag, 8);
+	}
+
+	state->values[column] = value;
+}
+
+
+static uint64_t
+__decode_unsigned(const uint8_t * data, struct series_state * state, size_t column) {
+	if (state->row == 0) {
+		state->values[column] = __read_bits(data, &state->bit, 64);
+		return state->values[column];
+	}
+
+	uint64_t zigzag = 0;
+	for (unsigned int shift = 0; ; shift += 7) {
+		uint64_t group = __read_bits(data, &state->bit, 8);
+		zigzag |= (group & 0x7f) << shift;
+		if ((group & 0x80) == 0) {
+			break;
+		}
+	}
+
+	int64_t delta = (int64_t) (zigzag >> 1) ^ -(int64_t) (zigzag & 1);
+	state->values[column] += (uint64_t) delta;
+	return state->values[column];
+}
+
+//
+
+static void
+__encode_double(uint8_t * data, struct series_state * state, size_t column, uint64_t bits) {
+	if (state->row == 0) {
+		__write_bits(data, &state->bit, bits, 64);
+		state->leading[column] = SERIES_LEADING_NONE;
+		state->values[column] = bits;
+		return;
+	}
+
+	uint64_t xor = bits ^ state->values[column];
+	state->values[column] = bits;
+
+	if (xor == 0) {
+		__write_bits(data, &state->bit, 0, 1);
+		return;
+	}
+
+	unsigned int leading = __builtin_clzll(xor);
+	unsigned int trailing = __builtin_ctzll(xor);
+	if (leading >= (1u << SERIES_LEADING_BITS)) {
+		leading = (1u << SERIES_LEADING_BITS) - 1;
+	}
+
+	//
+	// Reuse the window of meaningful bits of the previous XOR if the
+	// meaningful bits fit into it, otherwise store a new window.
+	//
+	uint8_t prev_leading = state->leading[column];
+	if (prev_leading != SERIES_LEADING_NONE && leading >= prev_leading && trailing >= state->trailing[column]) {
+		unsigned int length = 64 - prev_leading - state->trailing[column];
+		__write_bits(data, &state->bit, 0x2, 2);
+		__write_bits(data, &state->bit, xor >> state->trailing[column], length);
+
+	} else {
+		unsigned int length = 64 - leading - trailing;
+		__write_bits(data, &state->bit, 0x3, 2);
+		__write_bits(data, &state->bit, leading, SERIES_LEADING_BITS);
+		__write_bits(data, &state->bit, length - 1, 6);
+		__write_bits(data, &state->bit, xor >> trailing, length);
+
+		state->leading[column] = (uint8_t) leading;
+		state->trailing[column] = (uint8_t) trailing;
+	}
+}
+
+
+static uint64_t
+__decode_double(const uint8_t * data, struct series_state * state, size_t column) {
+	if (state->row == 0) {
+		state->leading[column] = SERIES_LEADING_NONE;
+		state->values[column] = __read_bits(data, &state->bit, 64);
+		return state->values[column];
+	}
+
+	if (__read_bits(data, &state->bit, 1) == 0) {
+		return state->values[column];
+	}
+
+	if (__read_bits(data, &state->bit, 1) != 0) {
+		unsigned int leading = __read_bits(data, &state->bit, SERIES_LEADING_BITS);
+		unsigned int length = __read_bits(data, &state->bit, 6) + 1;
+
+		state->leading[column] = (uint8_t) leading;
+		state->trailing[column] = (uint8_t) (64 - leading - length);
+	}
+
+	unsigned int trailing = state->trailing[column];
+	unsigned int length = 64 - state->leading[column] - trailing;
+	uint64_t xor = __read_bits(data, &state->bit, length) << trailing;
+
+	state->values[column] ^= xor;
+	return state->values[column];
+}
+
+//
+
+static void
+__encode_row(
+	struct series * series, struct series_block * block,
+	const struct timespec * timestamp, const union entry_value * values
+) {
+	struct series_state * state = &series->writer;
+	__encode_timestamp(block->data, state, __timespec_ns(timestamp));
+
+	for (size_t column = 0; column < series->column_count; column++) {
+		if (series->types[column] == SERIES_DOUBLE) {
+			uint64_t bits;
+			memcpy(&bits, &values[column].as_double, sizeof(bits));
+			__encode_double(block->data, state, column, bits);
+		} else {
+			__encode_unsigned(block->data, state, column, values[column].as_unsigned);
+		}
+	}
+
+	state->row++;
+	block->row_count++;
+	block->bit_count = state->bit;
+}
+
+
+static void
+__decode_row(
+	struct series * series, const struct series_block * block,
+	struct series_state * state, struct timespec * timestamp
+) {
+	int64_t timestamp_ns = __decode_timestamp(block->data, state);
+	timestamp->tv_sec = timestamp_ns / 1000000000;
+	timestamp->tv_nsec = timestamp_ns % 1000000000;
+
+	for (size_t column = 0; column < series->column_count; column++) {
+		if (series->types[column] == SERIES_DOUBLE) {
+			uint64_t bits = __decode_double(block->data, state, column);
+			memcpy(&series->row[column].as_double, &bits, sizeof(bits));
+		} else {
+			series->row[column].as_unsigned = __decode_unsigned(block->data, state, column);
+		}
+	}
+
+	state->row++;
+}
+
+
+static inline void
+__state_restart(struct series_state * state) {
+	state->bit = 0;
+	state->row = 0;
+}
+
+
+static void
+__state_copy(const struct series * series, struct series_state * dst, const struct series_state * src) {
+	dst->bit = src->bit;
+	dst->row = src->row;
+	dst->timestamp_ns = src->timestamp_ns;
+	dst->delta_ns = src->delta_ns;
+
+	size_t count = series->column_count;
+	memcpy(dst->values, src->values, count * sizeof(uint64_t));
+	memcpy(dst->leading, src->leading, count * sizeof(uint8_t));
+	memcpy(dst->trailing, src->trailing, count * sizeof(uint8_t));
+}
+
+//
+
+size_t
+series_block_size_min(size_t column_count) {
+	// The first row (stored uncompressed) and a compressed row.
+	size_t first_bits = 64 + 64 * column_count;
+	size_t row_bits = SERIES_TIMESTAMP_BITS_MAX + SERIES_VALUE_BITS_MAX * column_count;
+	return sizeof(struct series_block) + (first_bits + row_bits + 7) / 8;
+}
+
+
+struct series *
+series_create(
+	const series_type_t * types, size_t column_count,
+	size_t block_size, size_t block_count
+) {
+	assert(types != NULL && block_count > 0);
+
+	if (block_size < series_block_size_min(column_count)) {
+		debug("series: block size %zu too small for %zu columns\n", block_size, column_count);
+		goto fail_block_size;
+	}
+
+	struct series * series = (struct series *) calloc(1, sizeof(struct series));
+	if (series == NULL) {
+		debug("series: failed to allocate series\n");
+		goto fail_series;
+	}
+
+	//
+	// Allocate the column types, the state arrays, and the decoded row
+	// in a single chunk of memory.
+	//
+	size_t state_size = column_count * (sizeof(uint64_t) + 2 * sizeof(uint8_t));
+	size_t arrays_size = column_count * (sizeof(series_type_t) + sizeof(union entry_value)) + 3 * state_size;
+	char * arrays = (char *) malloc(arrays_size + 1);
+	if (arrays == NULL) {
+		debug("series: failed to allocate arrays for %zu columns\n", column_count);
+		goto fail_arrays;
+	}
+
+	series->row = (union entry_value *) arrays;
+	arrays += column_count * sizeof(union entry_value);
+
+	struct series_state * states[] = { &series->writer, &series->reader, &series->peeker };
+	for (size_t index = 0; index < sizeof(states) / sizeof(states[0]); index++) {
+		states[index]->values = (uint64_t *) arrays;
+		arrays += column_count * sizeof(uint64_t);
+	}
+
+	series->types = (series_type_t *) arrays;
+	arrays += column_count * sizeof(series_type_t);
+	memcpy(series->types, types, column_count * sizeof(series_type_t));
+
+	for (size_t index = 0; index < sizeof(states) / sizeof(states[0]); index++) {
+		states[index]->leading = (uint8_t *) arrays;
+		arrays += column_count;
+		states[index]->trailing = (uint8_t *) arrays;
+		arrays += column_count;
+	}
+
+	series->column_count = column_count;
+	series->block_size = block_size;
+	series->block_bits = (block_size - sizeof(struct series_block)) * 8;
+	series->block_count_max = block_count;
+	series->row_bits_max = SERIES_TIMESTAMP_BITS_MAX + SERIES_VALUE_BITS_MAX * column_count;
+	return series;
+
+	//
+
+fail_arrays:
+	free(series);
+fail_series:
+fail_block_size:
+	return NULL;
+}
+
+
+static void
+__free_blocks(struct series_block * block) {
+	while (block != NULL) {
+		struct series_block * next = block->next;
+		free(block);
+		block = next;
+	}
+}
+
+
+void
+series_destroy(struct series * series) {
+	assert(series != NULL);
+
+	__free_blocks(series->head);
+	__free_blocks(series->free_blocks);
+
+	// The row is at the start of the chunk holding all arrays.
+	free(series->row);
+	free(series);
+}
+
+
+/**
+ * Releases the oldest block and restarts the reader at the next one. One
+ * released block is kept for the next block to be appended, the others
+ * are freed, so that a buffer which shrinks also releases its memory.
+ */
+static void
+__series_release_head(struct series * series) {
+	struct series_block * block = series->head;
+	assert(block != NULL);
+
+	series->head = block->next;
+	if (series->tail == block) {
+		series->tail = NULL;
+	}
+
+	if (series->free_blocks == NULL) {
+		block->next = NULL;
+		series->free_blocks = block;
+	} else {
+		free(block);
+	}
+
+	series->block_count--;
+
+	__state_restart(&series->reader);
+}
+
+
+bool
+series_append(
+	struct series * series, const struct timespec * timestamp,
+	const union entry_value * values
+) {
+	assert(series != NULL && timestamp != NULL && values != NULL);
+
+	struct series_block * block = series->tail;
+	if (block == NULL || block->bit_count + series->row_bits_max > series->block_bits) {
+		if (series->block_count >= series->block_count_max) {
+			return false;
+		}
+
+		block = series->free_blocks;
+		if (block != NULL) {
+			series->free_blocks = block->next;
+		} else {
+			block = (struct series_block *) malloc(series->block_size);
+			if (block == NULL) {
+				debug("series: failed to allocate block\n");
+				return false;
+			}
+		}
+
+		block->next = NULL;
+		block->row_count = 0;
+		block->bit_count = 0;
+
+		if (series->tail != NULL) {
+			series->tail->next = block;
+		} else {
+			series->head = block;
+			__state_restart(&series->reader);
+		}
+
+		series->tail = block;
+		series->block_count++;
+		__state_restart(&series->writer);
+
+		// The previous block may have had all its rows removed.
+		if (series->head != block && series->reader.row == series->head->row_count) {
+			__series_release_head(series);
+		}
+	}
+
+	__encode_row(series, block, timestamp, values);
+	series->row_count++;
+	return true;
+}
+
+
+size_t
+series_peek(struct series * series, size_t count, series_row_fn row, void * arg) {
+	assert(series != NULL && row != NULL);
+
+	struct series_state * state = &series->peeker;
+	__state_copy(series, state, &series->reader);
+
+	size_t result = 0;
+	struct series_block * block = series->head;
+	while (result < count && block != NULL) {
+		if (state->row == block->row_count) {
+			block = block->next;
+			__state_restart(state);
+			continue;
+		}
+
+		struct timespec timestamp;
+		__decode_row(series, block, state, &timestamp);
+		row(arg, result, &timestamp, series->row);
+		result++;
+	}
+
+	return result;
+}
+
+
+size_t
+series_drop(struct series * series, size_t count) {
+	assert(series != NULL);
+
+	size_t result = 0;
+	while (result < count && series->row_count > 0) {
+		struct series_block * block = series->head;
+		if (series->reader.row == block->row_count) {
+			__series_release_head(series);
+			continue;
+		}
+
+		struct timespec timestamp;
+		__decode_row(series, block, &series->reader, &timestamp);
+		series->row_count--;
+		result++;
+	}
+
+	// Release the last block when it is empty, or the first one when done.
+	if (series->row_count == 0) {
+		while (series->head != NULL) {
+			__series_release_head(series);
+		}
+	} else if (series->reader.row == series->head->row_count && series->head != series->tail) {
+		__series_release_head(series);
+	}
+
+	return result;
+}
+
+
+size_t
+series_drop_block(struct series * series) {
+	assert(series != NULL);
+
+	if (series->head == NULL) {
+		return 0;
+	}
+
+	size_t result = series->head->row_count - series->reader.row;
+	series->row_count -= result;
+	__series_release_head(series);
+	return result;
+}
+
+
+size_t
+series_row_count(const struct series * series) {
+	assert(series != NULL);
+	return series->row_count;
+}
+
+
+size_t
+series_block_count(const struct series * series) {
+	assert(series != NULL);
+	return series->block_count;
+}
+
+
+size_t
+series_block_count_max(const struct series * series) {
+	assert(series != NULL);
+	return series->block_count_max;
+}
+
+
+size_t
+series_compressed_size(const struct series * series) {
+	assert(series != NULL);
+
+	size_t result = 0;
+	for (struct series_block * block = series->head; block != NULL; block = block->next) {
+		result += (block->bit_count + 7) / 8;
+	}
+
+	return result;
+}
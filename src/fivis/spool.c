@@ -0,0 +1,649 @@
+/**
+ * Persistent spool of pending requests.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <zlib.h>
+
+#include <fivis/debug.h>
+#include <fivis/spool.h>
+
+//
+
+/** Marks the start of a complete record ("SPL1"). */
+#define SPOOL_RECORD_MAGIC ((uint32_t) 0x314c5053)
+
+/** Marks an acknowledged record ("ACKD"). */
+#define SPOOL_RECORD_ACKED ((uint32_t) 0x444b4341)
+
+/** Records start at offsets aligned to this value. */
+#define SPOOL_RECORD_ALIGN ((size_t) 8)
+
+/** Segment file names are 16 hexadecimal digits followed by this suffix. */
+#define SPOOL_SEGMENT_SUFFIX ".seg"
+#define SPOOL_SEGMENT_NAME_LENGTH (16 + sizeof(SPOOL_SEGMENT_SUFFIX) - 1)
+
+
+/**
+ * Header of a record, followed by the record data. The magic value is
+ * written last, so that a record interrupted by a crash is not found.
+ */
+struct spool_header {
+	uint32_t magic;
+	uint32_t acked;
+	uint64_t id;
+	uint64_t size;
+
+	/** Checksum of the identifier, the size, and the data. */
+	uint32_t checksum;
+	uint32_t reserved;
+};
+
+
+/** Represents a memory-mapped segment file. */
+struct spool_segment {
+	uint64_t sequence;
+
+	char * data;
+	size_t size;
+
+	/** Offset past the last record. */
+	size_t used;
+
+	/** Identifiers of the first and the last record, zero if none. */
+	uint64_t first_id;
+	uint64_t last_id;
+
+	/** Number of records not acknowledged. */
+	size_t pending;
+};
+
+
+struct spool {
+	/** Buffer holding the directory path followed by a segment name. */
+	char * path;
+	size_t path_length;
+
+	size_t segment_size;
+	size_t quota;
+
+	/** Segments ordered from the oldest, new records go to the last one. */
+	struct spool_segment * segments;
+	size_t segment_count;
+	size_t segment_capacity;
+
+	uint64_t next_sequence;
+	uint64_t next_id;
+
+	size_t disk_size;
+	size_t pending_count;
+	size_t evicted_count;
+};
+
+//
+
+static inline size_t
+__record_length(size_t size) {
+	size_t length = sizeof(struct spool_header) + size;
+	return (length + SPOOL_RECORD_ALIGN - 1) & ~(SPOOL_RECORD_ALIGN - 1);
+}
+
+
+static uint32_t
+__record_checksum(const struct spool_header * header) {
+	uLong result = crc32(0, (const Bytef *) &header->id, sizeof(header->id));
+	result = crc32(result, (const Bytef *) &header->size, sizeof(header->size));
+	return (uint32_t) crc32(result, (const Bytef *) (header + 1), header->size);
+}
+
+
+/**
+ * Returns the header of the record at the given offset of the segment,
+ * or NULL if there is no complete and intact record at the offset.
+ */
+static struct spool_header *
+__segment_record(const struct spool_segment * segment, size_t offset) {
+	if (offset + sizeof(struct spool_header) > segment->size) {
+		return NULL;
+	}
+
+	struct spool_header * header = (struct spool_header *) (segment->data + offset);
+	if (header->magic != SPOOL_RECORD_MAGIC) {
+		return NULL;
+	}
+
+	if (header->size > segment->size - offset - sizeof(struct spool_header)) {
+		return NULL;
+	}
+
+	return (__record_checksum(header) == header->checksum) ? header : NULL;
+}
+
+
+/** Scans the records of a segment mapped after a restart. */
+static void
+__segment_scan(struct spool_segment * segment) {
+	size_t offset = 0;
+
+	struct spool_header * header;
+	while ((header = __segment_record(segment, offset)) != NULL) {
+		if (segment->first_id == 0) {
+			segment->first_id = header->id;
+		}
+
+		segment->last_id = header->id;
+		if (header->acked != SPOOL_RECORD_ACKED) {
+			segment->pending++;
+		}
+
+		offset += __record_length(header->size);
+	}
+
+	// Anything past the last intact record is overwritten by new records.
+	segment->used = offset;
+}
+
+
+static const char *
+__segment_path(struct spool * spool, uint64_t sequence) {
+	snprintf(
+		spool->path + spool->path_length, SPOOL_SEGMENT_NAME_LENGTH + 2,
+		"/%016" PRIx64 SPOOL_SEGMENT_SUFFIX, sequence
+	);
+
+	return spool->path;
+}
+
+
+/**
+ * Maps the segment file with the given sequence number. If size is not
+ * zero, creates the file with the given size, otherwise opens an existing
+ * file. Returns true on success, false on failure.
+ */
+static bool
+__segment_map(
+	struct spool * spool, struct spool_segment * segment,
+	uint64_t sequence, size_t size
+) {
+	const char * path = __segment_path(spool, sequence);
+
+	int flags = (size > 0) ? (O_RDWR | O_CREAT | O_EXCL) : O_RDWR;
+	int fd = open(path, flags, 0600);
+	if (fd < 0) {
+		debug("spool: failed to open %s: %s\n", path, strerror(errno));
+		goto fail_open;
+	}
+
+	if (size > 0) {
+		if (ftruncate(fd, (off_t) size) != 0) {
+			debug("spool: failed to resize %s: %s\n", path, strerror(errno));
+			goto fail_size;
+		}
+
+	} else {
+		struct stat file_stat;
+		if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+			debug("spool: failed to get size of %s\n", path);
+			goto fail_size;
+		}
+
+		size = (size_t) file_stat.st_size;
+	}
+
+	void * data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (data == MAP_FAILED) {
+		debug("spool: failed to map %s: %s\n", path, strerror(errno));
+		goto fail_size;
+	}
+
+	// The mapping remains valid after closing the file.
+	close(fd);
+
+	*segment = (struct spool_segment) {
+		.sequence = sequence,
+		.data = (char *) data,
+		.size = size,
+	};
+
+	return true;
+
+	//
+
+fail_size:
+	close(fd);
+	if (flags & O_CREAT) {
+		unlink(path);
+	}
+fail_open:
+	return false;
+}
+
+
+/** Appends a segment to the list of segments. */
+static bool
+__spool_push_segment(struct spool * spool, const struct spool_segment * segment) {
+	if (spool->segment_count == spool->segment_capacity) {
+		size_t capacity = (spool->segment_capacity > 0) ? 2 * spool->segment_capacity : 8;
+		struct spool_segment * segments = (struct spool_segment *) realloc(
+			spool->segments, capacity * sizeof(struct spool_segment)
+		);
+
+		if (segments == NULL) {
+			debug("spool: failed to allocate %zu segments\n", capacity);
+			return false;
+		}
+
+		spool->segments = segments;
+		spool->segment_capacity = capacity;
+	}
+
+	spool->segments[spool->segment_count++] = *segment;
+	spool->disk_size += segment->size;
+	spool->pending_count += segment->pending;
+	return true;
+}
+
+
+/**
+ * Removes the segment with the given index, including the segment file.
+ * The pending records of the segment are counted as evicted.
+ */
+static void
+__spool_remove_segment(struct spool * spool, size_t index) {
+	assert(index < spool->segment_count);
+
+	struct spool_segment * segment = &spool->segments[index];
+	if (segment->pending > 0) {
+		warn("spool: evicting %zu pending records\n", segment->pending);
+		spool->evicted_count += segment->pending;
+		spool->pending_count -= segment->pending;
+	}
+
+	munmap(segment->data, segment->size);
+	unlink(__segment_path(spool, segment->sequence));
+	spool->disk_size -= segment->size;
+
+	spool->segment_count--;
+	memmove(
+		segment, segment + 1,
+		(spool->segment_count - index) * sizeof(struct spool_segment)
+	);
+}
+
+
+/**
+ * Removes the segments without pending records, except the last segment,
+ * which still receives new records.
+ */
+static void
+__spool_collect(struct spool * spool) {
+	size_t index = 0;
+	while (index + 1 < spool->segment_count) {
+		if (spool->segments[index].pending == 0) {
+			__spool_remove_segment(spool, index);
+		} else {
+			index++;
+		}
+	}
+}
+
+
+static int
+__compare_sequences(const void * a, const void * b) {
+	uint64_t first = *(const uint64_t *) a;
+	uint64_t second = *(const uint64_t *) b;
+	return (first > second) - (first < second);
+}
+
+
+/**
+ * Lists the sequence numbers of the segment files in the spool directory
+ * in ascending order. Returns the number of segments, or -1 on failure.
+ */
+static ssize_t
+__spool_list_segments(struct spool * spool, uint64_t ** sequences) {
+	spool->path[spool->path_length] = '\0';
+
+	DIR * dir = opendir(spool->path);
+	if (dir == NULL) {
+		debug("spool: failed to open directory %s: %s\n", spool->path, strerror(errno));
+		return -1;
+	}
+
+	size_t count = 0;
+	size_t capacity = 0;
+	uint64_t * result = NULL;
+
+	struct dirent * entry;
+	while ((entry = readdir(dir)) != NULL) {
+		const char * name = entry->d_name;
+		if (strlen(name) != SPOOL_SEGMENT_NAME_LENGTH || strcmp(name + 16, SPOOL_SEGMENT_SUFFIX) != 0) {
+			continue;
+		}
+
+		if (strspn(name, "0123456789abcdef") != 16) {
+			continue;
+		}
+
+		if (count == capacity) {
+			capacity = (capacity > 0) ? 2 * capacity : 16;
+			uint64_t * grown = (uint64_t *) realloc(result, capacity * sizeof(uint64_t));
+			if (grown == NULL) {
+				debug("spool: failed to allocate %zu sequence numbers\n", capacity);
+				free(result);
+				closedir(dir);
+				return -1;
+			}
+
+			result = grown;
+		}
+
+		result[count++] = strtoull(name, NULL, 16);
+	}
+
+	closedir(dir);
+
+	// The result is NULL for an empty directory.
+	if (count > 0) {
+		qsort(result, count, sizeof(uint64_t), __compare_sequences);
+	}
+
+	*sequences = result;
+	return (ssize_t) count;
+}
+
+
+/** Maps and scans the segments left in the spool directory. */
+static bool
+__spool_recover(struct spool * spool) {
+	uint64_t * sequences = NULL;
+	ssize_t count = __spool_list_segments(spool, &sequences);
+	if (count < 0) {
+		return false;
+	}
+
+	for (ssize_t index = 0; index < count; index++) {
+		struct spool_segment segment;
+		if (!__segment_map(spool, &segment, sequences[index], 0)) {
+			// Most likely a crash before the file was resized.
+			unlink(__segment_path(spool, sequences[index]));
+			continue;
+		}
+
+		__segment_scan(&segment);
+		if (!__spool_push_segment(spool, &segment)) {
+			munmap(segment.data, segment.size);
+			free(sequences);
+			return false;
+		}
+
+		spool->next_sequence = segment.sequence + 1;
+		if (segment.last_id >= spool->next_id) {
+			spool->next_id = segment.last_id + 1;
+		}
+	}
+
+	free(sequences);
+
+	debug(
+		"spool: recovered %zu pending records in %zu segments\n",
+		spool->pending_count, spool->segment_count
+	);
+
+	__spool_collect(spool);
+	return true;
+}
+
+
+struct spool *
+spool_open(const char * path, size_t segment_size, size_t quota) {
+	assert(path != NULL && segment_size > 0);
+
+	if (mkdir(path, 0700) != 0 && errno != EEXIST) {
+		debug("spool: failed to create directory %s: %s\n", path, strerror(errno));
+		goto fail_mkdir;
+	}
+
+	struct spool * spool = (struct spool *) malloc(sizeof(struct spool));
+	if (spool == NULL) {
+		debug("spool: failed to allocate spool\n");
+		goto fail_spool;
+	}
+
+	size_t path_length = strlen(path);
+	char * path_buffer = (char *) malloc(path_length + SPOOL_SEGMENT_NAME_LENGTH + 2);
+	if (path_buffer == NULL) {
+		debug("spool: failed to allocate path buffer\n");
+		goto fail_path;
+	}
+
+	memcpy(path_buffer, path, path_length + 1);
+
+	*spool = (struct spool) {
+		.path = path_buffer,
+		.path_length = path_length,
+		.segment_size = segment_size,
+		.quota = quota,
+		.segments = NULL,
+		.segment_count = 0,
+		.segment_capacity = 0,
+		.next_sequence = 1,
+		.next_id = 1,
+		.disk_size = 0,
+		.pending_count = 0,
+		.evicted_count = 0,
+	};
+
+	if (!__spool_recover(spool)) {
+		goto fail_recover;
+	}
+
+	return spool;
+
+	//
+
+fail_recover:
+	spool_close(spool);
+	return NULL;
+
+fail_path:
+	free(spool);
+fail_spool:
+fail_mkdir:
+	return NULL;
+}
+
+
+void
+spool_close(struct spool * spool) {
+	assert(spool != NULL);
+
+	for (size_t index = 0; index < spool->segment_count; index++) {
+		struct spool_segment * segment = &spool->segments[index];
+		munmap(segment->data, segment->size);
+	}
+
+	free(spool->segments);
+	free(spool->path);
+	free(spool);
+}
+
+
+bool
+spool_append(struct spool * spool, const char * data, size_t size, uint64_t * id) {
+	assert(spool != NULL && (data != NULL || size == 0));
+
+	size_t length = __record_length(size);
+	struct spool_segment * active = (spool->segment_count > 0)
+		? &spool->segments[spool->segment_count - 1] : NULL;
+
+	if (active == NULL || active->used + length > active->size) {
+		size_t segment_size = (length > spool->segment_size) ? length : spool->segment_size;
+		if (segment_size > spool->quota) {
+			debug("spool: record of %zu bytes exceeds quota\n", size);
+			return false;
+		}
+
+		// Make room for the new segment, evicting the oldest ones.
+		while (spool->segment_count > 0 && spool->disk_size + segment_size > spool->quota) {
+			__spool_remove_segment(spool, 0);
+		}
+
+		struct spool_segment segment;
+		if (!__segment_map(spool, &segment, spool->next_sequence, segment_size)) {
+			return false;
+		}
+
+		if (!__spool_push_segment(spool, &segment)) {
+			munmap(segment.data, segment.size);
+			unlink(__segment_path(spool, segment.sequence));
+			return false;
+		}
+
+		spool->next_sequence++;
+
+		// The previously active segment may have no pending records.
+		__spool_collect(spool);
+		active = &spool->segments[spool->segment_count - 1];
+	}
+
+	//
+	// Write the data and the header, then the magic value, and flush the
+	// pages holding the record to disk.
+	//
+	size_t offset = active->used;
+	struct spool_header * header = (struct spool_header *) (active->data + offset);
+
+	memcpy(header + 1, data, size);
+	header->acked = 0;
+	header->id = spool->next_id++;
+	header->size = size;
+	header->checksum = __record_checksum(header);
+	header->reserved = 0;
+	header->magic = SPOOL_RECORD_MAGIC;
+
+	size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+	size_t sync_offset = offset & ~(page_size - 1);
+	if (msync(active->data + sync_offset, offset + length - sync_offset, MS_SYNC) != 0) {
+		debug("spool: failed to flush record: %s\n", strerror(errno));
+	}
+
+	if (active->first_id == 0) {
+		active->first_id = header->id;
+	}
+
+	active->last_id = header->id;
+	active->used += length;
+	active->pending++;
+	spool->pending_count++;
+
+	if (id != NULL) {
+		*id = header->id;
+	}
+
+	return true;
+}
+
+
+/**
+ * Finds the oldest record not acknowledged with an identifier greater
+ * than the given one. Returns the header of the record and the index of
+ * its segment, or NULL if there is no such record.
+ */
+static struct spool_header *
+__spool_find_pending(struct spool * spool, uint64_t after_id, size_t * segment_index) {
+	for (size_t index = 0; index < spool->segment_count; index++) {
+		struct spool_segment * segment = &spool->segments[index];
+		if (segment->pending == 0 || segment->last_id <= after_id) {
+			continue;
+		}
+
+		for (size_t offset = 0; offset < segment->used; ) {
+			struct spool_header * header = (struct spool_header *) (segment->data + offset);
+			if (header->id > after_id && header->acked != SPOOL_RECORD_ACKED) {
+				*segment_index = index;
+				return header;
+			}
+
+			offset += __record_length(header->size);
+		}
+	}
+
+	return NULL;
+}
+
+
+bool
+spool_ack(struct spool * spool, uint64_t id) {
+	assert(spool != NULL && id > 0);
+
+	size_t index;
+	struct spool_header * header = __spool_find_pending(spool, id - 1, &index);
+	if (header == NULL || header->id != id) {
+		debug("spool: no pending record %" PRIu64 "\n", id);
+		return false;
+	}
+
+	// Losing the acknowledgement in a crash only causes a duplicate.
+	header->acked = SPOOL_RECORD_ACKED;
+	spool->segments[index].pending--;
+	spool->pending_count--;
+
+	__spool_collect(spool);
+	return true;
+}
+
+
+bool
+spool_next_pending(struct spool * spool, uint64_t after_id, struct spool_record * record) {
+	assert(spool != NULL && record != NULL);
+
+	size_t index;
+	struct spool_header * header = __spool_find_pending(spool, after_id, &index);
+	if (header == NULL) {
+		return false;
+	}
+
+	*record = (struct spool_record) {
+		.id = header->id,
+		.data = (const char *) (header + 1),
+		.size = header->size,
+	};
+
+	return true;
+}
+
+
+size_t
+spool_pending_count(const struct spool * spool) {
+	assert(spool != NULL);
+	return spool->pending_count;
+}
+
+
+size_t
+spool_disk_size(const struct spool * spool) {
+	assert(spool != NULL);
+	return spool->disk_size;
+}
+
+
+size_t
+spool_evicted_count(const struct spool * spool) {
+	assert(spool != NULL);
+	return spool->evicted_count;
+}
@@ -0,0 +1,239 @@
+/**
+ * Simple pool of worker threads.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include <fivis/debug.h>
+#include <fivis/workers.h>
+
+//
+
+struct workers {
+	/** Total number of threads, including the calling thread. */
+	size_t thread_count;
+
+	/** Worker threads (one less than the thread count). */
+	pthread_t * threads;
+
+	pthread_mutex_t mutex;
+
+	/** Signaled when a new job is available or when stopping. */
+	pthread_cond_t job_cond;
+
+	/** Signaled when the last task completes or a thread leaves a job. */
+	pthread_cond_t done_cond;
+
+	/** Incremented with each job, allows threads to detect new jobs. */
+	unsigned long generation;
+
+	/** Set when the worker threads should terminate. */
+	bool stop;
+
+	//
+
+	/** Task function and argument of the current job. */
+	void (* task) (void * arg, size_t index);
+	void * arg;
+
+	/** Number of tasks in the current job. */
+	size_t task_count;
+
+	/** Index of the next task to claim (updated atomically). */
+	size_t next_task;
+
+	/** Number of completed tasks. */
+	size_t done_count;
+
+	/** Number of worker threads participating in the current job. */
+	size_t active_count;
+};
+
+//
+
+/**
+ * Claims and runs tasks of the current job until there are no more tasks
+ * to claim. Returns the number of tasks completed.
+ */
+static size_t
+__run_tasks(struct workers * workers) {
+	size_t result = 0;
+
+	while (true) {
+		size_t index = __atomic_fetch_add(&workers->next_task, 1, __ATOMIC_RELAXED);
+		if (index >= workers->task_count) {
+			return result;
+		}
+
+		workers->task(workers->arg, index);
+		result++;
+	}
+}
+
+
+static void *
+__worker_main(void * arg) {
+	struct workers * workers = (struct workers *) arg;
+	unsigned long generation = 0;
+
+	pthread_mutex_lock(&workers->mutex);
+
+	while (true) {
+		while (!workers->stop && workers->generation == generation) {
+			pthread_cond_wait(&workers->job_cond, &workers->mutex);
+		}
+
+		if (workers->stop) {
+			break;
+		}
+
+		//
+		// Join the current job. The job fields are stable while there are
+		// active threads, because the caller waits for all of them to
+		// leave the job before returning.
+		//
+		generation = workers->generation;
+		workers->active_count++;
+		pthread_mutex_unlock(&workers->mutex);
+
+		size_t completed = __run_tasks(workers);
+
+		pthread_mutex_lock(&workers->mutex);
+		workers->done_count += completed;
+		workers->active_count--;
+		pthread_cond_signal(&workers->done_cond);
+	}
+
+	pthread_mutex_unlock(&workers->mutex);
+	return NULL;
+}
+
+
+/** Stops and joins the given number of worker threads. */
+static void
+__stop_threads(struct workers * workers, size_t count) {
+	pthread_mutex_lock(&workers->mutex);
+	workers->stop = true;
+	pthread_cond_broadcast(&workers->job_cond);
+	pthread_mutex_unlock(&workers->mutex);
+
+	for (size_t index = 0; index < count; index++) {
+		pthread_join(workers->threads[index], NULL);
+	}
+}
+
+
+struct workers *
+workers_create(size_t thread_count) {
+	assert(thread_count > 0);
+
+	struct workers * workers = (struct workers *) malloc(sizeof(struct workers));
+	if (workers == NULL) {
+		debug("workers: failed to allocate worker pool\n");
+		goto fail_workers;
+	}
+
+	pthread_t * threads = (pthread_t *) calloc(thread_count, sizeof(pthread_t));
+	if (threads == NULL) {
+		debug("workers: failed to allocate %zu threads\n", thread_count);
+		goto fail_threads;
+	}
+
+	*workers = (struct workers) {
+		.thread_count = thread_count,
+		.threads = threads,
+		.mutex = PTHREAD_MUTEX_INITIALIZER,
+		.job_cond = PTHREAD_COND_INITIALIZER,
+		.done_cond = PTHREAD_COND_INITIALIZER,
+		.generation = 0,
+		.stop = false,
+	};
+
+	for (size_t index = 0; index < thread_count - 1; index++) {
+		int result = pthread_create(&threads[index], NULL, __worker_main, workers);
+		if (result != 0) {
+			debug("workers: failed to create thread %zu\n", index);
+			__stop_threads(workers, index);
+			goto fail_create;
+		}
+	}
+
+	return workers;
+
+	//
+
+fail_create:
+	free(threads);
+fail_threads:
+	free(workers);
+fail_workers:
+	return NULL;
+}
+
+
+void
+workers_destroy(struct workers * workers) {
+	assert(workers != NULL);
+
+	__stop_threads(workers, workers->thread_count - 1);
+
+	pthread_cond_destroy(&workers->done_cond);
+	pthread_cond_destroy(&workers->job_cond);
+	pthread_mutex_destroy(&workers->mutex);
+
+	free(workers->threads);
+	free(workers);
+}
+
+
+size_t
+workers_thread_count(const struct workers * workers) {
+	assert(workers != NULL);
+	return workers->thread_count;
+}
+
+
+void
+workers_run(
+	struct workers * workers, size_t task_count,
+	void (* task) (void * arg, size_t index), void * arg
+) {
+	assert(workers != NULL && task != NULL);
+
+	pthread_mutex_lock(&workers->mutex);
+
+	// Wait for threads which joined the previous job after it completed.
+	while (workers->active_count > 0) {
+		pthread_cond_wait(&workers->done_cond, &workers->mutex);
+	}
+
+	workers->task = task;
+	workers->arg = arg;
+	workers->task_count = task_count;
+	workers->next_task = 0;
+	workers->done_count = 0;
+
+	workers->generation++;
+	pthread_cond_broadcast(&workers->job_cond);
+
+	pthread_mutex_unlock(&workers->mutex);
+
+	// Participate in the job.
+	size_t completed = __run_tasks(workers);
+
+	//
+	// Wait until all tasks complete and all worker threads leave the job,
+	// so that late threads do not claim tasks of the next job.
+	//
+	pthread_mutex_lock(&workers->mutex);
+
+	workers->done_count += completed;
+	while (workers->done_count < task_count || workers->active_count > 0) {
+		pthread_cond_wait(&workers->done_cond, &workers->mutex);
+	}
+
+	pthread_mutex_unlock(&workers->mutex);
+}